@@ -0,0 +1,39 @@
+/*
+SoF2GT_QMM - Hook gametype dlls/qvms for Soldier of Fortune 2
+Copyright 2025-2026
+https://github.com/thecybermind/sof2gt_qmm/
+3-clause BSD license: https://opensource.org/license/bsd-3-clause
+
+Created By:
+    Kevin Masterson < k.m.masterson@gmail.com >
+
+*/
+
+#ifndef __SOF2GT_QMM_CVAR_CACHE_H__
+#define __SOF2GT_QMM_CVAR_CACHE_H__
+
+#include <cstdint>
+#include <string>
+#include <qmmapi.h>
+
+// handle cache for GT_CVAR_VARIABLE_INTEGER_VALUE and GT_CVAR_VARIABLE_STRING_BUFFER. the first lookup of a cvar
+// registers a vmCvar_t for it, after which its value is served from that vmCvar_t and refreshed with GT_CVAR_UPDATE
+// (once per vmMain call, or after a GT_CVAR_SET) instead of being looked up by name in the engine every time
+
+// enable or disable the cache and set the engine syscall used to register/update cvars (clears the cache)
+void cvar_cache_init(bool enable, eng_syscall_t syscall);
+
+// mark all cached cvars to be refreshed on next use (start of a vmMain call)
+void cvar_cache_invalidate();
+
+// handle a gametype syscall in place of the engine. returns true (and the return value in ret) if it was handled.
+// args are the native syscall arguments with cmd in args[0] (like SOF2GT_syscall)
+bool cvar_cache_syscall(intptr_t* args, intptr_t& ret);
+
+// hit/update counts, one per line
+std::string cvar_cache_stats();
+
+// reset hit/update counts
+void cvar_cache_reset_stats();
+
+#endif // __SOF2GT_QMM_CVAR_CACHE_H__
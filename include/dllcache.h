@@ -0,0 +1,33 @@
+/*
+SoF2GT_QMM - Hook gametype dlls/qvms for Soldier of Fortune 2
+Copyright 2025-2026
+https://github.com/thecybermind/sof2gt_qmm/
+3-clause BSD license: https://opensource.org/license/bsd-3-clause
+
+Created By:
+    Kevin Masterson < k.m.masterson@gmail.com >
+
+*/
+
+#ifndef __SOF2GT_QMM_DLLCACHE_H__
+#define __SOF2GT_QMM_DLLCACHE_H__
+
+#include <cstddef>
+
+// resident gametype DLLs: modules stay loaded between maps (keyed by path and modification time) so a map change
+// only needs to call dllEntry again instead of dlopen/dlclose
+
+// open a gametype DLL, reusing a resident one if the file hasn't changed. returns nullptr if it can't be opened
+void* dllcache_open(const char* file);
+
+// release a DLL from dllcache_open. it stays resident unless there are more than 'maxresident' idle modules
+// (0 unloads it immediately)
+void dllcache_close(void* dll, size_t maxresident);
+
+// unload all idle DLLs, returns number unloaded
+size_t dllcache_flush();
+
+// number of resident DLLs
+size_t dllcache_count();
+
+#endif // __SOF2GT_QMM_DLLCACHE_H__
@@ -0,0 +1,141 @@
+/*
+SoF2GT_QMM - Hook gametype dlls/qvms for Soldier of Fortune 2
+Copyright 2025-2026
+https://github.com/thecybermind/sof2gt_qmm/
+3-clause BSD license: https://opensource.org/license/bsd-3-clause
+
+Created By:
+    Kevin Masterson < k.m.masterson@gmail.com >
+
+*/
+
+#ifndef __SOF2GT_QMM_GT_SYSCALL_H__
+#define __SOF2GT_QMM_GT_SYSCALL_H__
+
+#include <cstdint>
+#include <qmmapi.h>
+#include "game.h"
+#include "qvm_mem.h"
+
+// this gets an argument value (evaluate to an intptr_t)
+#define vmarg(arg)	(intptr_t)args[arg]
+// this adds the base VM address pointer to an argument value, e.g. vmptr(args[0]) (evaluate to a pointer)
+#define vmptr(val)	((val) ? membase + (val) : nullptr)
+// this subtracts the base VM address pointer from a value, for returning from syscall (this should evaluate to an int)
+#define vmret(ptr)	(int)(ptr ? (intptr_t)ptr - (intptr_t)membase : 0)
+
+// convert a gametype syscall from VM memory (int args, pointers relative to membase) into a native syscall.
+// this is shared by the QVM interpreter (SOF2GT_qvm_syscall) and by modules generated by qvm2c.
+// memsize is the size of the data segment at membase (power of 2). with localmem, GT_MEMSET/GT_MEMCPY/GT_STRNCPY are
+// done here directly on VM memory and never reach 'syscall' (so plugin hooks don't see them)
+inline intptr_t gt_qvm_syscall(eng_syscall_t syscall, uint8_t* membase, size_t memsize, int cmd, int* args, bool localmem) {
+	intptr_t ret = 0;
+
+	switch (cmd) {
+	case GT_MILLISECONDS:					// ( void );
+		ret = syscall(cmd);
+		break;
+	case GT_SIN:							// (double)
+	case GT_COS:							// (double)
+	case GT_SQRT:							// (double)
+	case GT_FLOOR:							// (double)
+	case GT_CEIL:							// (double)
+	case GT_ACOS:							// (double x)
+	case GT_ASIN:							// not used, but probably (double x)
+	case GT_RESETITEM:						// void ( int itemid );
+	case GT_STARTGLOBALSOUND:				// void ( int soundid );
+	case GT_RESTART:						// void ( int delay );
+		ret = syscall(cmd, args[0]);
+		break;
+	case GT_PRINT:							// ( const char *string );
+	case GT_ERROR:							// ( const char *string );
+	case GT_CVAR_UPDATE:					// ( vmCvar_t *vmCvar );
+	case GT_CVAR_VARIABLE_INTEGER_VALUE:	// ( const char *var_name );
+	case GT_REGISTERSOUND:					// int  ( const char* filename );
+	case GT_REGISTEREFFECT:					// int	( const char* name );
+	case GT_REGISTERICON:					// int	( const char* icon );
+	case GT_USETARGETS:						// void ( const char* targetname );
+		ret = syscall(cmd, vmptr(args[0]));
+		break;
+	case GT_ATAN2:							// (double, double)
+	case GT_DOESCLIENTHAVEITEM:				// bool ( int clientid, int itemid );
+	case GT_ADDTEAMSCORE:					// void ( team_t team, int score );
+	case GT_ADDCLIENTSCORE:					// void ( int clientid, int score );
+	case GT_GIVECLIENTITEM:					// void ( int clientid, int itemid );
+	case GT_TAKECLIENTITEM:					// void ( int clientid, int itemid );
+	case GT_SETHUDICON:						// void	( int index, int icon );
+		ret = syscall(cmd, args[0], args[1]);
+		break;
+	case GT_TESTPRINTINT:					// (char*, int)
+	case GT_TESTPRINTFLOAT:					// (char*, float)
+		ret = syscall(cmd, vmptr(args[0]), args[1]);
+		break;
+	case GT_TEXTMESSAGE:					// void ( int clientid, const char* message );
+	case GT_RADIOMESSAGE:					// void ( int clientid, const char* message );
+	case GT_GETCLIENTORIGIN:				// void ( int clientid, vec3_t origin );
+	case GT_STARTSOUND:						// void ( int soundid, vec3_t origin );
+		ret = syscall(cmd, args[0], vmptr(args[1]));
+		break;
+	case GT_CVAR_SET:						// ( const char *var_name, const char *value );
+	case GT_PERPENDICULARVECTOR:			// (vec3_t dst, const vec3_t src)
+		ret = syscall(cmd, vmptr(args[0]), vmptr(args[1]));
+		break;
+	// memory functions are clamped to VM memory the same way as QVM_OP_BLOCK_COPY. they return the VM destination
+	case GT_MEMSET:							// (void* dest, int c, size_t count)
+		if (localmem) {
+			qvm_mem_set(membase, memsize, args[0], args[1], args[2]);
+		}
+		else {
+			size_t dst = (size_t)args[0] & (memsize - 1);
+			syscall(cmd, membase + dst, args[1], args[2] > 0 ? qvm_mem_clamp(dst, (size_t)args[2], memsize) : 0);
+		}
+		ret = args[0];
+		break;
+	case GT_MEMCPY:							// (void* dest, const void* src, size_t count)
+	case GT_STRNCPY:						// (char* strDest, const char* strSource, size_t count)
+		if (localmem) {
+			if (cmd == GT_MEMCPY)
+				qvm_mem_copy(membase, memsize, args[0], args[1], args[2]);
+			else
+				qvm_mem_strncpy(membase, memsize, args[0], args[1], args[2]);
+		}
+		else {
+			size_t dst = (size_t)args[0] & (memsize - 1);
+			size_t src = (size_t)args[1] & (memsize - 1);
+			size_t count = args[2] > 0 ? qvm_mem_clamp(src, qvm_mem_clamp(dst, (size_t)args[2], memsize), memsize) : 0;
+			syscall(cmd, membase + dst, membase + src, count);
+		}
+		ret = args[0];
+		break;
+	case GT_GETCLIENTNAME:					// void ( int clientid, const char* buffer, int buffersize );
+	case GT_GETCLIENTITEMS:					// void ( int clientid, int* buffer, int buffersize );
+	case GT_GETTRIGGERTARGET:				// void ( int triggerid, char* buffer, int buffersize );
+	case GT_GETCLIENTLIST:					// int  ( team_t team, int* clients, int clientcount );
+		ret = syscall(cmd, args[0], vmptr(args[1]), args[2]);
+		break;
+	case GT_CVAR_VARIABLE_STRING_BUFFER:	// ( const char *var_name, char *buffer, int bufsize );
+		ret = syscall(cmd, vmptr(args[0]), vmptr(args[1]), args[2]);
+		break;
+	case GT_REGISTERITEM:					// bool ( int itemid, const char* name, gtItemDef_t* def );
+	case GT_REGISTERTRIGGER:				// bool ( int trigid, const char* name, gtTriggerDef_t* def );
+	case GT_PLAYEFFECT:						// void	( int effect, vec3_t origin, vec3_t angles );
+	case GT_SPAWNITEM:						// void ( int itemid, vec3_t origin, vec3_t angles );
+		ret = syscall(cmd, args[0], vmptr(args[1]), vmptr(args[2]));
+		break;
+	case GT_MATRIXMULTIPLY:					// (float in1[3][3], float in2[3][3], float out[3][3])
+		ret = syscall(cmd, vmptr(args[0]), vmptr(args[1]), vmptr(args[2]));
+		break;
+	case GT_CVAR_REGISTER:					// ( vmCvar_t *vmCvar, const char *varName, const char *defaultValue, int flags );
+		ret = syscall(cmd, vmptr(args[0]), vmptr(args[1]), vmptr(args[2]), args[3]);
+		break;
+	case GT_ANGLEVECTORS:					// (const vec3_t angles, vec3_t forward, vec3_t right, vec3_t up)
+		ret = syscall(cmd, vmptr(args[0]), vmptr(args[1]), vmptr(args[2]), vmptr(args[3]));
+		break;
+	default:
+		ret = 0;
+	}
+
+	return ret;
+}
+
+#endif // __SOF2GT_QMM_GT_SYSCALL_H__
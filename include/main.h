@@ -35,13 +35,6 @@ intptr_t SOF2GT_syscall(intptr_t cmd, ...);
 intptr_t SOFT2GT_qvm_vmmain(intptr_t cmd, ...);
 
 // handle syscalls from QVM gametype mod (redirects to SOF2GT_syscall)
-int SOF2GT_qvm_syscall(uint8_t* membase, int cmd, int* args);
-    
-// this gets an argument value (evaluate to an intptr_t)
-#define vmarg(arg)	(intptr_t)args[arg]
-// this adds the base VM address pointer to an argument value (evaluate to a pointer)
-#define vmptr(arg)	(args[arg] ? membase + args[arg] : nullptr)
-// this subtracts the base VM address pointer from a value, for returning from syscall (this should evaluate to an int)
-#define vmret(ptr)	(int)(ptr ? (intptr_t)ptr - (intptr_t)membase : 0)
+int SOF2GT_qvm_syscall(qvm_t* qvm, uint8_t* membase, int cmd, int* args);
 
 #endif // __SOF2GT_QMM_MAIN_H__
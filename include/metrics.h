@@ -0,0 +1,54 @@
+/*
+SoF2GT_QMM - Hook gametype dlls/qvms for Soldier of Fortune 2
+Copyright 2025-2026
+https://github.com/thecybermind/sof2gt_qmm/
+3-clause BSD license: https://opensource.org/license/bsd-3-clause
+
+Created By:
+    Kevin Masterson < k.m.masterson@gmail.com >
+
+*/
+
+#ifndef __SOF2GT_QMM_METRICS_H__
+#define __SOF2GT_QMM_METRICS_H__
+
+#include <cstdint>
+#include "sof2gt_metrics.h"
+
+// writer side of the shared memory metrics (see sof2gt_metrics.h). all functions do nothing if metrics aren't
+// open, and must only be called from the game thread
+
+// caches that report hits
+enum {
+    METRICS_SYSCALL_CACHE,
+    METRICS_CVAR_CACHE,
+    METRICS_REGISTER_CACHE,
+};
+
+// create the shared memory object for the given server port (replaces a stale one from a previous process). does
+// nothing if it is already open for this port
+bool metrics_open(int port);
+
+// remove the shared memory object
+void metrics_close();
+
+// start timing something (0 if metrics aren't open)
+uint64_t metrics_begin();
+
+// count a syscall/vmMain call that started at 'begin'
+void metrics_syscall(intptr_t cmd, uint64_t begin);
+void metrics_vmmain(intptr_t cmd, uint64_t begin);
+
+// add instructions executed by the QVM since the last call, given its cumulative counter
+void metrics_qvm_instructions(uint64_t counter);
+
+// count a QVM run-time error
+void metrics_runtime_error();
+
+// count a load of the given gametype that started at 'begin'
+void metrics_load(const char* gametype, uint64_t begin);
+
+// count a cache hit
+void metrics_cache_hit(int cache);
+
+#endif // __SOF2GT_QMM_METRICS_H__
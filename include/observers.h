@@ -0,0 +1,42 @@
+/*
+SoF2GT_QMM - Hook gametype dlls/qvms for Soldier of Fortune 2
+Copyright 2025-2026
+https://github.com/thecybermind/sof2gt_qmm/
+3-clause BSD license: https://opensource.org/license/bsd-3-clause
+
+Created By:
+    Kevin Masterson < k.m.masterson@gmail.com >
+
+*/
+
+#ifndef __SOF2GT_QMM_OBSERVERS_H__
+#define __SOF2GT_QMM_OBSERVERS_H__
+
+#include <cstdint>
+#include <string>
+#include "sof2gt_plugin.h"
+
+// asynchronous delivery of finished vmMain/syscall calls to observer plugins (see gt_register_observer). the game
+// thread copies each call into a fixed-size slot of a single-producer/single-consumer ring without locking or
+// allocating, and a worker thread hands the slots to every observer in order. if the ring is full, calls are
+// dropped rather than making the game thread wait
+
+// register a plugin's observer (or unregister it if observer is nullptr). the worker is started with the first one
+bool observers_register(const char* name, sof2gt_observer_t observer);
+
+// queue a finished call for observers (does nothing if there aren't any). this doesn't wake the worker
+void observers_push(int msg, const intptr_t* args, int numargs, intptr_t ret);
+
+// wake the worker if it is asleep with calls queued. called once per top-level vmMain call rather than per call
+void observers_wake();
+
+// deliver anything still queued and stop the worker
+void observers_stop();
+
+// per-observer report (empty if no observers were registered)
+std::string observers_report();
+
+// reset counts
+void observers_reset_stats();
+
+#endif // __SOF2GT_QMM_OBSERVERS_H__
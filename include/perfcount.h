@@ -0,0 +1,56 @@
+/*
+SoF2GT_QMM - Hook gametype dlls/qvms for Soldier of Fortune 2
+Copyright 2025-2026
+https://github.com/thecybermind/sof2gt_qmm/
+3-clause BSD license: https://opensource.org/license/bsd-3-clause
+
+Created By:
+    Kevin Masterson < k.m.masterson@gmail.com >
+
+*/
+
+#ifndef __SOF2GT_QMM_PERFCOUNT_H__
+#define __SOF2GT_QMM_PERFCOUNT_H__
+
+#include <cstdint>
+#include <string>
+
+// CPU performance counters (Linux perf_event_open) read around QVM execution and plugin hooks, totalled per
+// gametype vmMain cmd. hardware counters (cycles, instructions, branch misses, L1 misses) are used if available,
+// otherwise software counters (task clock, context switches, page faults). counters only count the thread that
+// called perfcount_start(), which must be the game thread
+
+#define PERFCOUNT_MAX_COUNTERS  5
+
+// sections of a vmMain call that are measured
+enum {
+    PERFCOUNT_QVM,      // qvm_exec
+    PERFCOUNT_PLUGINS,  // SOF2GT_vmMain and SOF2GT_vmMain_Post plugin hooks
+    PERFCOUNT_SECTIONS
+};
+
+// counter values at the start of a section
+struct perfcount_sample_t {
+    bool active;
+    uint64_t values[PERFCOUNT_MAX_COUNTERS];
+};
+
+// open counters and start counting (clears totals). returns false if no counters could be opened
+bool perfcount_start();
+
+// stop counting and close counters
+void perfcount_stop();
+
+// is counting active
+bool perfcount_active();
+
+// start of a section (nested sections of the same kind are counted by the outermost one)
+void perfcount_begin(int section, perfcount_sample_t& sample);
+
+// end of a section, add to totals for 'cmd'
+void perfcount_end(int section, intptr_t cmd, perfcount_sample_t& sample);
+
+// per-cmd totals, one line per cmd and section
+std::string perfcount_report();
+
+#endif // __SOF2GT_QMM_PERFCOUNT_H__
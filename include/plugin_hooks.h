@@ -0,0 +1,38 @@
+/*
+SoF2GT_QMM - Hook gametype dlls/qvms for Soldier of Fortune 2
+Copyright 2025-2026
+https://github.com/thecybermind/sof2gt_qmm/
+3-clause BSD license: https://opensource.org/license/bsd-3-clause
+
+Created By:
+    Kevin Masterson < k.m.masterson@gmail.com >
+
+*/
+
+#ifndef __SOF2GT_QMM_PLUGIN_HOOKS_H__
+#define __SOF2GT_QMM_PLUGIN_HOOKS_H__
+
+#include <cstdint>
+#include <string>
+#include "sof2gt_plugin.h"
+
+// routing of SOF2GT_vmMain/SOF2GT_syscall hook messages to plugins. plugins that registered a handler (see
+// gt_register_handler) are called directly, one at a time, so each one's time and results can be counted. the
+// message is then broadcast through QMM to all other plugins, which are counted together
+
+// register a plugin's handler (or unregister it if handler is nullptr)
+bool plugin_hooks_register(const char* name, sof2gt_handler_t handler);
+
+// measure time spent in each handler (calls and results are always counted)
+void plugin_hooks_timing(bool enable);
+
+// send a hook message (SOF2GT_MSG_*) to registered handlers and then to all other plugins
+void plugin_hooks_run(int msg, intptr_t* args, int numargs);
+
+// per-plugin report, sorted by "time" (default), "avg", "calls", "override", "supercede" or "name"
+std::string plugin_hooks_report(const char* sort);
+
+// reset counts
+void plugin_hooks_reset_stats();
+
+#endif // __SOF2GT_QMM_PLUGIN_HOOKS_H__
@@ -0,0 +1,35 @@
+/*
+SoF2GT_QMM - Hook gametype dlls/qvms for Soldier of Fortune 2
+Copyright 2025-2026
+https://github.com/thecybermind/sof2gt_qmm/
+3-clause BSD license: https://opensource.org/license/bsd-3-clause
+
+Created By:
+    Kevin Masterson < k.m.masterson@gmail.com >
+
+*/
+
+#ifndef __SOF2GT_QMM_PRELOAD_H__
+#define __SOF2GT_QMM_PRELOAD_H__
+
+#include <cstdint>
+#include <vector>
+#include "qvm.h"
+
+// background QVM loading: the file is read on the game thread (engine FS calls aren't thread-safe), then qvm_load
+// decodes it into a standby qvm_t on a worker thread. only one gametype is preloaded at a time
+
+// start loading a gametype QVM on a worker thread (replaces any other preload)
+void preload_start(const char* gametype, std::vector<uint8_t>&& filemem, vmsyscall_t vmsyscall, int flags, qvm_alloc_t* allocator);
+
+// wait for a preload of the given gametype with the same load options to finish and move it into qvm. returns false
+// if there isn't one (any other preload is discarded)
+bool preload_take(const char* gametype, int flags, qvm_alloc_t* allocator, qvm_t* qvm);
+
+// check if the given gametype is being (or has been) preloaded
+bool preload_pending(const char* gametype);
+
+// wait for and discard any preload
+void preload_cancel();
+
+#endif // __SOF2GT_QMM_PRELOAD_H__
@@ -25,6 +25,26 @@ Created By:
 #define QVM_PROGRAMSTACK_SIZE           0x10000     // 64KiB
 // allow extra space to be allocated to the data segment for additional stack space
 #define QVM_EXTRA_PROGRAMSTACK_SIZE     0
+// max size of a leaf function (in instructions, without QVM_OP_ENTER) to splice into its callers with QVM_LOAD_INLINE
+#define QVM_INLINE_MAX_INSTRUCTIONS     32
+// max stack frame size of a leaf function to splice into its callers (this much is added to each caller's frame)
+#define QVM_INLINE_MAX_FRAMESIZE        128
+
+// max number of arguments passed to vmMain or a function by qvm_exec/qvm_call/qvm_begin (vmMain takes 13 at most)
+#define QVM_MAX_ARGS                    16
+
+// max number of VM functions that can be overridden by native functions with qvm_override (power of 2)
+#define QVM_MAX_NATIVES                 64
+
+// how many instructions a run started by qvm_begin/qvm_resume executes between checks of its time limit
+#define QVM_SLICE_CHECK_INSTRUCTIONS    1024
+
+// page sizes used by qvm_allocator_mmap
+#define QVM_PAGE_SIZE                   4096
+#define QVM_HUGEPAGE_SIZE               (2 * 1024 * 1024)
+
+// how long qvm_load waits for another process to finish publishing a shared code image before decoding its own
+#define QVM_SHARED_WAIT_MS              5000
 
 // round number up to next power of 2: https://stackoverflow.com/a/1322548/809900
 #define QVM_NEXT_POW_2(var) var--; var |= var >> 1; var |= var >> 2; var |= var >> 4; var |= var >> 8; var |= var >> 16; var++;
@@ -39,6 +59,8 @@ Created By:
 
 // move instruction pointer to a given index, masked to code segment
 #define QVM_JUMP(x) opptr = qvm->codesegment + ((x) & codemask)
+// move instruction pointer to an original (.qvm) instruction index, like a function address or switch table entry
+#define QVM_JUMP_ORIG(x) QVM_JUMP(qvm->codemap[(x) & mapmask])
 
 // branch comparisons
 // signed integer comparison
@@ -60,10 +82,35 @@ Created By:
 // floating point (done to self)
 #define QVM_SFOP(o) *(float*)&stack[0] = o *(float*)&stack[0]
 
+// fixed size block copy (stack[0] copied to stack[1]), falls back to the clamped copy if the range crosses the end of the data segment
+#define QVM_BLOCK_COPY_N(n) { \
+    size_t srci = (size_t)(unsigned int)stack[0] & datamask; \
+    size_t dsti = (size_t)(unsigned int)stack[1] & datamask; \
+    QVM_POPN(2); \
+    if (srci + (n) <= qvm->dataseglen && dsti + (n) <= qvm->dataseglen) \
+        qvm_mem_copy##n(qvm->datasegment + dsti, qvm->datasegment + srci); \
+    else \
+        qvm_mem_copy(qvm->datasegment, qvm->dataseglen, (int)dsti, (int)srci, (n)); \
+}
+
+
+
+// qvm_load flags
+#define QVM_LOAD_VERIFY_DATA            1           // verify data access is inside the memory block
+#define QVM_LOAD_OPTIMIZE               2           // optimize bytecode at load time (see qvm_opt.c)
+#define QVM_LOAD_INLINE                 4           // splice small leaf functions into callers (with QVM_LOAD_OPTIMIZE)
+#define QVM_LOAD_SHARE_CODE             8           // map the decoded code image from shared memory (shared between processes)
 
+typedef struct qvm_s qvm_t;
 
-// function to receive syscalls (engine traps) out of VM
-typedef int (*vmsyscall_t)(uint8_t* membase, int cmd, int* args);
+// function to receive syscalls (engine traps) out of VM. qvm->userdata is the owner's context
+typedef int (*vmsyscall_t)(qvm_t* qvm, uint8_t* membase, int cmd, int* args);
+
+// function to receive log messages from a VM (severity is QMM_LOG_*), instead of log_c
+typedef void (*qvm_log_t)(qvm_t* qvm, int severity, const char* msg);
+
+// native function that replaces a VM function (see qvm_override). args are the VM function's arguments
+typedef int (*qvm_nativefunc_t)(uint8_t* membase, int* args);
 
 // list of VM instructions
 typedef enum qvmopcode_e {
@@ -129,6 +176,16 @@ typedef enum qvmopcode_e {
     QVM_OP_CVFI,
 
     QVM_OP_NUM_OPS,
+
+    // internal opcodes generated by qvm_load/qvm_optimize, never valid in a .qvm file
+    QVM_OP_JUMPD = QVM_OP_NUM_OPS,  // jump to instruction index in param
+    QVM_OP_BLOCK_COPY12,            // QVM_OP_BLOCK_COPY with param 12 (vec3_t)
+    QVM_OP_BLOCK_COPY16,            // QVM_OP_BLOCK_COPY with param 16
+    QVM_OP_BLOCK_COPY32,            // QVM_OP_BLOCK_COPY with param 32
+    QVM_OP_BLOCK_COPY64,            // QVM_OP_BLOCK_COPY with param 64
+    QVM_OP_NATIVE,                  // replaces QVM_OP_ENTER of a function overridden with qvm_override, param is natives index
+
+    QVM_OP_NUM_INTERNAL_OPS,
 } qvmopcode_t;
 
 // array of strings of opcode names
@@ -161,9 +218,57 @@ typedef struct qvm_alloc_s {
 
 // default vm allocator (uses malloc/free)
 extern qvm_alloc_t qvm_allocator_default;
+// page allocator (mmap/VirtualAlloc). memory is page aligned (huge page aligned and backed by transparent
+// huge pages where available for blocks of at least QVM_HUGEPAGE_SIZE) and faulted in at allocation
+extern qvm_alloc_t qvm_allocator_mmap;
+
+// a VM function overridden by a native function
+typedef struct qvm_native_s {
+    qvm_nativefunc_t func;          // native function (NULL if slot is unused)
+    int addr;                       // function address (original instruction index)
+    int enterparam;                 // param of the QVM_OP_ENTER instruction replaced by QVM_OP_NATIVE
+} qvm_native_t;
+
+// results of qvm_begin/qvm_resume
+typedef enum qvmstatus_e {
+    QVM_RUN_ERROR = -1,             // invalid call, or a run-time error (the VM was unloaded)
+    QVM_RUN_DONE = 0,               // the function returned
+    QVM_RUN_YIELDED = 1,            // the budget ran out, continue with qvm_resume
+} qvmstatus_t;
+
+// a run paused by qvm_begin/qvm_resume. its stack frames and opstack values stay where they are, and calls made
+// while it is paused run below them, like nested calls from a syscall
+typedef struct qvm_paused_s {
+    int active;                     // 1 if a run is paused
+    int instr;                      // code segment index of the next instruction
+    int* programstack;              // program stack pointer
+    int* stack;                     // opstack pointer
+    int* entryprogramstack;         // program stack pointer when the run started
+    int* entrystack;                // opstack pointer when the run started
+    int framesize;                  // size of the run's entry stack frame
+    int cmd;                        // first argument (for logging)
+} qvm_paused_t;
+
+// execution state reused by every qvm_exec call on a VM, including nested calls (e.g. from a syscall handler)
+typedef struct qvm_context_s {
+    // opstack for math/comparison/temp/etc operations (instead of using registers)
+    // +2 for a fixed sentinel so 2 values (like QVM_OP_BLOCK_COPY) can be "harmlessly" read if opstack is empty
+    int opstack[QVM_OPSTACK_SIZE + 2];
+    // current opstack pointer (starts at end of block, grows down). a nested qvm_exec call starts from here
+    int* stack;
+    // number of qvm_exec calls currently running
+    int depth;
+    // run paused by qvm_begin/qvm_resume
+    qvm_paused_t paused;
+} qvm_context_t;
+
+// all the info for a single QVM object. there is no state shared between objects, so different objects can be used
+// on different threads at the same time (each object must only be used by one thread at a time)
+struct qvm_s {
+    // owner's context (set before qvm_load, and kept by qvm_unload)
+    void* userdata;                 // for use by vmsyscall, log and native functions
+    qvm_log_t log;                  // log function (NULL to use log_c)
 
-// all the info for a single QVM object
-typedef struct qvm_s {
     // syscall
     vmsyscall_t vmsyscall;          // e.g. Q3A_vmsyscall function from game_q3a.cpp
 
@@ -171,53 +276,120 @@ typedef struct qvm_s {
     uint8_t* memory;                // main block of memory
     size_t memorysize;              // size of memory block
 
-    // segments (into memory block)
+    // segments (into memory block, or into shared code image)
     qvmop_t* codesegment;           // code segment, each op is 8 bytes (4 op, 4 param)
     uint8_t* datasegment;           // data segment, partially filled on load
 
     // segment sizes
     size_t instructioncount;        // number of instructions, from qvm header
+    size_t codecount;               // number of instructions in code segment (differs if optimized)
     size_t codeseglen;              // size of code segment
     size_t dataseglen;              // size of data segment
     size_t stacksize;               // size of stack in bss segment
 
+    // instruction maps (after code segment)
+    int* codemap;                   // original instruction index -> code segment index (for function pointers/jump tables)
+    size_t codemapsize;             // number of codemap entries (power of 2 for masking)
+    int* origindex;                 // code segment index -> original instruction index (for error messages)
+
+    // execution context (into memory block, after data segment)
+    qvm_context_t* context;
+
+    // shared code image (QVM_LOAD_SHARE_CODE), holds code segment and instruction maps. read-only
+    void* sharedimage;              // mapping of shared memory object (NULL if code image is in memory block)
+    size_t sharedimagesize;         // size of mapping
+    void* sharedhandle;             // file mapping handle (windows only)
+
+    // native overrides, indexed by QVM_OP_NATIVE param
+    qvm_native_t natives[QVM_MAX_NATIVES];
+
+    // number of instructions executed since load (for metrics)
+    uint64_t instructions;
+
     // registers
     int* stackptr;                  // pointer to current location in program stack
+    int trapinstr;                  // code segment index of the engine trap being made (valid inside vmsyscall)
 
     // extra
     size_t filesize;                // .qvm file size
+    qvmheader_t header;             // .qvm file header (segment sizes, for checking a new version's layout)
     qvm_alloc_t* allocator;         // allocator
     int verify_data;                // verify data access is inside the memory block
-} qvm_t;
+};
 
 #ifdef __cplusplus
 extern "C" {
 #endif // __cplusplus
 
 /**
-* Create and initialize a new VM from a QVM file
+* Create and initialize a new VM from a QVM file. qvm must be empty (zeroed or unloaded), except for userdata and log
 * 
 * @param [qvm_t*] qvm - Pointer to qvm_t object to store VM information
 * @param [const uint8_t*] filemem - Buffer with QVM file contents
 * @param [size_t] filesize - Size of the filemem buffer
 * @param [vmsyscall_t] vmsyscall - Function to be called for engine traps
-* @param [size_t] stacksize - Size of QVM program stack in MiB
-* @param [int] verify_data - (Boolean) Should data segment reads and writes be validated?
+* @param [int] flags - QVM_LOAD_* flags (1/true is QVM_LOAD_VERIFY_DATA)
 * @param [qvm_alloc_t*] allocator - Pointer to a qvm_alloc_t object which contains custom alloc/free function pointers (pass NULL for default)
 * @returns [int] - (Boolean) 1 if success, 0 if failure
 */
-int qvm_load(qvm_t* qvm, const uint8_t* filemem, size_t filesize, vmsyscall_t vmsyscall, int verify_data, qvm_alloc_t* allocator);
+int qvm_load(qvm_t* qvm, const uint8_t* filemem, size_t filesize, vmsyscall_t vmsyscall, int flags, qvm_alloc_t* allocator);
 
 /**
 * Begin execution in a VM
 *
 * @param [qvm_t*] qvm - Pointer to qvm_t object to execute
-* @param [int] argc - Number of arguments to pass to VM entry point
+* @param [int] argc - Number of arguments to pass to VM entry point (at most QVM_MAX_ARGS)
 * @param [int*] argv - Array of arguments to pass to VM entry point
 * @returns [int] - Return value from VM entry point
 */
 int qvm_exec(qvm_t* qvm, int argc, int* argv);
 
+/**
+* Call a VM function directly (instead of going through vmMain)
+*
+* @param [qvm_t*] qvm - Pointer to qvm_t object to execute
+* @param [int] addr - Function address (original instruction index, as in a .map file or a function pointer)
+* @param [int] argc - Number of arguments to pass to the function (at most QVM_MAX_ARGS)
+* @param [int*] argv - Array of arguments to pass to the function
+* @returns [int] - Return value from the function (0 if addr is not a function)
+*/
+int qvm_call(qvm_t* qvm, int addr, int argc, int* argv);
+
+/**
+* Start a call that stops when it runs out of budget and can be continued later (e.g. on the next server frame), to
+* spread long work over several frames. Only one such run can be paused at a time. While it is paused, other calls
+* into the VM (qvm_exec, qvm_call) work as usual, running below its stack frames. Can't be used from inside another
+* call into the VM (e.g. from a syscall handler)
+*
+* @param [qvm_t*] qvm - Pointer to qvm_t object to execute
+* @param [int] addr - Function address (original instruction index), or -1 for vmMain
+* @param [int] argc - Number of arguments to pass to the function (at most QVM_MAX_ARGS)
+* @param [int*] argv - Array of arguments to pass to the function
+* @param [uint64_t] maxinstructions - Instructions to run before yielding (0 for no limit)
+* @param [uint64_t] maxusec - Microseconds to run before yielding, checked every QVM_SLICE_CHECK_INSTRUCTIONS (0 for no limit)
+* @param [int*] ret - Receives the return value if the function returned
+* @returns [int] - QVM_RUN_DONE, QVM_RUN_YIELDED or QVM_RUN_ERROR (see qvmstatus_t)
+*/
+int qvm_begin(qvm_t* qvm, int addr, int argc, int* argv, uint64_t maxinstructions, uint64_t maxusec, int* ret);
+
+/**
+* Continue a run paused by qvm_begin or qvm_resume, with a new budget
+*
+* @param [qvm_t*] qvm - Pointer to qvm_t object to execute
+* @param [uint64_t] maxinstructions - Instructions to run before yielding (0 for no limit)
+* @param [uint64_t] maxusec - Microseconds to run before yielding (0 for no limit)
+* @param [int*] ret - Receives the return value if the function returned
+* @returns [int] - QVM_RUN_DONE, QVM_RUN_YIELDED or QVM_RUN_ERROR (see qvmstatus_t)
+*/
+int qvm_resume(qvm_t* qvm, uint64_t maxinstructions, uint64_t maxusec, int* ret);
+
+/**
+* Abandon a paused run, removing its stack frames. Anything it already wrote to VM memory stays
+*
+* @param [qvm_t*] qvm - Pointer to qvm_t object
+*/
+void qvm_cancel(qvm_t* qvm);
+
 /**
 * Unload a VM
 *
@@ -225,6 +397,32 @@ int qvm_exec(qvm_t* qvm, int argc, int* argv);
 */
 void qvm_unload(qvm_t* qvm);
 
+/**
+* Replace a VM function with a native function, or restore the VM function. The function's QVM_OP_ENTER is replaced
+* so every call to it (direct or through a function pointer) calls the native function instead. Fails if the code
+* segment is shared (QVM_LOAD_SHARE_CODE) or if the function was inlined into any callers (QVM_LOAD_INLINE)
+*
+* @param [qvm_t*] qvm - Pointer to qvm_t object
+* @param [int] addr - Function address (original instruction index, as in a .map file or a function pointer)
+* @param [qvm_nativefunc_t] func - Native function to call instead, or NULL to restore the VM function
+* @returns [int] - (Boolean) 1 if success, 0 if failure
+*/
+int qvm_override(qvm_t* qvm, int addr, qvm_nativefunc_t func);
+
+/**
+* Optimize decoded instructions (used by qvm_load with QVM_LOAD_OPTIMIZE)
+*
+* @param [qvmop_t**] code - malloc'd array of decoded instructions, replaced with optimized instructions
+* @param [int**] origindex - malloc'd array of original instruction indexes for each instruction, replaced to match code
+* @param [int*] codemap - Array of instructioncount entries to receive new instruction index for each original index
+* @param [size_t] instructioncount - Number of instructions in code
+* @param [const uint8_t*] data - Initialized data segment (scanned for code addresses)
+* @param [size_t] datalen - Size of initialized data segment
+* @param [int] flags - QVM_LOAD_* flags (QVM_LOAD_INLINE enables inlining)
+* @returns [size_t] - New number of instructions, or 0 if optimization failed (code/origindex untouched)
+*/
+size_t qvm_optimize(qvmop_t** code, int** origindex, int* codemap, size_t instructioncount, const uint8_t* data, size_t datalen, int flags);
+
 #ifdef __cplusplus
 }
 #endif // __cplusplus
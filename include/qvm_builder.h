@@ -0,0 +1,206 @@
+/*
+SoF2GT_QMM - Hook gametype dlls/qvms for Soldier of Fortune 2
+Copyright 2025-2026
+https://github.com/thecybermind/sof2gt_qmm/
+3-clause BSD license: https://opensource.org/license/bsd-3-clause
+
+Created By:
+    Kevin Masterson < k.m.masterson@gmail.com >
+
+*/
+
+#ifndef __QMM2_QVM_BUILDER_H__
+#define __QMM2_QVM_BUILDER_H__
+
+#include <stdint.h>
+#include <stddef.h>
+#include "qvm.h"
+
+// builds .qvm images one instruction at a time, for generated test and benchmark programs (see tools/qvm_bench.c).
+// addresses are symbols, like in q3asm: a symbol is created in a segment, placed (given an instruction index or a
+// segment offset) when its code or data is added, and can be used as an instruction param or a data word before it
+// is placed. everything is resolved by qvm_builder_finish. instruction 0 is the vmMain entry point, and the program
+// stack (QVM_PROGRAMSTACK_SIZE) is added to the end of bss like q3asm does
+
+// segments (same numbers as q3asm .map files)
+typedef enum qvmsegment_e {
+    QVM_SEG_CODE,
+    QVM_SEG_DATA,
+    QVM_SEG_LIT,
+    QVM_SEG_BSS,
+} qvmsegment_t;
+
+// a symbol
+typedef struct qvm_symbol_s {
+    char name[64];                  // name for the .map file (empty for internal labels)
+    qvmsegment_t segment;
+    int offset;                     // instruction index or offset in segment (-1 until placed)
+    int address;                    // final address (set by qvm_builder_finish)
+} qvm_symbol_t;
+
+// a reference to a symbol that is resolved by qvm_builder_finish
+typedef struct qvm_fixup_s {
+    int symbol;
+    int addend;
+    qvmsegment_t segment;           // QVM_SEG_CODE for an instruction param, QVM_SEG_DATA for a data word
+    int at;                         // instruction index or data offset
+} qvm_fixup_t;
+
+// builder state
+typedef struct qvm_builder_s {
+    qvmop_t* code;
+    size_t codecount;
+    size_t codecap;
+
+    uint8_t* data;                  // initialized 4-byte words
+    size_t datalen;
+    size_t datacap;
+
+    uint8_t* lit;                   // initialized bytes (strings)
+    size_t litlen;
+    size_t litcap;
+
+    size_t bsslen;                  // uninitialized bytes (without the program stack)
+
+    qvm_symbol_t* symbols;
+    size_t symbolcount;
+    size_t symbolcap;
+
+    qvm_fixup_t* fixups;
+    size_t fixupcount;
+    size_t fixupcap;
+
+    int error;                      // set if anything failed to be added, qvm_builder_finish then fails
+} qvm_builder_t;
+
+#ifdef __cplusplus
+extern "C" {
+#endif // __cplusplus
+
+/**
+* Initialize an empty builder
+*
+* @param [qvm_builder_t*] builder - Pointer to qvm_builder_t object
+*/
+void qvm_builder_init(qvm_builder_t* builder);
+
+/**
+* Free everything held by a builder
+*
+* @param [qvm_builder_t*] builder - Pointer to qvm_builder_t object
+*/
+void qvm_builder_free(qvm_builder_t* builder);
+
+/**
+* Create a symbol that is placed later (e.g. a forward jump target or a function that isn't written yet)
+*
+* @param [qvm_builder_t*] builder - Pointer to qvm_builder_t object
+* @param [const char*] name - Name for the .map file (NULL or "" for none)
+* @param [qvmsegment_t] segment - Segment the symbol will be placed in
+* @returns [int] - Symbol index, or -1 if failure
+*/
+int qvm_builder_symbol(qvm_builder_t* builder, const char* name, qvmsegment_t segment);
+
+/**
+* Place a symbol at the current end of its segment (the next instruction, for code symbols)
+*
+* @param [qvm_builder_t*] builder - Pointer to qvm_builder_t object
+* @param [int] symbol - Symbol index from qvm_builder_symbol
+*/
+void qvm_builder_place(qvm_builder_t* builder, int symbol);
+
+/**
+* Create a code symbol at the next instruction (a function or a backward jump target)
+*
+* @param [qvm_builder_t*] builder - Pointer to qvm_builder_t object
+* @param [const char*] name - Name for the .map file (NULL or "" for none)
+* @returns [int] - Symbol index, or -1 if failure
+*/
+int qvm_builder_label(qvm_builder_t* builder, const char* name);
+
+/**
+* Add an instruction
+*
+* @param [qvm_builder_t*] builder - Pointer to qvm_builder_t object
+* @param [qvmopcode_t] op - Opcode (QVM_OP_UNDEF to QVM_OP_CVFI)
+* @param [int] param - Param (ignored for opcodes that don't have one)
+* @returns [int] - Instruction index, or -1 if failure
+*/
+int qvm_builder_op(qvm_builder_t* builder, qvmopcode_t op, int param);
+
+/**
+* Add an instruction whose param is the address of a symbol (e.g. QVM_OP_CONST of a function or global variable,
+* or a branch target)
+*
+* @param [qvm_builder_t*] builder - Pointer to qvm_builder_t object
+* @param [qvmopcode_t] op - Opcode
+* @param [int] symbol - Symbol index
+* @param [int] addend - Added to the symbol address
+* @returns [int] - Instruction index, or -1 if failure
+*/
+int qvm_builder_op_symbol(qvm_builder_t* builder, qvmopcode_t op, int symbol, int addend);
+
+/**
+* Add initialized words to the data segment
+*
+* @param [qvm_builder_t*] builder - Pointer to qvm_builder_t object
+* @param [const char*] name - Name of a symbol for the first word (NULL or "" for none)
+* @param [const int*] words - Words to add (NULL to add zeroes)
+* @param [size_t] count - Number of words
+* @returns [int] - Symbol index, or -1 if failure
+*/
+int qvm_builder_data(qvm_builder_t* builder, const char* name, const int* words, size_t count);
+
+/**
+* Add a data word holding the address of a symbol (e.g. a function pointer or jump table entry)
+*
+* @param [qvm_builder_t*] builder - Pointer to qvm_builder_t object
+* @param [int] symbol - Symbol index
+* @param [int] addend - Added to the symbol address
+*/
+void qvm_builder_data_symbol(qvm_builder_t* builder, int symbol, int addend);
+
+/**
+* Add bytes to the lit segment (padded to 4 bytes)
+*
+* @param [qvm_builder_t*] builder - Pointer to qvm_builder_t object
+* @param [const char*] name - Name of a symbol for the first byte (NULL or "" for none)
+* @param [const void*] bytes - Bytes to add
+* @param [size_t] len - Number of bytes
+* @returns [int] - Symbol index, or -1 if failure
+*/
+int qvm_builder_lit(qvm_builder_t* builder, const char* name, const void* bytes, size_t len);
+
+/**
+* Reserve uninitialized bytes in the bss segment (rounded up to 4 bytes)
+*
+* @param [qvm_builder_t*] builder - Pointer to qvm_builder_t object
+* @param [const char*] name - Name of a symbol for the first byte (NULL or "" for none)
+* @param [size_t] len - Number of bytes
+* @returns [int] - Symbol index, or -1 if failure
+*/
+int qvm_builder_bss(qvm_builder_t* builder, const char* name, size_t len);
+
+/**
+* Resolve all symbols and write a .qvm image
+*
+* @param [qvm_builder_t*] builder - Pointer to qvm_builder_t object
+* @param [size_t*] size - Receives the size of the image
+* @returns [uint8_t*] - malloc'd .qvm image (free with free), or NULL if failure
+*/
+uint8_t* qvm_builder_finish(qvm_builder_t* builder, size_t* size);
+
+/**
+* Write the named symbols as a q3asm .map file (after qvm_builder_finish)
+*
+* @param [qvm_builder_t*] builder - Pointer to qvm_builder_t object
+* @param [size_t*] len - Receives the length of the text
+* @returns [char*] - malloc'd text (free with free), or NULL if failure
+*/
+char* qvm_builder_map(qvm_builder_t* builder, size_t* len);
+
+#ifdef __cplusplus
+}
+#endif // __cplusplus
+
+#endif // __QMM2_QVM_BUILDER_H__
@@ -0,0 +1,131 @@
+/*
+SoF2GT_QMM - Hook gametype dlls/qvms for Soldier of Fortune 2
+Copyright 2025-2026
+https://github.com/thecybermind/sof2gt_qmm/
+3-clause BSD license: https://opensource.org/license/bsd-3-clause
+
+Created By:
+    Kevin Masterson < k.m.masterson@gmail.com >
+
+*/
+
+#ifndef __QMM2_QVM_MEM_H__
+#define __QMM2_QVM_MEM_H__
+
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define QVM_MEM_SSE2
+#endif
+
+// bulk memory helpers used by QVM_OP_BLOCK_COPY and the GT_MEMCPY/GT_MEMSET/GT_STRNCPY traps.
+// offsets are relative to the start of a data segment of 'seglen' bytes (a power of 2). they are masked to the
+// segment, and counts are clamped so the whole range stays inside it. overlapping copies behave like memmove
+
+// clamp 'count' bytes starting at (masked) 'offset' to the end of the segment
+static inline size_t qvm_mem_clamp(size_t offset, size_t count, size_t seglen) {
+    return count > seglen - offset ? seglen - offset : count;
+}
+
+
+// copy 'count' bytes from 'src' to 'dst'
+static inline void qvm_mem_copy(uint8_t* seg, size_t seglen, int dst, int src, int count) {
+    size_t srci = (size_t)src & (seglen - 1);
+    size_t dsti = (size_t)dst & (seglen - 1);
+
+    // skip if src/dst are the same
+    if (srci == dsti || count <= 0)
+        return;
+
+    size_t n = qvm_mem_clamp(srci, (size_t)count, seglen);
+    n = qvm_mem_clamp(dsti, n, seglen);
+    memmove(seg + dsti, seg + srci, n);
+}
+
+
+// fixed size copies between real pointers, for QVM_OP_BLOCK_COPY of common struct sizes. everything is loaded
+// before anything is stored, so overlapping ranges are handled
+static inline void qvm_mem_copy12(uint8_t* dst, const uint8_t* src) {
+    uint64_t a;
+    uint32_t b;
+    memcpy(&a, src, sizeof(a));
+    memcpy(&b, src + 8, sizeof(b));
+    memcpy(dst, &a, sizeof(a));
+    memcpy(dst + 8, &b, sizeof(b));
+}
+
+
+static inline void qvm_mem_copy16(uint8_t* dst, const uint8_t* src) {
+#ifdef QVM_MEM_SSE2
+    _mm_storeu_si128((__m128i*)dst, _mm_loadu_si128((const __m128i*)src));
+#else
+    uint8_t tmp[16];
+    memcpy(tmp, src, sizeof(tmp));
+    memcpy(dst, tmp, sizeof(tmp));
+#endif
+}
+
+
+static inline void qvm_mem_copy32(uint8_t* dst, const uint8_t* src) {
+#ifdef QVM_MEM_SSE2
+    __m128i a = _mm_loadu_si128((const __m128i*)src);
+    __m128i b = _mm_loadu_si128((const __m128i*)(src + 16));
+    _mm_storeu_si128((__m128i*)dst, a);
+    _mm_storeu_si128((__m128i*)(dst + 16), b);
+#else
+    uint8_t tmp[32];
+    memcpy(tmp, src, sizeof(tmp));
+    memcpy(dst, tmp, sizeof(tmp));
+#endif
+}
+
+
+static inline void qvm_mem_copy64(uint8_t* dst, const uint8_t* src) {
+#ifdef QVM_MEM_SSE2
+    __m128i a = _mm_loadu_si128((const __m128i*)src);
+    __m128i b = _mm_loadu_si128((const __m128i*)(src + 16));
+    __m128i c = _mm_loadu_si128((const __m128i*)(src + 32));
+    __m128i d = _mm_loadu_si128((const __m128i*)(src + 48));
+    _mm_storeu_si128((__m128i*)dst, a);
+    _mm_storeu_si128((__m128i*)(dst + 16), b);
+    _mm_storeu_si128((__m128i*)(dst + 32), c);
+    _mm_storeu_si128((__m128i*)(dst + 48), d);
+#else
+    uint8_t tmp[64];
+    memcpy(tmp, src, sizeof(tmp));
+    memcpy(dst, tmp, sizeof(tmp));
+#endif
+}
+
+
+// set 'count' bytes at 'dst' to 'c'
+static inline void qvm_mem_set(uint8_t* seg, size_t seglen, int dst, int c, int count) {
+    size_t dsti = (size_t)dst & (seglen - 1);
+
+    if (count <= 0)
+        return;
+
+    memset(seg + dsti, c, qvm_mem_clamp(dsti, (size_t)count, seglen));
+}
+
+
+// strncpy 'count' bytes from 'src' to 'dst' (stops at the end of the segment if src isn't terminated before it)
+static inline void qvm_mem_strncpy(uint8_t* seg, size_t seglen, int dst, int src, int count) {
+    size_t srci = (size_t)src & (seglen - 1);
+    size_t dsti = (size_t)dst & (seglen - 1);
+
+    if (count <= 0)
+        return;
+
+    size_t n = qvm_mem_clamp(dsti, (size_t)count, seglen);
+    const uint8_t* end = (const uint8_t*)memchr(seg + srci, 0, qvm_mem_clamp(srci, n, seglen));
+    size_t len = end ? (size_t)(end - (seg + srci)) : qvm_mem_clamp(srci, n, seglen);
+
+    memmove(seg + dsti, seg + srci, len);
+    memset(seg + dsti + len, 0, n - len);
+}
+
+#endif // __QMM2_QVM_MEM_H__
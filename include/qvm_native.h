@@ -0,0 +1,173 @@
+/*
+SoF2GT_QMM - Hook gametype dlls/qvms for Soldier of Fortune 2
+Copyright 2025-2026
+https://github.com/thecybermind/sof2gt_qmm/
+3-clause BSD license: https://opensource.org/license/bsd-3-clause
+
+Created By:
+    Kevin Masterson < k.m.masterson@gmail.com >
+
+*/
+
+#ifndef __SOF2GT_QMM_QVM_NATIVE_H__
+#define __SOF2GT_QMM_QVM_NATIVE_H__
+
+// runtime support for gametype modules generated by qvm2c. a generated .cpp file defines the following
+// before including this header, and then defines the translated functions, qn_call(), and the
+// dllEntry/vmMain exports:
+//   QVM_NATIVE_DATASEGLEN  - size of the data segment (power of 2, same as qvm_load)
+//   QVM_NATIVE_STACKSIZE   - size of the program stack at the end of the data segment
+//   QVM_NATIVE_DATAINITLEN - size of the initialized data (data + lit) copied in at dllEntry
+// and optionally:
+//   QVM_NATIVE_LOCALMEM    - 1 to do GT_MEMSET/GT_MEMCPY/GT_STRNCPY in the module instead of through the syscall
+
+#include <cstdint>
+#include <cstring>
+#include <cstdio>
+#include <cstdarg>
+#include <csetjmp>
+#include <qmmapi.h>
+#include "game.h"
+#include "gt_syscall.h"
+
+#if !defined(QVM_NATIVE_DATASEGLEN) || !defined(QVM_NATIVE_STACKSIZE) || !defined(QVM_NATIVE_DATAINITLEN)
+#error qvm_native.h must be included from a module generated by qvm2c
+#endif
+
+#ifndef QVM_NATIVE_LOCALMEM
+#define QVM_NATIVE_LOCALMEM 0
+#endif
+
+#ifdef _MSC_VER
+#pragma warning(disable: 4102)  // unreferenced label
+#else
+#pragma GCC diagnostic ignored "-Wunused-label"
+#pragma GCC diagnostic ignored "-Wunused-variable"
+#pragma GCC diagnostic ignored "-Wunused-function"
+#pragma GCC diagnostic ignored "-Wunused-but-set-variable"
+#endif
+
+// mask all data accesses to the data segment, like qvm_exec with verify_data
+#define QN_DATAMASK     (QVM_NATIVE_DATASEGLEN - 1)
+#define QN_ADDR(a)      (qn_data + ((a) & QN_DATAMASK))
+
+// data segment (+4 so a 4-byte access at the last masked address stays inside the block)
+static uint8_t qn_data[QVM_NATIVE_DATASEGLEN + 4];
+// current program stack pointer, set before every call so the callee can build its frame below it
+static uint8_t* qn_stackptr = nullptr;
+// syscall function given to dllEntry (SOF2GT_syscall when loaded by sof2gt_qmm)
+static eng_syscall_t qn_syscall = nullptr;
+// set once a runtime error occurs, the module then refuses to run (like an unloaded QVM)
+static bool qn_failed = false;
+// jump buffer for the innermost qn_exec call
+static jmp_buf* qn_jmp = nullptr;
+
+// translated function dispatch for indirect calls (defined by generated code)
+static int qn_call(int addr);
+
+// reinterpret opstack values
+static inline float qn_f(int i) { float f; memcpy(&f, &i, sizeof(f)); return f; }
+static inline int qn_i(float f) { int i; memcpy(&i, &f, sizeof(i)); return i; }
+
+// memory access
+static inline int qn_load1(int a) { return *QN_ADDR(a); }
+static inline int qn_load2(int a) { uint16_t v; memcpy(&v, QN_ADDR(a), sizeof(v)); return v; }
+static inline int qn_load4(int a) { int v; memcpy(&v, QN_ADDR(a), sizeof(v)); return v; }
+static inline void qn_store1(int a, int v) { *QN_ADDR(a) = (uint8_t)(v & 0xFF); }
+static inline void qn_store2(int a, int v) { uint16_t w = (uint16_t)(v & 0xFFFF); memcpy(QN_ADDR(a), &w, sizeof(w)); }
+static inline void qn_store4(int a, int v) { memcpy(QN_ADDR(a), &v, sizeof(v)); }
+static inline void qn_arg(uint8_t* ps, int offset, int v) { memcpy(ps + offset, &v, sizeof(v)); }
+static inline int qn_local(uint8_t* ps, int offset) { return (int)(ps + offset - qn_data); }
+
+
+// abort the current qn_exec call after a runtime error
+static void qn_error(int instr, const char* fmt, ...) {
+    char buf[256];
+    va_list argptr;
+    va_start(argptr, fmt);
+    vsnprintf(buf, sizeof(buf), fmt, argptr);
+    va_end(argptr);
+
+    char msg[320];
+    snprintf(msg, sizeof(msg), "qvm_native: Runtime error at %d: %s\n", instr, buf);
+    qn_syscall(GT_PRINT, msg);
+
+    qn_failed = true;
+    longjmp(*qn_jmp, 1);
+}
+
+
+// set up a new stack frame for a translated function, and verify the program stack
+static inline uint8_t* qn_enter(int instr, int framesize) {
+    uint8_t* ps = qn_stackptr - framesize;
+    if (ps < qn_data + QVM_NATIVE_DATASEGLEN - QVM_NATIVE_STACKSIZE)
+        qn_error(instr, "program stack overflow! Max is %d.", QVM_NATIVE_STACKSIZE);
+    memset(ps, 0, sizeof(int));             // RII
+    memcpy(ps + sizeof(int), &framesize, sizeof(int));
+    return ps;
+}
+
+
+// verify the frame size stored by qn_enter, like QVM_OP_LEAVE
+static inline void qn_leave(int instr, uint8_t* ps, int framesize) {
+    int stored;
+    memcpy(&stored, ps + sizeof(int), sizeof(stored));
+    if (stored != framesize)
+        qn_error(instr, "QVM_OP_LEAVE param (%d) does not match QVM_OP_ENTER param (%d)", framesize, stored);
+}
+
+
+// engine trap from translated code (addr is the negative call address)
+static inline int qn_trap(uint8_t* ps, int addr) {
+    qn_stackptr = ps;
+    return (int)gt_qvm_syscall(qn_syscall, qn_data, QVM_NATIVE_DATASEGLEN, -addr - 1, (int*)ps + 2, QVM_NATIVE_LOCALMEM);
+}
+
+
+// QVM_OP_BLOCK_COPY with the same clamping as qvm_exec
+static inline void qn_blockcopy(int dst, int src, int count) {
+    qvm_mem_copy(qn_data, QVM_NATIVE_DATASEGLEN, dst, src, count);
+}
+
+
+// entry point: call into the translated vmMain (instruction 0) like qvm_exec
+static int qn_exec(int (*entry)(), int argc, int* argv) {
+    if (qn_failed || !qn_stackptr)
+        return 0;
+
+    uint8_t* oldstackptr = qn_stackptr;
+    int framesize = (argc + 2) * (int)sizeof(int);
+
+    uint8_t* ps = qn_stackptr - framesize;
+    if (ps < qn_data + QVM_NATIVE_DATASEGLEN - QVM_NATIVE_STACKSIZE)
+        return 0;
+    int header[2] = { -1, framesize };
+    memcpy(ps, header, sizeof(header));
+    memcpy(ps + sizeof(header), argv, argc * sizeof(int));
+
+    jmp_buf jmp;
+    jmp_buf* oldjmp = qn_jmp;
+    qn_jmp = &jmp;
+
+    int ret = 0;
+    if (!setjmp(jmp)) {
+        qn_stackptr = ps;
+        ret = entry();
+    }
+
+    qn_jmp = oldjmp;
+    qn_stackptr = oldstackptr;
+    return qn_failed ? 0 : ret;
+}
+
+
+// initialize data segment and store syscall pointer
+static void qn_init(eng_syscall_t syscall, const uint8_t* datainit) {
+    qn_syscall = syscall;
+    memset(qn_data, 0, sizeof(qn_data));
+    memcpy(qn_data, datainit, QVM_NATIVE_DATAINITLEN);
+    qn_stackptr = qn_data + QVM_NATIVE_DATASEGLEN;
+    qn_failed = false;
+}
+
+#endif // __SOF2GT_QMM_QVM_NATIVE_H__
@@ -0,0 +1,143 @@
+/*
+SoF2GT_QMM - Hook gametype dlls/qvms for Soldier of Fortune 2
+Copyright 2025-2026
+https://github.com/thecybermind/sof2gt_qmm/
+3-clause BSD license: https://opensource.org/license/bsd-3-clause
+
+Created By:
+    Kevin Masterson < k.m.masterson@gmail.com >
+
+*/
+
+#ifndef __QMM2_QVM_SHADOW_H__
+#define __QMM2_QVM_SHADOW_H__
+
+#include <stdint.h>
+#include <stddef.h>
+#include "qvm.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif // __cplusplus
+
+// shadow execution, for checking the QVM optimizer. a reference QVM (usually loaded without optimization) runs as
+// usual, and every call into it is then repeated on a second copy of the QVM loaded with the flags being checked.
+// syscalls made by the reference run are recorded (return value and the data segment bytes they changed) and
+// replayed into the shadow run instead of being made again. syscall order and arguments, the data segment before
+// each syscall, and the return value and data segment after the call are compared, and the first divergence in each
+// call is noted with the function and instruction it was found at. the program stack is not compared, since inlining
+// changes stack frame layouts. this snapshots the data segment around every syscall, so it is meant for testing.
+// this has no game or plugin dependencies: it is used by the plugin (sof2gt_shadow) and by qvm_bench
+
+// max syscall arguments compared
+#define QVM_SHADOW_MAX_ARGS         8
+
+// a syscall made by the reference run
+typedef struct qvm_shadow_record_s {
+    int cmd;
+    int ret;
+    int instr;                      // original instruction index of the trap
+    int stackptr;                   // program stack offset at the trap
+    int args[QVM_SHADOW_MAX_ARGS];
+    uint64_t digest;                // digest of the data outside the program stack, before the syscall
+    size_t firstwrite;              // range of writes made by the syscall
+    size_t numwrites;
+} qvm_shadow_record_t;
+
+// data segment bytes changed by a syscall (contents are in 'bytes')
+typedef struct qvm_shadow_write_s {
+    int offset;
+    int len;
+    size_t bytes;
+} qvm_shadow_write_t;
+
+typedef struct qvm_shadow_s {
+    // set before qvm_shadow_load (all optional)
+    int (*numargs)(int cmd);                                // number of arguments a syscall uses (none are compared if NULL)
+    const char* (*function)(int instr, int* start);         // name and first instruction of the function containing an instruction
+    const char* (*data)(int address, int* offset);          // name of the global at or before an address, and the offset into it
+    void* userdata;                                         // for use by the owner
+
+    qvm_t shadow;                   // copy loaded with the flags being checked
+    qvm_t* reference;
+    vmsyscall_t syscall;            // where the reference's syscalls go
+
+    // current call
+    int recording;
+    int insyscall;
+    qvm_shadow_record_t* records;
+    size_t numrecords;
+    size_t recordcap;
+    qvm_shadow_write_t* writes;
+    size_t numwrites;
+    size_t writecap;
+    uint8_t* bytes;
+    size_t numbytes;
+    size_t bytecap;
+    uint8_t* before;                // data segment before the current syscall
+    size_t replay;                  // next record to replay
+    char divergence[512];           // first divergence in the current call (empty if none)
+
+    // totals
+    uint64_t calls;
+    uint64_t syscalls;              // syscalls replayed
+    uint64_t divergences;           // calls with a divergence
+    uint64_t mirrored;              // calls that started with the reference's data changed from outside (e.g. by plugins)
+    char last[640];                 // last divergence, with the call it was found in
+} qvm_shadow_t;
+
+/**
+* Load the shadow copy of a QVM. The reference must be loaded from the same file with qvm_shadow_syscall as its
+* syscall handler. Its userdata is set to the qvm_shadow_t, and its syscalls are passed on to 'syscall' (also when
+* there is no shadow copy, e.g. if this fails)
+*
+* @param [qvm_shadow_t*] sh - Pointer to qvm_shadow_t object (zeroed, except for the optional callbacks)
+* @param [qvm_t*] reference - Pointer to the loaded reference qvm_t object
+* @param [const uint8_t*] filemem - QVM file contents
+* @param [size_t] filesize - Size of filemem
+* @param [vmsyscall_t] syscall - Syscall handler for the reference
+* @param [int] flags - Load flags for the shadow copy (QVM_LOAD_*)
+* @param [qvm_alloc_t*] allocator - Allocator for the shadow copy (NULL for default)
+* @returns [int] - 1 if succeeded, 0 if failed
+*/
+int qvm_shadow_load(qvm_shadow_t* sh, qvm_t* reference, const uint8_t* filemem, size_t filesize, vmsyscall_t syscall, int flags, qvm_alloc_t* allocator);
+
+/**
+* Unload the shadow copy and free recorded syscalls. The reference is left loaded
+*
+* @param [qvm_shadow_t*] sh - Pointer to qvm_shadow_t object
+*/
+void qvm_shadow_unload(qvm_shadow_t* sh);
+
+/**
+* Check if a shadow copy is loaded (it is unloaded if it hits a run-time error)
+*
+* @param [qvm_shadow_t*] sh - Pointer to qvm_shadow_t object
+* @returns [int] - 1 if loaded, 0 if not
+*/
+int qvm_shadow_loaded(qvm_shadow_t* sh);
+
+/**
+* Syscall handler for the reference QVM: records syscalls made while shadowing, then passes them on
+*/
+int qvm_shadow_syscall(qvm_t* qvm, uint8_t* membase, int cmd, int* args);
+
+/**
+* Call vmMain (addr < 0, like qvm_exec) or a function (like qvm_call) in the reference QVM, then in the shadow copy,
+* and compare them. Nested calls (from inside a syscall of a shadowed call) only run on the reference. If the data
+* segment of the reference was changed from outside since the last call, it is copied to the shadow first
+*
+* @param [qvm_shadow_t*] sh - Pointer to qvm_shadow_t object
+* @param [int] addr - Function address (original instruction index), or -1 for vmMain
+* @param [int] argc - Number of arguments to pass
+* @param [int*] argv - Array of arguments to pass
+* @param [int*] diverged - Set to 1 if this call diverged (sh->last describes it), 0 if not (may be NULL)
+* @returns [int] - Return value from the reference
+*/
+int qvm_shadow_exec(qvm_shadow_t* sh, int addr, int argc, int* argv, int* diverged);
+
+#ifdef __cplusplus
+}
+#endif // __cplusplus
+
+#endif // __QMM2_QVM_SHADOW_H__
@@ -0,0 +1,41 @@
+/*
+SoF2GT_QMM - Hook gametype dlls/qvms for Soldier of Fortune 2
+Copyright 2025-2026
+https://github.com/thecybermind/sof2gt_qmm/
+3-clause BSD license: https://opensource.org/license/bsd-3-clause
+
+Created By:
+    Kevin Masterson < k.m.masterson@gmail.com >
+
+*/
+
+#ifndef __SOF2GT_QMM_REGISTER_CACHE_H__
+#define __SOF2GT_QMM_REGISTER_CACHE_H__
+
+#include <cstdint>
+#include <string>
+
+// memoization of GT_REGISTERSOUND/EFFECT/ICON/ITEM/TRIGGER results for the current map. repeated registrations
+// with the same arguments return the earlier handle without reaching the engine. after a GT_RESTART, sound/effect/
+// icon handles are checked against their configstrings before being reused, and items/triggers are registered
+// again. args are the native syscall arguments with cmd in args[0] (like SOF2GT_syscall)
+
+// enable or disable the cache (clears it)
+void register_cache_enable(bool enable);
+
+// forget all handles (map change)
+void register_cache_clear();
+
+// serve a registration syscall from the cache. returns true (and the handle in ret) on a hit
+bool register_cache_lookup(intptr_t* args, intptr_t& ret);
+
+// store the result of a registration syscall after it was made
+void register_cache_store(intptr_t* args, intptr_t ret);
+
+// registration/duplicate counts, one per line
+std::string register_cache_stats();
+
+// reset registration/duplicate counts
+void register_cache_reset_stats();
+
+#endif // __SOF2GT_QMM_REGISTER_CACHE_H__
@@ -0,0 +1,44 @@
+/*
+SoF2GT_QMM - Hook gametype dlls/qvms for Soldier of Fortune 2
+Copyright 2025-2026
+https://github.com/thecybermind/sof2gt_qmm/
+3-clause BSD license: https://opensource.org/license/bsd-3-clause
+
+Created By:
+    Kevin Masterson < k.m.masterson@gmail.com >
+
+*/
+
+#ifndef __SOF2GT_QMM_SHADOW_H__
+#define __SOF2GT_QMM_SHADOW_H__
+
+#include <cstdint>
+#include <string>
+#include "qvm.h"
+
+// shadow execution of the gametype QVM, for checking the optimizer (sof2gt_shadow). the comparison itself is in
+// qvm_shadow.c (see qvm_shadow.h), which qvm_bench also uses; this adds gametype syscall arguments, names from the
+// .map file and logging. changes plugins make to the gametype's data segment between calls are copied to the shadow
+// copy before the next call, so they aren't reported as divergences
+
+// load the shadow copy of a QVM with the given flags. 'reference' must be loaded from the same file with
+// shadow_syscall as its syscall handler, which passes syscalls on to 'syscall'
+bool shadow_load(qvm_t* reference, const uint8_t* filemem, size_t filesize, vmsyscall_t syscall, int flags, qvm_alloc_t* allocator);
+
+// unload the shadow copy
+void shadow_unload();
+
+// is a shadow copy loaded (it is unloaded if it hits a run-time error)
+bool shadow_loaded();
+
+// syscall handler for the reference QVM: records syscalls made while shadowing, then passes them on
+int shadow_syscall(qvm_t* qvm, uint8_t* membase, int cmd, int* args);
+
+// call vmMain (addr < 0, like qvm_exec) or a function (like qvm_call) in the reference QVM, then in the shadow copy,
+// and compare them. returns the reference result
+int shadow_exec(int addr, int argc, int* argv);
+
+// calls, syscalls and divergences so far, and the last divergence
+std::string shadow_report();
+
+#endif // __SOF2GT_QMM_SHADOW_H__
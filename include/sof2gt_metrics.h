@@ -0,0 +1,57 @@
+/*
+SoF2GT_QMM - Hook gametype dlls/qvms for Soldier of Fortune 2
+Copyright 2025-2026
+https://github.com/thecybermind/sof2gt_qmm/
+3-clause BSD license: https://opensource.org/license/bsd-3-clause
+
+Created By:
+    Kevin Masterson < k.m.masterson@gmail.com >
+
+*/
+
+#ifndef __SOF2GT_METRICS_H__
+#define __SOF2GT_METRICS_H__
+
+#include <stdint.h>
+
+// per-process counters in a shared memory object ("/dev/shm/sof2gt_<port>" on Linux, "Local\sof2gt_<port>" on
+// Windows) so an external agent can read them without involving the game thread. the layout is fixed (all fields
+// are 64-bit aligned, no pointers) so 32-bit servers and 64-bit readers agree. this header is shared with the
+// tools/sof2gt_metrics reader, so it must stay C.
+//
+// the game thread is the only writer. 'seq' is a sequence lock: it is odd while counters are being updated, so a
+// reader copies the whole block and retries if 'seq' was odd or changed during the copy
+
+#define SOF2GT_METRICS_MAGIC        0x4D544753  // "SGTM"
+#define SOF2GT_METRICS_VERSION      1
+#define SOF2GT_METRICS_NAME         "sof2gt_%d" // formatted with the server port
+#define SOF2GT_METRICS_SYSCALLS     256         // GT_* syscall cmds (higher cmds are counted in the last slot)
+#define SOF2GT_METRICS_VMMAIN       16          // gametype vmMain cmds (higher cmds are counted in the last slot)
+
+typedef struct sof2gt_metric_s {
+    uint64_t calls;
+    uint64_t ns;                    // cumulative wall time
+} sof2gt_metric_t;
+
+typedef struct sof2gt_metrics_s {
+    uint32_t magic;                 // SOF2GT_METRICS_MAGIC
+    uint32_t version;               // SOF2GT_METRICS_VERSION
+    uint32_t size;                  // sizeof(sof2gt_metrics_t)
+    uint32_t seq;                   // sequence lock, odd while being written
+    int32_t pid;
+    int32_t port;
+    char gametype[32];
+
+    sof2gt_metric_t syscalls[SOF2GT_METRICS_SYSCALLS];
+    sof2gt_metric_t vmmain[SOF2GT_METRICS_VMMAIN];
+
+    uint64_t qvm_instructions;      // QVM instructions executed
+    uint64_t runtime_errors;        // QVM run-time errors
+    sof2gt_metric_t loads;          // gametype DLL/QVM loads
+
+    uint64_t syscall_cache_hits;    // syscalls served by the syscall cache
+    uint64_t cvar_cache_hits;       // cvar lookups served by the cvar cache
+    uint64_t register_cache_hits;   // registrations served by the registration cache
+} sof2gt_metrics_t;
+
+#endif // __SOF2GT_METRICS_H__
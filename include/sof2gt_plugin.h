@@ -13,14 +13,181 @@ Created By:
 #define __SOF2GT_QMM_SOF2GT_PLUGIN_H__
 
 #include <cstdint>
+#include <cstring>
 #include <qmmapi.h>
 
+// plugins can broadcast "SOF2GT_Preload" with a gametype name (e.g. "ctf") as the buffer to have its QVM loaded
+// in the background before the next map starts
+
+// "SOF2GT_Reload" is broadcast (with this struct as the buffer, like "SOF2GT_Attach") after "sof2gt reload" switches
+// to a new version of the gametype QVM. global variables and functions keep their addresses (unless the reload was
+// forced without .map files to check them). uninitialized globals keep their values, initialized ones start over
+// from the new version unless they were named in the reload command. native overrides are gone, so register them
+// again
+
+// native replacement for a gametype QVM function: membase is the start of the data segment, args are the function's
+// arguments (VM addresses for pointers)
+typedef int (*sof2gt_native_t)(uint8_t* membase, int* args);
+
+// hook messages, for handlers registered with gt_register_handler
+enum {
+	SOF2GT_MSG_VMMAIN,			// "SOF2GT_vmMain"
+	SOF2GT_MSG_VMMAIN_POST,		// "SOF2GT_vmMain_Post"
+	SOF2GT_MSG_SYSCALL,			// "SOF2GT_syscall"
+	SOF2GT_MSG_SYSCALL_POST,	// "SOF2GT_syscall_Post"
+	SOF2GT_MSG_COUNT
+};
+
+// segments of symbols, from gt_symbol_segment (the same numbers as in the q3asm .map file)
+enum {
+	SOF2GT_SEGMENT_CODE,		// function, the address is an instruction index
+	SOF2GT_SEGMENT_DATA,		// initialized global
+	SOF2GT_SEGMENT_LIT,			// string literal
+	SOF2GT_SEGMENT_BSS,			// zero-initialized global
+};
+
+// results of gt_call_sliced/gt_resume
+enum {
+	SOF2GT_CALL_ERROR = -1,		// failed (bad address, another call is paused, or the QVM hit a run-time error)
+	SOF2GT_CALL_DONE = 0,		// the function returned and *ret is set
+	SOF2GT_CALL_PAUSED = 1,		// ran out of time, continue it with gt_resume
+};
+
+// direct handler for hook messages: args/numargs are the same as the message buffer (cmd in args[0]). set
+// gt_result/gt_return like when handling the message in QMM_PluginMessage
+typedef void (*sof2gt_handler_t)(int msg, intptr_t* args, int numargs);
+
+// max arguments (including cmd) and bytes of copied pointer contents in an observation
+#define SOF2GT_OBSERVE_ARGS		8
+#define SOF2GT_OBSERVE_DATA		1024
+
+// a finished vmMain or syscall call, copied for observers (see gt_register_observer). args are the same as the
+// SOF2GT_vmMain_Post/SOF2GT_syscall_Post message buffer (cmd in args[0]), except that syscall pointer arguments point
+// to copies in 'data' of the strings, vectors and arrays they pointed to after the call. pointers to anything else
+// (or that didn't fit) are nullptr
+struct sof2gt_observation_t {
+	int msg;					// SOF2GT_MSG_VMMAIN_POST or SOF2GT_MSG_SYSCALL_POST
+	int numargs;
+	intptr_t args[SOF2GT_OBSERVE_ARGS];
+	intptr_t ret;				// value returned to the caller (after any plugin override)
+	uint8_t data[SOF2GT_OBSERVE_DATA];
+};
+
+// observer for finished calls, called on a worker thread
+typedef void (*sof2gt_observer_t)(const sof2gt_observation_t* observation);
+
 struct sof2gt_plugininfo_t {
 	char gt_gametype[32];
 	intptr_t gt_return;
 	pluginres_t gt_result;
 	eng_syscall_t gt_syscall;
 	mod_vmMain_t gt_vmMain;
+
+	// memory of the loaded gametype QVM (nullptr/0 for DLL gametypes). valid from dllEntry until GAME_SHUTDOWN
+	uint8_t* gt_datasegment;
+	size_t gt_dataseglen;
+	// look up a symbol from the gametype's q3asm .map file (vm/gt_<gametype>.map) if there is one. returns a data
+	// segment address (or instruction index for functions), or -1 if not found
+	int (*gt_symbol)(const char* name);
+	// replace a QVM function (by address, e.g. from gt_symbol) with a native function, or restore it if func is
+	// nullptr. returns 0 if it can't be overridden (e.g. it was inlined, see sof2gt_inline). overrides last until
+	// the QVM is unloaded, so register them on GAMETYPE_INIT
+	int (*gt_override)(int addr, sof2gt_native_t func);
+	// call a QVM function (by address, e.g. from gt_symbol) directly, instead of through vmMain. pointer arguments
+	// must be VM addresses. argc is at most 16, the call fails (returns 0) otherwise
+	int (*gt_call)(int addr, int argc, int* argv);
+	// receive hook messages through a direct call to 'handler' instead of a QMM broadcast, so the time spent in
+	// each plugin can be measured separately ("sof2gt plugins"). a plugin that registers a handler should ignore
+	// the broadcast hook messages, and must unregister (handler = nullptr) in QMM_Detach. 'name' identifies the
+	// plugin in reports. each handler is called with gt_result set to QMM_UNUSED, and the highest result of all
+	// plugins is used. returns 0 on failure
+	int (*gt_register_handler)(const char* name, sof2gt_handler_t handler);
+	// call a QVM function like gt_call, but pause it after 'usec' microseconds (0 for no limit) so long work can be
+	// spread over several frames. a paused call keeps its place and is continued with gt_resume (e.g. once per
+	// GAMETYPE_RUN_FRAME), and the gametype keeps running normally in between. only one call can be paused at a time,
+	// and these can't be used from inside a call into the QVM (e.g. a syscall hook). returns SOF2GT_CALL_*
+	int (*gt_call_sliced)(int addr, int argc, int* argv, int usec, int* ret);
+	int (*gt_resume)(int usec, int* ret);
+	// abandon a paused call (anything it already changed in QVM memory stays changed). paused calls are also
+	// dropped when the QVM is unloaded
+	void (*gt_cancel)();
+	// receive a copy of every finished vmMain and syscall call on a worker thread, in order, for plugins that only
+	// watch the gametype (stats, logging, telemetry) and never change results. this keeps their work off the game
+	// thread. observers must not call engine, QMM or gt_* functions, and a plugin that registers one should ignore
+	// the Post broadcast messages. calls are dropped if the observers fall too far behind ("sof2gt plugins" shows
+	// how many). unregister (observer = nullptr) in QMM_Detach, which waits for a call in progress to finish.
+	// returns 0 on failure
+	int (*gt_register_observer)(const char* name, sof2gt_observer_t observer);
+	// look up which segment a symbol from gt_symbol is in (SOF2GT_SEGMENT_*), or -1 if not found. only non-code
+	// symbols are data segment addresses
+	int (*gt_symbol_segment)(const char* name);
 };
 
+// bounds-checked access to gametype QVM memory. addresses are VM addresses (e.g. from gt_symbol). these fail if
+// the range isn't entirely inside the data segment or the gametype isn't a QVM
+
+// get a pointer to 'count' T objects at a VM address, or nullptr. QVM data is only 4-byte aligned
+template <typename T>
+inline T* sof2gt_vm_ptr(const sof2gt_plugininfo_t* info, intptr_t addr, size_t count = 1) {
+	if (!info->gt_datasegment || addr < 0 || (size_t)addr > info->gt_dataseglen || count > (info->gt_dataseglen - (size_t)addr) / sizeof(T))
+		return nullptr;
+	return (T*)(info->gt_datasegment + addr);
+}
+
+// read a T from a VM address
+template <typename T>
+inline bool sof2gt_vm_read(const sof2gt_plugininfo_t* info, intptr_t addr, T& out) {
+	const uint8_t* p = sof2gt_vm_ptr<const uint8_t>(info, addr, sizeof(T));
+	if (!p)
+		return false;
+	memcpy(&out, p, sizeof(T));
+	return true;
+}
+
+// write a T to a VM address
+template <typename T>
+inline bool sof2gt_vm_write(const sof2gt_plugininfo_t* info, intptr_t addr, const T& in) {
+	uint8_t* p = sof2gt_vm_ptr<uint8_t>(info, addr, sizeof(T));
+	if (!p)
+		return false;
+	memcpy(p, &in, sizeof(T));
+	return true;
+}
+
+// read a QVM global by name
+template <typename T>
+inline bool sof2gt_vm_global(const sof2gt_plugininfo_t* info, const char* name, T& out) {
+	if (!info->gt_symbol || !info->gt_symbol_segment)
+		return false;
+	int segment = info->gt_symbol_segment(name);
+	return segment >= 0 && segment != SOF2GT_SEGMENT_CODE && sof2gt_vm_read(info, info->gt_symbol(name), out);
+}
+
+// replace a QVM function by name with a native function
+inline bool sof2gt_vm_override(const sof2gt_plugininfo_t* info, const char* name, sof2gt_native_t func) {
+	if (!info->gt_symbol || !info->gt_override || !info->gt_symbol_segment || info->gt_symbol_segment(name) != SOF2GT_SEGMENT_CODE)
+		return false;
+	int addr = info->gt_symbol(name);
+	return addr >= 0 && info->gt_override(addr, func);
+}
+
+// call a QVM function by name, returns false if the function isn't found
+inline bool sof2gt_vm_call(const sof2gt_plugininfo_t* info, const char* name, int argc, int* argv, int& ret) {
+	if (!info->gt_symbol || !info->gt_call || !info->gt_symbol_segment || info->gt_symbol_segment(name) != SOF2GT_SEGMENT_CODE)
+		return false;
+	int addr = info->gt_symbol(name);
+	if (addr < 0)
+		return false;
+	ret = info->gt_call(addr, argc, argv);
+	return true;
+}
+
+// get a null-terminated string at a VM address, or nullptr if it isn't terminated inside the data segment
+inline const char* sof2gt_vm_string(const sof2gt_plugininfo_t* info, intptr_t addr) {
+	const char* str = sof2gt_vm_ptr<const char>(info, addr);
+	if (!str || !memchr(str, '\0', info->gt_dataseglen - (size_t)addr))
+		return nullptr;
+	return str;
+}
+
 #endif // __SOF2GT_QMM_SOF2GT_PLUGIN_H__
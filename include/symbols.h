@@ -0,0 +1,54 @@
+/*
+SoF2GT_QMM - Hook gametype dlls/qvms for Soldier of Fortune 2
+Copyright 2025-2026
+https://github.com/thecybermind/sof2gt_qmm/
+3-clause BSD license: https://opensource.org/license/bsd-3-clause
+
+Created By:
+    Kevin Masterson < k.m.masterson@gmail.com >
+
+*/
+
+#ifndef __SOF2GT_QMM_SYMBOLS_H__
+#define __SOF2GT_QMM_SYMBOLS_H__
+
+#include <cstddef>
+#include <string>
+
+// symbol table for the loaded gametype QVM, from the .map file written by q3asm (vm/gt_<gametype>.map). each line is
+// "<segment> <hex address> <name>". code symbols are instruction indexes, others are data segment addresses
+
+// q3asm segment numbers
+enum {
+    SYMBOL_SEG_CODE,
+    SYMBOL_SEG_DATA,
+    SYMBOL_SEG_LIT,
+    SYMBOL_SEG_BSS,
+};
+
+// replace the symbol table with the contents of a .map file, returns number of symbols
+size_t symbols_parse(const char* text, size_t len);
+
+// clear the symbol table
+void symbols_clear();
+
+// look up a symbol, returns its address (or -1 if not found) and optionally its segment
+int symbols_find(const char* name, int* segment = nullptr);
+
+// find the name of the code symbol containing an instruction index (nullptr if none)
+const char* symbols_function(int instruction);
+
+// number of symbols in the table
+size_t symbols_count();
+
+// compare the symbols in the table (code and data/lit/bss) with those in another .map file. returns a description of
+// the first symbol that was added, removed or moved, or an empty string if they match (or the table is empty)
+std::string symbols_diff(const char* text, size_t len);
+
+// address of the first data/lit/bss symbol after a data segment address (-1 if none)
+int symbols_data_next(int address);
+
+// find the name of the data symbol at or before a data segment address (nullptr if none), and the offset into it
+const char* symbols_data(int address, int* offset = nullptr);
+
+#endif // __SOF2GT_QMM_SYMBOLS_H__
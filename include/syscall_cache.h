@@ -0,0 +1,40 @@
+/*
+SoF2GT_QMM - Hook gametype dlls/qvms for Soldier of Fortune 2
+Copyright 2025-2026
+https://github.com/thecybermind/sof2gt_qmm/
+3-clause BSD license: https://opensource.org/license/bsd-3-clause
+
+Created By:
+    Kevin Masterson < k.m.masterson@gmail.com >
+
+*/
+
+#ifndef __SOF2GT_QMM_SYSCALL_CACHE_H__
+#define __SOF2GT_QMM_SYSCALL_CACHE_H__
+
+#include <cstdint>
+#include <string>
+
+// memoization of read-only gametype syscalls (client lists/origins/names/items, integer cvars). results are valid
+// until the end of the current vmMain call, or until a syscall that may change game state is made. args are the
+// native syscall arguments with cmd in args[0] (like SOF2GT_syscall)
+
+// enable or disable the cache (disabling clears it)
+void syscall_cache_enable(bool enable);
+
+// forget all cached results (start/end of a vmMain call)
+void syscall_cache_invalidate();
+
+// serve a syscall from the cache. returns true (and the return value in ret) on a hit
+bool syscall_cache_lookup(intptr_t* args, intptr_t& ret);
+
+// store the result of a syscall after it was made
+void syscall_cache_store(intptr_t* args, intptr_t ret);
+
+// hit/miss counts of each cached syscall, one per line
+std::string syscall_cache_stats();
+
+// reset hit/miss counts
+void syscall_cache_reset_stats();
+
+#endif // __SOF2GT_QMM_SYSCALL_CACHE_H__
@@ -0,0 +1,52 @@
+/*
+SoF2GT_QMM - Hook gametype dlls/qvms for Soldier of Fortune 2
+Copyright 2025-2026
+https://github.com/thecybermind/sof2gt_qmm/
+3-clause BSD license: https://opensource.org/license/bsd-3-clause
+
+Created By:
+    Kevin Masterson < k.m.masterson@gmail.com >
+
+*/
+
+#ifndef __SOF2GT_QMM_TRACE_H__
+#define __SOF2GT_QMM_TRACE_H__
+
+#include <atomic>
+#include <cstdint>
+#include <string>
+
+// timeline tracing of vmMain calls, syscalls, plugin hooks and QVM execution, written out as Chrome trace event
+// JSON (chrome://tracing or ui.perfetto.dev). each thread records into its own ring buffer, so only the most
+// recent events are kept. trace_stop() must not run while another thread is recording. a span is recorded when
+// it ends:
+//   uint64_t t = trace_begin();
+//   ...
+//   trace_end("vmMain", cmd, t);
+
+extern std::atomic<bool> g_trace_enabled;
+
+// current time in ns (never 0)
+uint64_t trace_now();
+
+// start of a span (0 if tracing is off)
+inline uint64_t trace_begin() {
+    return g_trace_enabled.load(std::memory_order_relaxed) ? trace_now() : 0;
+}
+
+// record a span that started at 'begin'. 'name' must be a string literal
+void trace_record(const char* name, intptr_t arg, uint64_t begin);
+
+// end of a span
+inline void trace_end(const char* name, intptr_t arg, uint64_t begin) {
+    if (begin)
+        trace_record(name, arg, begin);
+}
+
+// start tracing, keeping the last 'events' spans per thread (clears previous events)
+void trace_start(size_t events);
+
+// stop tracing and return recorded spans as Chrome trace event JSON
+std::string trace_stop();
+
+#endif // __SOF2GT_QMM_TRACE_H__
@@ -12,11 +12,26 @@ Created By:
 #ifndef __SOF2GT_QMM_UTIL_H__
 #define __SOF2GT_QMM_UTIL_H__
 
+#include <string>
+#include <vector>
+
 #define COUNTOF(arr)  (sizeof(arr) / sizeof(arr[0]))
 
 // "safe" strncpy that always null-terminates
 char* strncpyz(char* dest, const char* src, size_t count);
 
+// a log message held back from the QMM log (QMM logging is only safe from the game thread)
+struct log_msg_t {
+    int severity;
+    std::string text;
+};
+
+// write held back messages to the QMM log (must be called from the game thread)
+void log_c_flush(std::vector<log_msg_t>& capture);
+
+// available physical memory in MiB (0 if unknown)
+size_t available_memory_mb();
+
 #ifdef _WIN32
 
     #define WIN32_LEAN_AND_MEAN
@@ -0,0 +1,207 @@
+/*
+SoF2GT_QMM - Hook gametype dlls/qvms for Soldier of Fortune 2
+Copyright 2025-2026
+https://github.com/thecybermind/sof2gt_qmm/
+3-clause BSD license: https://opensource.org/license/bsd-3-clause
+
+Created By:
+	Kevin Masterson < k.m.masterson@gmail.com >
+
+*/
+
+#define _CRT_SECURE_NO_WARNINGS 1
+
+#include <qmmapi.h>
+
+#include <cctype>
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#include "game.h"
+#include "util.h"
+#include "cvar_cache.h"
+
+// max number of cvars to keep handles for. anything past this is looked up by the engine every time
+#define CVAR_CACHE_MAX		1024
+
+// a cvar looked up by the gametype. cvars without a value are remembered too (without a handle), so looking them up
+// again doesn't reach the engine until the next refresh
+struct cvar_entry_t {
+	uint32_t hash;			// 0 = empty slot
+	std::string name;
+	vmCvar_t cvar;			// all zero (empty string, 0) until it has a handle
+	bool registered;		// has a handle from GT_CVAR_REGISTER
+	unsigned int updated;	// s_generation when last refreshed
+};
+
+// open addressing table keyed by name hash (size is a power of 2, at most half full)
+static std::vector<cvar_entry_t> s_table;
+static size_t s_count = 0;
+static unsigned int s_generation = 1;
+static bool s_enabled = false;
+static eng_syscall_t s_syscall = nullptr;
+
+static unsigned long long s_hits = 0;
+static unsigned long long s_updates = 0;
+static unsigned long long s_misses = 0;
+
+
+// FNV-1a hash of a cvar name (case-insensitive like the engine, never 0)
+static uint32_t s_hash(const char* name) {
+	uint32_t hash = 2166136261u;
+	for (; *name; name++) {
+		hash ^= (uint8_t)tolower((unsigned char)*name);
+		hash *= 16777619u;
+	}
+	return hash ? hash : 1;
+}
+
+
+// compare cvar names (case-insensitive like the engine)
+static bool s_name_equal(const std::string& a, const char* b) {
+	size_t i = 0;
+	for (; i < a.size() && b[i]; i++) {
+		if (tolower((unsigned char)a[i]) != tolower((unsigned char)b[i]))
+			return false;
+	}
+	return i == a.size() && !b[i];
+}
+
+
+// find the slot for a name: either its entry or the empty slot it would go in
+static cvar_entry_t& s_slot(std::vector<cvar_entry_t>& table, uint32_t hash, const char* name) {
+	size_t mask = table.size() - 1;
+	for (size_t i = hash & mask; ; i = (i + 1) & mask) {
+		cvar_entry_t& entry = table[i];
+		if (!entry.hash || (entry.hash == hash && s_name_equal(entry.name, name)))
+			return entry;
+	}
+}
+
+
+// double the size of the table
+static void s_grow() {
+	std::vector<cvar_entry_t> table(s_table.empty() ? 64 : s_table.size() * 2);
+	for (cvar_entry_t& entry : s_table) {
+		if (entry.hash)
+			s_slot(table, entry.hash, entry.name.c_str()) = std::move(entry);
+	}
+	s_table.swap(table);
+}
+
+
+// look up a cvar that has no handle yet, and take one if it has a value now. registering a cvar that doesn't exist
+// would create it, and its value would then stick when the game registers it with a default later. so cvars
+// without a value are left without a handle, and read as an empty string (integer 0) like the engine gives for them
+static void s_refresh_unregistered(cvar_entry_t& entry) {
+	char value[sizeof(vmCvar_t::string)];
+	s_syscall(GT_CVAR_VARIABLE_STRING_BUFFER, entry.name.c_str(), value, sizeof(value));
+	if (!*value)
+		return;
+	memset(&entry.cvar, 0, sizeof(entry.cvar));
+	s_syscall(GT_CVAR_REGISTER, &entry.cvar, entry.name.c_str(), value, 0);
+	entry.registered = true;
+}
+
+
+// get the up-to-date entry for a cvar, adding it on first use. returns nullptr if the engine should be used
+static cvar_entry_t* s_lookup(const char* name) {
+	if (!s_enabled || !name || !*name)
+		return nullptr;
+
+	uint32_t hash = s_hash(name);
+	if (!s_table.empty()) {
+		cvar_entry_t& entry = s_slot(s_table, hash, name);
+		if (entry.hash) {
+			if (entry.updated != s_generation) {
+				// only copies the value in if it changed
+				if (entry.registered)
+					s_syscall(GT_CVAR_UPDATE, &entry.cvar);
+				else
+					s_refresh_unregistered(entry);
+				entry.updated = s_generation;
+				s_updates++;
+			}
+			s_hits++;
+			return &entry;
+		}
+	}
+	s_misses++;
+
+	if (s_count >= CVAR_CACHE_MAX)
+		return nullptr;
+
+	if ((s_count + 1) * 2 > s_table.size())
+		s_grow();
+
+	cvar_entry_t& entry = s_slot(s_table, hash, name);
+	entry.hash = hash;
+	entry.name = name;
+	memset(&entry.cvar, 0, sizeof(entry.cvar));
+	entry.registered = false;
+	s_refresh_unregistered(entry);
+	entry.updated = s_generation;
+	s_count++;
+
+	return &entry;
+}
+
+
+// enable or disable the cache and set the engine syscall used to register/update cvars
+void cvar_cache_init(bool enable, eng_syscall_t syscall) {
+	s_enabled = enable && syscall;
+	s_syscall = syscall;
+	s_table.clear();
+	s_count = 0;
+}
+
+
+// mark all cached cvars to be refreshed on next use
+void cvar_cache_invalidate() {
+	s_generation++;
+}
+
+
+// handle a gametype syscall in place of the engine
+bool cvar_cache_syscall(intptr_t* args, intptr_t& ret) {
+	cvar_entry_t* entry;
+
+	switch (args[0]) {
+	case GT_CVAR_VARIABLE_INTEGER_VALUE:	// ( const char *var_name );
+		if (!(entry = s_lookup((const char*)args[1])))
+			return false;
+		// the engine returns the cvar's integer, which is parsed from the string rather than cast from the float
+		ret = entry->cvar.integer;
+		return true;
+	case GT_CVAR_VARIABLE_STRING_BUFFER:	// ( const char *var_name, char *buffer, int bufsize );
+		if (!args[2] || args[3] <= 0 || !(entry = s_lookup((const char*)args[1])))
+			return false;
+		strncpyz((char*)args[2], entry->cvar.string, (size_t)args[3]);
+		ret = 0;
+		return true;
+	case GT_CVAR_SET:						// ( const char *var_name, const char *value );
+		// let the engine set it, and refresh everything afterwards
+		cvar_cache_invalidate();
+		return false;
+	default:
+		return false;
+	}
+}
+
+
+// hit/update counts
+std::string cvar_cache_stats() {
+	char line[160];
+	snprintf(line, sizeof(line), "cvar cache: %d cvars, %llu hits, %llu updates, %llu misses\n", (int)s_count, s_hits, s_updates, s_misses);
+	return line;
+}
+
+
+// reset hit/update counts
+void cvar_cache_reset_stats() {
+	s_hits = 0;
+	s_updates = 0;
+	s_misses = 0;
+}
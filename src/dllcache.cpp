@@ -0,0 +1,117 @@
+/*
+SoF2GT_QMM - Hook gametype dlls/qvms for Soldier of Fortune 2
+Copyright 2025-2026
+https://github.com/thecybermind/sof2gt_qmm/
+3-clause BSD license: https://opensource.org/license/bsd-3-clause
+
+Created By:
+	Kevin Masterson < k.m.masterson@gmail.com >
+
+*/
+
+#define _CRT_SECURE_NO_WARNINGS 1
+
+#include <qmmapi.h>
+
+#include <string>
+#include <vector>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <time.h>
+
+#include "game.h"
+#include "util.h"
+#include "dllcache.h"
+
+struct dllcache_entry_t {
+	std::string path;
+	time_t mtime;
+	void* dll;
+	bool inuse;
+	unsigned int lastused;		// dllcache_close call count when released (for picking the oldest idle module)
+};
+static std::vector<dllcache_entry_t> s_dllcache;
+static unsigned int s_dllcache_clock = 0;
+
+
+static void s_dllcache_unload(size_t i) {
+	QMM_WRITEQMMLOG(PLID, QMM_VARARGS(PLID, "dllcache: Unloading \"%s\"\n", s_dllcache[i].path.c_str()), QMMLOG_DEBUG);
+	dlclose(s_dllcache[i].dll);
+	s_dllcache.erase(s_dllcache.begin() + (ptrdiff_t)i);
+}
+
+
+// open a gametype DLL, reusing a resident one if the file hasn't changed
+void* dllcache_open(const char* file) {
+	struct stat st;
+	if (stat(file, &st) != 0)
+		return nullptr;
+
+	for (size_t i = 0; i < s_dllcache.size(); i++) {
+		dllcache_entry_t& entry = s_dllcache[i];
+		if (entry.path != file)
+			continue;
+		// same file still on disk and nobody else is using it
+		if (entry.mtime == st.st_mtime && !entry.inuse) {
+			QMM_WRITEQMMLOG(PLID, QMM_VARARGS(PLID, "dllcache: Reusing resident \"%s\"\n", file), QMMLOG_DEBUG);
+			entry.inuse = true;
+			return entry.dll;
+		}
+		// the file was replaced, load the new one
+		if (!entry.inuse) {
+			s_dllcache_unload(i);
+			break;
+		}
+	}
+
+	void* dll = dlopen(file, RTLD_NOW);
+	if (!dll)
+		return nullptr;
+
+	s_dllcache.push_back({ file, st.st_mtime, dll, true, 0 });
+	return dll;
+}
+
+
+// release a DLL from dllcache_open
+void dllcache_close(void* dll, size_t maxresident) {
+	size_t idle = 0;
+	for (dllcache_entry_t& entry : s_dllcache) {
+		if (entry.dll == dll) {
+			entry.inuse = false;
+			entry.lastused = ++s_dllcache_clock;
+		}
+		if (!entry.inuse)
+			idle++;
+	}
+
+	// unload the least recently used idle modules over the limit
+	while (idle > maxresident) {
+		size_t oldest = s_dllcache.size();
+		for (size_t i = 0; i < s_dllcache.size(); i++) {
+			if (!s_dllcache[i].inuse && (oldest == s_dllcache.size() || s_dllcache[i].lastused < s_dllcache[oldest].lastused))
+				oldest = i;
+		}
+		s_dllcache_unload(oldest);
+		idle--;
+	}
+}
+
+
+// unload all idle DLLs
+size_t dllcache_flush() {
+	size_t count = 0;
+	for (size_t i = s_dllcache.size(); i-- > 0; ) {
+		if (!s_dllcache[i].inuse) {
+			s_dllcache_unload(i);
+			count++;
+		}
+	}
+	return count;
+}
+
+
+// number of resident DLLs
+size_t dllcache_count() {
+	return s_dllcache.size();
+}
@@ -13,6 +13,9 @@ Created By:
 
 #include <qmmapi.h>
 
+#include <cstdio>
+#include <cstdlib>
+#include <string>
 #include <vector>
 #include <string.h>
 
@@ -23,6 +26,19 @@ Created By:
 #include "main.h"
 #include "hook.h"
 #include "qvm.h"
+#include "gt_syscall.h"
+#include "preload.h"
+#include "dllcache.h"
+#include "symbols.h"
+#include "syscall_cache.h"
+#include "cvar_cache.h"
+#include "register_cache.h"
+#include "trace.h"
+#include "perfcount.h"
+#include "metrics.h"
+#include "plugin_hooks.h"
+#include "observers.h"
+#include "shadow.h"
 
 pluginres_t* g_result = nullptr;
 plugininfo_t g_plugininfo = {
@@ -44,6 +60,100 @@ pluginvars_t* g_pluginvars = nullptr;
 void* gt_dll = nullptr;
 qvm_t gt_qvm;
 
+// do GT_MEMSET/GT_MEMCPY/GT_STRNCPY on QVM memory without going through SOF2GT_syscall (sof2gt_localmem)
+static bool s_localmem = false;
+
+// gametype vmMain calls in progress (a syscall can lead to another vmMain call)
+static int s_vmmain_depth = 0;
+
+// initialized data segment of the loaded gametype QVM as it was in the file, to check a reload against
+static std::vector<uint8_t> s_qvm_initdata;
+
+// keep the initialized data of a QVM that was just loaded (before it runs)
+static void s_keep_initdata(const qvm_t& qvm) {
+	s_qvm_initdata.assign(qvm.datasegment, qvm.datasegment + qvm.header.datalen);
+}
+
+// clear plugin access to QVM memory if it was unloaded
+static void s_check_unloaded();
+
+// look up a symbol from the gametype's .map file (given to plugins)
+static int s_symbol(const char* name) {
+	return symbols_find(name);
+}
+
+// look up which segment a symbol is in (given to plugins)
+static int s_symbol_segment(const char* name) {
+	int segment = -1;
+	symbols_find(name, &segment);
+	return segment;
+}
+
+// replace a QVM function with a native function (given to plugins)
+static int s_override(int addr, sof2gt_native_t func) {
+	if (!gt_qvm.memory)
+		return 0;
+	return qvm_override(&gt_qvm, addr, func);
+}
+
+// call a QVM function directly (given to plugins)
+static int s_call(int addr, int argc, int* argv) {
+	if (!gt_qvm.memory)
+		return 0;
+	uint64_t t = trace_begin();
+	int ret = shadow_loaded() ? shadow_exec(addr, argc, argv) : qvm_call(&gt_qvm, addr, argc, argv);
+	trace_end("qvm_call", addr, t);
+	s_check_unloaded();
+	return ret;
+}
+
+// start a QVM function call that pauses after 'usec' microseconds (given to plugins)
+static int s_call_sliced(int addr, int argc, int* argv, int usec, int* ret) {
+	if (!gt_qvm.memory)
+		return SOF2GT_CALL_ERROR;
+	uint64_t t = trace_begin();
+	int status;
+	// shadow execution compares whole calls, so run it to completion
+	if (shadow_loaded()) {
+		int result = shadow_exec(addr, argc, argv);
+		if (ret)
+			*ret = result;
+		status = gt_qvm.memory ? SOF2GT_CALL_DONE : SOF2GT_CALL_ERROR;
+	}
+	else {
+		status = qvm_begin(&gt_qvm, addr, argc, argv, 0, usec > 0 ? (uint64_t)usec : 0, ret);
+	}
+	trace_end("qvm_call", addr, t);
+	s_check_unloaded();
+	return status;
+}
+
+// continue a paused QVM function call (given to plugins)
+static int s_resume(int usec, int* ret) {
+	if (!gt_qvm.memory)
+		return SOF2GT_CALL_ERROR;
+	uint64_t t = trace_begin();
+	int status = qvm_resume(&gt_qvm, 0, usec > 0 ? (uint64_t)usec : 0, ret);
+	trace_end("qvm_resume", -1, t);
+	s_check_unloaded();
+	return status;
+}
+
+// abandon a paused QVM function call (given to plugins)
+static void s_cancel() {
+	qvm_cancel(&gt_qvm);
+}
+
+// receive hook messages through a direct call (given to plugins)
+static int s_register_handler(const char* name, sof2gt_handler_t handler) {
+	return plugin_hooks_register(name, handler);
+}
+
+// receive copies of finished calls on a worker thread (given to plugins)
+static int s_register_observer(const char* name, sof2gt_observer_t observer) {
+	return observers_register(name, observer);
+}
+
 // stuff to pass to plugins
 sof2gt_plugininfo_t gt_pluginvars = {
 	"",			// gt_gametype
@@ -51,6 +161,17 @@ sof2gt_plugininfo_t gt_pluginvars = {
 	QMM_UNUSED,	// gt_result
 	nullptr,	// gt_syscall
 	nullptr,	// gt_vmMain
+	nullptr,	// gt_datasegment
+	0,			// gt_dataseglen
+	s_symbol,	// gt_symbol
+	s_override,	// gt_override
+	s_call,		// gt_call
+	s_register_handler,	// gt_register_handler
+	s_call_sliced,	// gt_call_sliced
+	s_resume,	// gt_resume
+	s_cancel,	// gt_cancel
+	s_register_observer,	// gt_register_observer
+	s_symbol_segment,	// gt_symbol_segment
 };
 
 // track if we shutdown
@@ -61,6 +182,24 @@ bool g_shutdown = 0;
 static bool s_load_dll(const char* file);
 // attempt to load QVM gametype mod
 static bool s_load_qvm(const char* file);
+// load a gametype QVM on the reference interpreter with a shadow copy to check against
+static bool s_load_qvm_shadow(const char* file, int flags, qvm_alloc_t* allocator);
+// start loading a gametype QVM in the background
+static void s_preload_qvm(const char* gametype);
+// give plugins access to the loaded QVM's memory and symbols
+static void s_expose_qvm(const char* file);
+// load a new version of the running gametype QVM and switch to it, keeping the live game state
+static void s_reload_qvm(bool force, const std::vector<std::string>& keep);
+// read a file with engine functions (so it can come from pk3s)
+static bool s_read_file(const char* file, std::vector<uint8_t>& filemem);
+// write a file with engine functions (into the mod directory)
+static bool s_write_file(const char* file, const std::string& contents);
+// get qvm_load flags and allocator from cvars
+static void s_qvm_options(int& flags, qvm_alloc_t*& allocator);
+// handle "sof2gt" server console command
+static bool s_console_command();
+// pass syscall on to the engine, unless it can be served from the cvar or registration caches
+static intptr_t s_engine_syscall(intptr_t* args);
 
 
 C_DLLEXPORT void QMM_Query(plugininfo_t** pinfo) {
@@ -81,6 +220,11 @@ C_DLLEXPORT int QMM_Attach(eng_syscall_t engfunc, mod_vmMain_t modfunc, pluginre
 
 
 C_DLLEXPORT void QMM_Detach() {
+	preload_cancel();
+	dllcache_flush();
+	perfcount_stop();
+	metrics_close();
+	observers_stop();
 }
 
 
@@ -91,10 +235,43 @@ C_DLLEXPORT intptr_t QMM_vmMain(intptr_t cmd, intptr_t* args) {
 		// pass result variable and return variable to plugins
 		QMM_PLUGIN_BROADCAST(PLID, "SOF2GT_Attach", &gt_pluginvars, sizeof(gt_pluginvars));
 	}
+	else if (cmd == GAME_CONSOLE_COMMAND) {
+		if (s_console_command())
+			QMM_RET_SUPERCEDE(1);
+	}
 	else if (cmd == GAME_SHUTDOWN) {
-		if (gt_dll)
-			dlclose(gt_dll);
+		if (gt_dll) {
+			// gametype DLLs stay loaded for the next map: "sof2gt_dllcache" is the number of idle modules to keep
+			// resident (0 unloads them every map), and they are all unloaded if free memory drops below
+			// "sof2gt_dllcache_minfree" MiB
+			g_syscall(G_CVAR_REGISTER, nullptr, "sof2gt_dllcache", "4", CVAR_ARCHIVE);
+			g_syscall(G_CVAR_REGISTER, nullptr, "sof2gt_dllcache_minfree", "256", CVAR_ARCHIVE);
+			intptr_t maxresident = g_syscall(G_CVAR_VARIABLE_INTEGER_VALUE, "sof2gt_dllcache");
+			dllcache_close(gt_dll, maxresident > 0 ? (size_t)maxresident : 0);
+			gt_dll = nullptr;
+
+			size_t freemem = available_memory_mb();
+			if (freemem && freemem < (size_t)g_syscall(G_CVAR_VARIABLE_INTEGER_VALUE, "sof2gt_dllcache_minfree")) {
+				size_t count = dllcache_flush();
+				if (count)
+					QMM_WRITEQMMLOG(PLID, QMM_VARARGS(PLID, "Unloaded %d resident gametype DLLs, only %d MiB free\n", (int)count, (int)freemem), QMMLOG_NOTICE);
+			}
+		}
 		qvm_unload(&gt_qvm);
+		shadow_unload();
+		register_cache_clear();
+		gt_pluginvars.gt_datasegment = nullptr;
+		gt_pluginvars.gt_dataseglen = 0;
+		symbols_clear();
+
+		// the next map usually runs the same gametype, so start decoding it while the engine loads the map.
+		// "sof2gt_preload 0" disables this
+		g_syscall(G_CVAR_REGISTER, nullptr, "sof2gt_preload", "1", CVAR_ARCHIVE);
+		if (g_syscall(G_CVAR_VARIABLE_INTEGER_VALUE, "sof2gt_preload")) {
+			char gametype[sizeof(gt_pluginvars.gt_gametype)];
+			g_syscall(G_CVAR_VARIABLE_STRING_BUFFER, "g_gametype", gametype, sizeof(gametype));
+			s_preload_qvm(gametype);
+		}
 	}
 
 	QMM_RET_IGNORED(0);
@@ -142,6 +319,12 @@ C_DLLEXPORT intptr_t QMM_syscall_Post(intptr_t cmd, intptr_t* args) {
 
 
 C_DLLEXPORT void QMM_PluginMessage(plid_t from_plid, const char* message, void* buf, intptr_t buflen) {
+	// a plugin knows which gametype is next (e.g. from a map rotation): buf is the gametype name
+	if (!strcmp(message, "SOF2GT_Preload") && buf && buflen > 0) {
+		char gametype[sizeof(gt_pluginvars.gt_gametype)];
+		strncpyz(gametype, (const char*)buf, (size_t)buflen < sizeof(gametype) ? (size_t)buflen : sizeof(gametype));
+		s_preload_qvm(gametype);
+	}
 }
 
 
@@ -151,8 +334,16 @@ C_DLLEXPORT intptr_t vmMain(intptr_t cmd, intptr_t arg0, intptr_t arg1, intptr_t
 		QMM_WRITEQMMLOG(PLID, QMM_VARARGS(PLID, "Gametype '%s' initialized!", gt_pluginvars.gt_gametype), QMMLOG_NOTICE);
 	}
 
+	uint64_t t_vmmain = trace_begin();
+	uint64_t t_metrics = metrics_begin();
+	s_vmmain_depth++;
+
 	intptr_t args[] = { cmd, arg0, arg1, arg2, arg3, arg4, arg5, arg6 };
 
+	// cached syscall results are only valid within a single vmMain call
+	syscall_cache_invalidate();
+	cvar_cache_invalidate();
+
 	// return value from mod call
 	intptr_t mod_ret = 0;
 	// return value to pass back to the engine (either mod_ret, or a plugin_ret from QMM_OVERRIDE/QMM_SUPERCEDE result)
@@ -161,15 +352,23 @@ C_DLLEXPORT intptr_t vmMain(intptr_t cmd, intptr_t arg0, intptr_t arg1, intptr_t
 	// route to plugins
 	gt_pluginvars.gt_return = 0;
 	gt_pluginvars.gt_result = QMM_UNUSED;
-	QMM_PLUGIN_BROADCAST(PLID, "SOF2GT_vmMain", args, COUNTOF(args));
+	uint64_t t = trace_begin();
+	perfcount_sample_t sample;
+	perfcount_begin(PERFCOUNT_PLUGINS, sample);
+	plugin_hooks_run(SOF2GT_MSG_VMMAIN, args, COUNTOF(args));
+	perfcount_end(PERFCOUNT_PLUGINS, cmd, sample);
+	trace_end("plugins SOF2GT_vmMain", cmd, t);
 
 	// if plugin resulted in QMM_OVERRIDE or QMM_SUPERCEDE, set final_ret to this return value
 	if (gt_pluginvars.gt_result >= QMM_OVERRIDE)
 		final_ret = gt_pluginvars.gt_return;
 
 	// call real vmMain function (unless a plugin resulted in QMM_SUPERCEDE)
-	if (gt_pluginvars.gt_result < QMM_SUPERCEDE)
+	if (gt_pluginvars.gt_result < QMM_SUPERCEDE) {
+		t = trace_begin();
 		mod_ret = gt_pluginvars.gt_vmMain(cmd, args[1], args[2], args[3], args[4], args[5], args[6], args[7]);
+		trace_end("mod vmMain", cmd, t);
+	}
 
 	// if no plugin resulted in QMM_OVERRIDE or QMM_SUPERCEDE, return the actual mod's return value back to the engine
 	if (gt_pluginvars.gt_result < QMM_OVERRIDE)
@@ -178,15 +377,29 @@ C_DLLEXPORT intptr_t vmMain(intptr_t cmd, intptr_t arg0, intptr_t arg1, intptr_t
 	// route to plugins Post
 	gt_pluginvars.gt_return = 0;
 	gt_pluginvars.gt_result = QMM_UNUSED;
-	QMM_PLUGIN_BROADCAST(PLID, "SOF2GT_vmMain_Post", args, COUNTOF(args));
+	t = trace_begin();
+	perfcount_begin(PERFCOUNT_PLUGINS, sample);
+	plugin_hooks_run(SOF2GT_MSG_VMMAIN_POST, args, COUNTOF(args));
+	perfcount_end(PERFCOUNT_PLUGINS, cmd, sample);
+	trace_end("plugins SOF2GT_vmMain_Post", cmd, t);
 
 	// if plugin resulted in QMM_OVERRIDE or QMM_SUPERCEDE, set final_ret to this return value
 	if (gt_pluginvars.gt_result >= QMM_OVERRIDE)
 		final_ret = gt_pluginvars.gt_return;
 
+	observers_push(SOF2GT_MSG_VMMAIN_POST, args, COUNTOF(args), final_ret);
+	// observers get everything from this call (and its syscalls) in one go
+	if (!--s_vmmain_depth)
+		observers_wake();
+
+	syscall_cache_invalidate();
+
 	if (cmd != GAMETYPE_RUN_FRAME)
 		QMM_WRITEQMMLOG(PLID, QMM_VARARGS(PLID, "vmMain(%d) returning %d", cmd, final_ret), QMMLOG_INFO);
 
+	metrics_vmmain(cmd, t_metrics);
+	trace_end("vmMain", cmd, t_vmmain);
+
 	return final_ret;
 }
 
@@ -201,15 +414,29 @@ intptr_t SOF2GT_syscall(intptr_t cmd, ...) {
 		args[i + 1] = va_arg(arglist, intptr_t);
 	va_end(arglist);
 
-	// return value from mod call
-	intptr_t mod_ret = 0;
+	uint64_t t_syscall = trace_begin();
+	uint64_t t_metrics = metrics_begin();
+
 	// return value to pass back to the engine (either mod_ret, or a plugin_ret from QMM_OVERRIDE/QMM_SUPERCEDE result)
 	intptr_t final_ret = 0;
 
+	// return the same result as an earlier identical read-only syscall in this vmMain call
+	if (syscall_cache_lookup(args, final_ret)) {
+		metrics_cache_hit(METRICS_SYSCALL_CACHE);
+		metrics_syscall(cmd, t_metrics);
+		trace_end("syscall (cached)", cmd, t_syscall);
+		return final_ret;
+	}
+
+	// return value from mod call
+	intptr_t mod_ret = 0;
+
 	// route to plugins
 	gt_pluginvars.gt_return = 0;
 	gt_pluginvars.gt_result = QMM_UNUSED;
-	QMM_PLUGIN_BROADCAST(PLID, "SOF2GT_syscall", args, COUNTOF(args));
+	uint64_t t = trace_begin();
+	plugin_hooks_run(SOF2GT_MSG_SYSCALL, args, COUNTOF(args));
+	trace_end("plugins SOF2GT_syscall", cmd, t);
 
 	// if plugin resulted in QMM_OVERRIDE or QMM_SUPERCEDE, set final_ret to this return value
 	if (gt_pluginvars.gt_result >= QMM_OVERRIDE)
@@ -217,7 +444,7 @@ intptr_t SOF2GT_syscall(intptr_t cmd, ...) {
 
 	// call real syscall function (unless a plugin resulted in QMM_SUPERCEDE)
 	if (gt_pluginvars.gt_result < QMM_SUPERCEDE)
-		mod_ret = gt_pluginvars.gt_syscall(cmd, args[1], args[2], args[3], args[4], args[5], args[6]);
+		mod_ret = s_engine_syscall(args);
 
 	// if no plugin resulted in QMM_OVERRIDE or QMM_SUPERCEDE, return the actual mod's return value back to the engine
 	if (gt_pluginvars.gt_result < QMM_OVERRIDE)
@@ -226,12 +453,20 @@ intptr_t SOF2GT_syscall(intptr_t cmd, ...) {
 	// route to plugins Post
 	gt_pluginvars.gt_return = 0;
 	gt_pluginvars.gt_result = QMM_UNUSED;
-	QMM_PLUGIN_BROADCAST(PLID, "SOF2GT_syscall_Post", args, COUNTOF(args));
+	t = trace_begin();
+	plugin_hooks_run(SOF2GT_MSG_SYSCALL_POST, args, COUNTOF(args));
+	trace_end("plugins SOF2GT_syscall_Post", cmd, t);
 
 	// if plugin resulted in QMM_OVERRIDE or QMM_SUPERCEDE, set final_ret to this return value
 	if (gt_pluginvars.gt_result >= QMM_OVERRIDE)
 		final_ret = gt_pluginvars.gt_return;
 
+	observers_push(SOF2GT_MSG_SYSCALL_POST, args, COUNTOF(args), final_ret);
+
+	syscall_cache_store(args, final_ret);
+
+	metrics_syscall(cmd, t_metrics);
+	trace_end("syscall", cmd, t_syscall);
 	return final_ret;
 }
 
@@ -264,97 +499,33 @@ intptr_t SOFT2GT_qvm_vmmain(intptr_t cmd, ...) {
 	}
 
 	// pass array and size to qvm
-	return qvm_exec(&gt_qvm, SOF2GT_VMMAIN_ARGS + 1, qvmargs);
-}
+	uint64_t t = trace_begin();
+	perfcount_sample_t sample;
+	perfcount_begin(PERFCOUNT_QVM, sample);
+	int ret = shadow_loaded() ? shadow_exec(-1, SOF2GT_VMMAIN_ARGS + 1, qvmargs) : qvm_exec(&gt_qvm, SOF2GT_VMMAIN_ARGS + 1, qvmargs);
+	perfcount_end(PERFCOUNT_QVM, cmd, sample);
+	trace_end("qvm_exec", cmd, t);
+	s_check_unloaded();
 
+	return ret;
+}
 
-// handle syscalls from QVM gametype mod (continues to SOF2GT_syscall)
-int SOF2GT_qvm_syscall(uint8_t* membase, int cmd, int* args) {
-	intptr_t ret = 0;
 
-	switch (cmd) {
-	case GT_MILLISECONDS:					// ( void );
-		ret = SOF2GT_syscall(cmd);
-		break;
-	case GT_SIN:							// (double)
-	case GT_COS:							// (double)
-	case GT_SQRT:							// (double)
-	case GT_FLOOR:							// (double)
-	case GT_CEIL:							// (double)
-	case GT_ACOS:							// (double x)
-	case GT_ASIN:							// not used, but probably (double x)
-	case GT_RESETITEM:						// void ( int itemid );
-	case GT_STARTGLOBALSOUND:				// void ( int soundid );
-	case GT_RESTART:						// void ( int delay );
-		ret = SOF2GT_syscall(cmd, args[0]);
-		break;
-	case GT_PRINT:							// ( const char *string );
-	case GT_ERROR:							// ( const char *string );
-	case GT_CVAR_UPDATE:					// ( vmCvar_t *vmCvar );
-	case GT_CVAR_VARIABLE_INTEGER_VALUE:	// ( const char *var_name );
-	case GT_REGISTERSOUND:					// int  ( const char* filename );
-	case GT_REGISTEREFFECT:					// int	( const char* name );
-	case GT_REGISTERICON:					// int	( const char* icon );
-	case GT_USETARGETS:						// void ( const char* targetname );
-		ret = SOF2GT_syscall(cmd, vmptr(args[0]));
-		break;
-	case GT_ATAN2:							// (double, double)
-	case GT_DOESCLIENTHAVEITEM:				// bool ( int clientid, int itemid );
-	case GT_ADDTEAMSCORE:					// void ( team_t team, int score );
-	case GT_ADDCLIENTSCORE:					// void ( int clientid, int score );
-	case GT_GIVECLIENTITEM:					// void ( int clientid, int itemid );
-	case GT_TAKECLIENTITEM:					// void ( int clientid, int itemid );
-	case GT_SETHUDICON:						// void	( int index, int icon );
-		ret = SOF2GT_syscall(cmd, args[0], args[1]);
-		break;
-	case GT_TESTPRINTINT:					// (char*, int)
-	case GT_TESTPRINTFLOAT:					// (char*, float)
-		ret = SOF2GT_syscall(cmd, vmptr(args[0]), args[1]);
-		break;
-	case GT_TEXTMESSAGE:					// void ( int clientid, const char* message );
-	case GT_RADIOMESSAGE:					// void ( int clientid, const char* message );
-	case GT_GETCLIENTORIGIN:				// void ( int clientid, vec3_t origin );
-	case GT_STARTSOUND:						// void ( int soundid, vec3_t origin );
-		ret = SOF2GT_syscall(cmd, args[0], vmptr(args[1]));
-		break;
-	case GT_CVAR_SET:						// ( const char *var_name, const char *value );
-	case GT_PERPENDICULARVECTOR:			// (vec3_t dst, const vec3_t src)
-		ret = SOF2GT_syscall(cmd, vmptr(args[0]), vmptr(args[1]));
-		break;
-	case GT_MEMSET:							// (void* dest, int c, size_t count)
-		ret = SOF2GT_syscall(cmd, vmptr(args[0]), args[1], args[2]);
-		break;
-	case GT_GETCLIENTNAME:					// void ( int clientid, const char* buffer, int buffersize );
-	case GT_GETCLIENTITEMS:					// void ( int clientid, int* buffer, int buffersize );
-	case GT_GETTRIGGERTARGET:				// void ( int triggerid, char* buffer, int buffersize );
-	case GT_GETCLIENTLIST:					// int  ( team_t team, int* clients, int clientcount );
-		ret = SOF2GT_syscall(cmd, args[0], vmptr(args[1]), args[2]);
-		break;
-	case GT_CVAR_VARIABLE_STRING_BUFFER:	// ( const char *var_name, char *buffer, int bufsize );
-	case GT_MEMCPY:							// (void* dest, const void* src, size_t count)
-	case GT_STRNCPY:						// (char* strDest, const char* strSource, size_t count)
-		ret = SOF2GT_syscall(cmd, vmptr(args[0]), vmptr(args[1]), args[2]);
-		break;
-	case GT_REGISTERITEM:					// bool ( int itemid, const char* name, gtItemDef_t* def );
-	case GT_REGISTERTRIGGER:				// bool ( int trigid, const char* name, gtTriggerDef_t* def );
-	case GT_PLAYEFFECT:						// void	( int effect, vec3_t origin, vec3_t angles );
-	case GT_SPAWNITEM:						// void ( int itemid, vec3_t origin, vec3_t angles );
-		ret = SOF2GT_syscall(cmd, args[0], vmptr(args[1]), vmptr(args[2]));
-		break;
-	case GT_MATRIXMULTIPLY:					// (float in1[3][3], float in2[3][3], float out[3][3])
-		ret = SOF2GT_syscall(cmd, vmptr(args[0]), vmptr(args[1]), vmptr(args[2]));
-		break;
-	case GT_CVAR_REGISTER:					// ( vmCvar_t *vmCvar, const char *varName, const char *defaultValue, int flags );
-		ret = SOF2GT_syscall(cmd, vmptr(args[0]), vmptr(args[1]), vmptr(args[2]), args[3]);
-		break;
-	case GT_ANGLEVECTORS:					// (const vec3_t angles, vec3_t forward, vec3_t right, vec3_t up)
-		ret = SOF2GT_syscall(cmd, vmptr(args[0]), vmptr(args[1]), vmptr(args[2]), vmptr(args[3]));
-		break;
-	default:
-		ret = 0;
+// a run-time error unloads the QVM, don't leave plugins pointing at its memory
+static void s_check_unloaded() {
+	metrics_qvm_instructions(gt_qvm.instructions);
+	if (!gt_qvm.memory) {
+		if (gt_pluginvars.gt_datasegment)
+			metrics_runtime_error();
+		gt_pluginvars.gt_datasegment = nullptr;
+		gt_pluginvars.gt_dataseglen = 0;
 	}
+}
 
-	return ret;
+
+// handle syscalls from QVM gametype mod (continues to SOF2GT_syscall)
+int SOF2GT_qvm_syscall(qvm_t* qvm, uint8_t* membase, int cmd, int* args) {
+	return (int)gt_qvm_syscall(SOF2GT_syscall, membase, qvm->dataseglen, cmd, args, s_localmem);
 }
 
 
@@ -365,9 +536,46 @@ C_DLLEXPORT void dllEntry(eng_syscall_t syscall) {
 
 	QMM_WRITEQMMLOG(PLID, QMM_VARARGS(PLID, "Gametype hook DLL loaded for gametype '%s'\n", gt_pluginvars.gt_gametype), QMMLOG_NOTICE);
 
+	// cache read-only syscalls (client lists, names, items, etc.) within each vmMain call
+	g_syscall(G_CVAR_REGISTER, nullptr, "sof2gt_syscallcache", "0", CVAR_ARCHIVE);
+	syscall_cache_enable(g_syscall(G_CVAR_VARIABLE_INTEGER_VALUE, "sof2gt_syscallcache") != 0);
+
+	// do GT_MEMSET/GT_MEMCPY/GT_STRNCPY directly on QVM memory instead of through SOF2GT_syscall and the engine
+	g_syscall(G_CVAR_REGISTER, nullptr, "sof2gt_localmem", "0", CVAR_ARCHIVE);
+	s_localmem = g_syscall(G_CVAR_VARIABLE_INTEGER_VALUE, "sof2gt_localmem") != 0;
+
+	// serve name-based cvar lookups from registered cvar handles
+	g_syscall(G_CVAR_REGISTER, nullptr, "sof2gt_cvarcache", "0", CVAR_ARCHIVE);
+	cvar_cache_init(g_syscall(G_CVAR_VARIABLE_INTEGER_VALUE, "sof2gt_cvarcache") != 0, syscall);
+
+	// reuse sound/effect/icon/item/trigger handles for repeated registrations during this map. repeats then no longer
+	// reach the engine, so this is opt-in
+	g_syscall(G_CVAR_REGISTER, nullptr, "sof2gt_registercache", "0", CVAR_ARCHIVE);
+	register_cache_enable(g_syscall(G_CVAR_VARIABLE_INTEGER_VALUE, "sof2gt_registercache") != 0);
+
+	// time each plugin's hook handlers for "sof2gt plugins"
+	g_syscall(G_CVAR_REGISTER, nullptr, "sof2gt_pluginstats", "0", CVAR_ARCHIVE);
+	plugin_hooks_timing(g_syscall(G_CVAR_VARIABLE_INTEGER_VALUE, "sof2gt_pluginstats") != 0);
+
+	// export counters for external monitoring in shared memory named after the server port
+	g_syscall(G_CVAR_REGISTER, nullptr, "sof2gt_metrics", "0", CVAR_ARCHIVE);
+	if (g_syscall(G_CVAR_VARIABLE_INTEGER_VALUE, "sof2gt_metrics")) {
+		int port = (int)g_syscall(G_CVAR_VARIABLE_INTEGER_VALUE, "net_port");
+		if (!metrics_open(port))
+			QMM_WRITEQMMLOG(PLID, QMM_VARARGS(PLID, "Could not create shared memory for metrics on port %d\n", port), QMMLOG_WARNING);
+	}
+	else {
+		metrics_close();
+	}
+	uint64_t t_load = metrics_begin();
+
 	// load gametype mod file
 	const char* modpath = QMM_VARARGS(PLID, "base/mp/qmm_gt_%sx86.dll", gt_pluginvars.gt_gametype);
-	if (!s_load_dll(modpath)) {
+	if (s_load_dll(modpath)) {
+		// a preloaded QVM won't be needed
+		preload_cancel();
+	}
+	else {
 		modpath = QMM_VARARGS(PLID, "vm/gt_%s.qvm", gt_pluginvars.gt_gametype);
 		if (!s_load_qvm(modpath)) {
 			g_shutdown = true;
@@ -376,6 +584,8 @@ C_DLLEXPORT void dllEntry(eng_syscall_t syscall) {
 		}
 	}
 
+	metrics_load(gt_pluginvars.gt_gametype, t_load);
+
 	QMM_WRITEQMMLOG(PLID, QMM_VARARGS(PLID, "Successfully loaded %s for gametype '%s'\n", (gt_dll ? "DLL" : "QVM"), gt_pluginvars.gt_gametype), QMMLOG_NOTICE);
 }
 
@@ -384,7 +594,7 @@ C_DLLEXPORT void dllEntry(eng_syscall_t syscall) {
 static bool s_load_dll(const char* file) {
 	mod_dllEntry_t gt_dllEntry;
 
-	gt_dll = dlopen(file, RTLD_NOW);
+	gt_dll = dllcache_open(file);
 	if (!gt_dll) {
 		QMM_WRITEQMMLOG(PLID, QMM_VARARGS(PLID, "s_load_dll(\"%s\"): Could not open DLL file for gametype '%s'\n", file, gt_pluginvars.gt_gametype), QMMLOG_DEBUG);
 		goto fail;
@@ -407,7 +617,7 @@ static bool s_load_dll(const char* file) {
 
 fail:
 	if (gt_dll)
-		dlclose(gt_dll);
+		dllcache_close(gt_dll, 0);
 	gt_dll = nullptr;
 	return false;
 }
@@ -415,25 +625,36 @@ fail:
 
 // attempt to load QVM gametype mod
 static bool s_load_qvm(const char* file) {
-	int fpk3;
-	intptr_t filelen;
 	std::vector<uint8_t> filemem;
 	int loaded;
+	int flags;
+	qvm_alloc_t* allocator;
+
+	s_qvm_options(flags, allocator);
+
+	// "sof2gt_shadow 1" runs the gametype on the reference interpreter and repeats every call on a copy loaded with
+	// the optimization flags above, logging where they diverge (for testing the optimizer, see shadow.h)
+	g_syscall(G_CVAR_REGISTER, nullptr, "sof2gt_shadow", "0", CVAR_ARCHIVE);
+	if (g_syscall(G_CVAR_VARIABLE_INTEGER_VALUE, "sof2gt_shadow"))
+		return s_load_qvm_shadow(file, flags, allocator);
+
+	// use the QVM loaded in the background, if it was started for this gametype
+	if (preload_take(gt_pluginvars.gt_gametype, flags, allocator, &gt_qvm)) {
+		QMM_WRITEQMMLOG(PLID, QMM_VARARGS(PLID, "s_load_qvm(\"%s\"): Using preloaded QVM for gametype '%s'\n", file, gt_pluginvars.gt_gametype), QMMLOG_DEBUG);
+		gt_pluginvars.gt_vmMain = SOFT2GT_qvm_vmmain;
+		s_keep_initdata(gt_qvm);
+		s_expose_qvm(file);
+		return true;
+	}
 
 	// load file using engine functions to read into pk3s if necessary
-	filelen = g_syscall(G_FS_FOPEN_FILE, file, &fpk3, FS_READ);
-	if (filelen <= 0) {
+	if (!s_read_file(file, filemem)) {
 		QMM_WRITEQMMLOG(PLID, QMM_VARARGS(PLID, "s_load_qvm(\"%s\"): Could not open QVM for reading for gametype '%s'\n", file, gt_pluginvars.gt_gametype), QMMLOG_DEBUG);
-		g_syscall(G_FS_FCLOSE_FILE, fpk3);
 		return false;
 	}
-	filemem.resize((size_t)filelen);
-
-	g_syscall(G_FS_READ, filemem.data(), filelen, fpk3);
-	g_syscall(G_FS_FCLOSE_FILE, fpk3);
 
 	// attempt to load mod
-	loaded = qvm_load(&gt_qvm, filemem.data(), filemem.size(), SOF2GT_qvm_syscall, true, nullptr);	// true = verify_data
+	loaded = qvm_load(&gt_qvm, filemem.data(), filemem.size(), SOF2GT_qvm_syscall, flags, allocator);
 	if (!loaded) {
 		QMM_WRITEQMMLOG(PLID, QMM_VARARGS(PLID, "s_load_qvm(\"%s\"): QVM load failed for gametype '%s'\n", file, gt_pluginvars.gt_gametype), QMMLOG_DEBUG);
 		return false;
@@ -441,6 +662,373 @@ static bool s_load_qvm(const char* file) {
 
 	// special function to call into QVM
 	gt_pluginvars.gt_vmMain = SOFT2GT_qvm_vmmain;
+	s_keep_initdata(gt_qvm);
+	s_expose_qvm(file);
+
+	return true;
+}
+
+
+// load a gametype QVM on the reference interpreter with a shadow copy to check against
+static bool s_load_qvm_shadow(const char* file, int flags, qvm_alloc_t* allocator) {
+	std::vector<uint8_t> filemem;
+
+	// the preloaded QVM was loaded with the optimization flags, so it can't be the reference
+	preload_cancel();
+
+	if (!s_read_file(file, filemem)) {
+		QMM_WRITEQMMLOG(PLID, QMM_VARARGS(PLID, "s_load_qvm_shadow(\"%s\"): Could not open QVM for reading for gametype '%s'\n", file, gt_pluginvars.gt_gametype), QMMLOG_DEBUG);
+		return false;
+	}
+
+	if (!qvm_load(&gt_qvm, filemem.data(), filemem.size(), shadow_syscall, QVM_LOAD_VERIFY_DATA, allocator)) {
+		QMM_WRITEQMMLOG(PLID, QMM_VARARGS(PLID, "s_load_qvm_shadow(\"%s\"): QVM load failed for gametype '%s'\n", file, gt_pluginvars.gt_gametype), QMMLOG_DEBUG);
+		return false;
+	}
+
+	// without a shadow copy the gametype still runs on the reference interpreter
+	if (shadow_load(&gt_qvm, filemem.data(), filemem.size(), SOF2GT_qvm_syscall, flags & ~QVM_LOAD_SHARE_CODE, allocator))
+		QMM_WRITEQMMLOG(PLID, QMM_VARARGS(PLID, "Shadow execution enabled for gametype '%s' (flags %d)\n", gt_pluginvars.gt_gametype, flags & ~QVM_LOAD_SHARE_CODE), QMMLOG_NOTICE);
+	else
+		QMM_WRITEQMMLOG(PLID, QMM_VARARGS(PLID, "s_load_qvm_shadow(\"%s\"): Shadow QVM load failed for gametype '%s'\n", file, gt_pluginvars.gt_gametype), QMMLOG_WARNING);
+
+	gt_pluginvars.gt_vmMain = SOFT2GT_qvm_vmmain;
+	s_keep_initdata(gt_qvm);
+	s_expose_qvm(file);
+
+	return true;
+}
+
+
+// give plugins access to the loaded QVM's memory and symbols
+static void s_expose_qvm(const char* file) {
+	gt_pluginvars.gt_datasegment = gt_qvm.datasegment;
+	gt_pluginvars.gt_dataseglen = gt_qvm.dataseglen;
+
+	// symbols come from the q3asm .map file next to the .qvm, if there is one
+	std::string mapfile = file;
+	mapfile.replace(mapfile.size() - 4, 4, ".map");
+	std::vector<uint8_t> filemem;
+	symbols_clear();
+	if (s_read_file(mapfile.c_str(), filemem)) {
+		size_t count = symbols_parse((const char*)filemem.data(), filemem.size());
+		QMM_WRITEQMMLOG(PLID, QMM_VARARGS(PLID, "s_expose_qvm(\"%s\"): Loaded %d symbols\n", mapfile.c_str(), (int)count), QMMLOG_DEBUG);
+	}
+}
+
+
+// load a new version of the running gametype QVM and switch to it, keeping the live game state. this runs from a
+// console command, between calls into the gametype, so the switch happens at a frame boundary. 'force' allows it
+// without .map files to check symbols against, or with changed initialized data. 'keep' are initialized globals
+// whose live values are carried over (bss always is)
+static void s_reload_qvm(bool force, const std::vector<std::string>& keep) {
+	if (!gt_qvm.memory) {
+		g_syscall(G_PRINT, "[SOF2GT] Reloading is only available for QVM gametypes\n");
+		return;
+	}
+	if (shadow_loaded()) {
+		g_syscall(G_PRINT, "[SOF2GT] Reloading is not available with sof2gt_shadow\n");
+		return;
+	}
+	// a paused plugin call (gt_call_sliced) has stack frames from the old code
+	if (gt_qvm.context->depth || gt_qvm.context->paused.active) {
+		g_syscall(G_PRINT, "[SOF2GT] Can't reload while a call into the gametype is running or paused\n");
+		return;
+	}
+
+	const char* file = QMM_VARARGS(PLID, "vm/gt_%s.qvm", gt_pluginvars.gt_gametype);
+	std::vector<uint8_t> filemem;
+	if (!s_read_file(file, filemem)) {
+		g_syscall(G_PRINT, QMM_VARARGS(PLID, "[SOF2GT] Could not open %s for reading\n", file));
+		return;
+	}
+
+	int flags;
+	qvm_alloc_t* allocator;
+	s_qvm_options(flags, allocator);
+	qvm_t qvm = {};
+	if (!qvm_load(&qvm, filemem.data(), filemem.size(), SOF2GT_qvm_syscall, flags, allocator)) {
+		g_syscall(G_PRINT, QMM_VARARGS(PLID, "[SOF2GT] Could not load %s\n", file));
+		return;
+	}
+
+	// the live globals only make sense to the new code if every global is in the same place, and function pointers
+	// stored in them are instruction indexes into the old code, so every function must be in the same place too.
+	// segment sizes must match, and so must the address of every symbol in the .map files of both versions. without
+	// both .map files this can't be checked, so it needs "force"
+	const qvmheader_t& before = gt_qvm.header;
+	const qvmheader_t& after = qvm.header;
+	std::string reason;
+	if (before.datalen != after.datalen || before.litlen != after.litlen || before.bsslen != after.bsslen || qvm.dataseglen != gt_qvm.dataseglen) {
+		reason = QMM_VARARGS(PLID, "segment sizes changed (data %u -> %u, lit %u -> %u, bss %u -> %u)", before.datalen, after.datalen,
+			before.litlen, after.litlen, before.bsslen, after.bsslen);
+	}
+	else {
+		std::string mapfile = file;
+		mapfile.replace(mapfile.size() - 4, 4, ".map");
+		std::vector<uint8_t> mapmem;
+		if (symbols_count() && s_read_file(mapfile.c_str(), mapmem))
+			reason = symbols_diff((const char*)mapmem.data(), mapmem.size());
+		else if (!force)
+			reason = "there is no .map file for both versions to check that functions and globals didn't move (use \"sof2gt reload force\" to skip this check)";
+	}
+	// lcc puts switch jump tables (code addresses, under local labels that aren't in the .map file) in initialized
+	// data, so a change there may be a change to code that the symbol check can't see
+	if (reason.empty() && !force && (s_qvm_initdata.size() != after.datalen || memcmp(s_qvm_initdata.data(), qvm.datasegment, after.datalen)))
+		reason = "its initialized data changed, which includes switch jump tables (use \"sof2gt reload force\" to reload anyway)";
+
+	// live values of initialized globals to carry over, from the old version's .map file
+	std::vector<std::pair<int, int>> ranges;
+	for (size_t i = 0; reason.empty() && i < keep.size(); i++) {
+		int segment = -1;
+		int address = symbols_find(keep[i].c_str(), &segment);
+		if (address < 0 || segment != SYMBOL_SEG_DATA || (uint32_t)address >= after.datalen) {
+			reason = "'" + keep[i] + "' is not an initialized global in the .map file";
+			break;
+		}
+		int next = symbols_data_next(address);
+		int end = next < 0 || (uint32_t)next > after.datalen ? (int)after.datalen : next;
+		ranges.push_back({ address, end - address });
+	}
+
+	if (!reason.empty()) {
+		g_syscall(G_PRINT, QMM_VARARGS(PLID, "[SOF2GT] Can't reload %s, %s. A map restart is needed\n", file, reason.c_str()));
+		qvm_unload(&qvm);
+		return;
+	}
+
+	// keep the live bss (and the idle program stack) and the globals asked for. the rest of the initialized data and
+	// the string literals come from the new version
+	s_keep_initdata(qvm);
+	size_t litend = after.datalen + after.litlen;
+	for (auto& range : ranges)
+		memcpy(qvm.datasegment + range.first, gt_qvm.datasegment + range.first, range.second);
+	memcpy(qvm.datasegment + litend, gt_qvm.datasegment + litend, gt_qvm.dataseglen - litend);
+	qvm.stackptr = (int*)(qvm.datasegment + ((uint8_t*)gt_qvm.stackptr - gt_qvm.datasegment));
+	qvm.instructions = gt_qvm.instructions;
+
+	qvm_unload(&gt_qvm);
+	gt_qvm = qvm;
+	gt_pluginvars.gt_vmMain = SOFT2GT_qvm_vmmain;
+	s_expose_qvm(file);
+
+	// a QVM preloaded for the next map may be the old version
+	preload_cancel();
 
+	QMM_WRITEQMMLOG(PLID, QMM_VARARGS(PLID, "Reloaded %s for gametype '%s'\n", file, gt_pluginvars.gt_gametype), QMMLOG_NOTICE);
+	g_syscall(G_PRINT, QMM_VARARGS(PLID, "[SOF2GT] Reloaded %s\n", file));
+
+	// native overrides were on the old code: plugins need to register them again
+	QMM_PLUGIN_BROADCAST(PLID, "SOF2GT_Reload", &gt_pluginvars, sizeof(gt_pluginvars));
+}
+
+
+// start loading a gametype QVM in the background
+static void s_preload_qvm(const char* gametype) {
+	if (!*gametype || preload_pending(gametype))
+		return;
+
+	// native gametype DLLs take priority (see dllEntry), nothing to preload
+	FILE* dll = fopen(QMM_VARARGS(PLID, "base/mp/qmm_gt_%sx86.dll", gametype), "rb");
+	if (dll) {
+		fclose(dll);
+		return;
+	}
+
+	std::vector<uint8_t> filemem;
+	const char* file = QMM_VARARGS(PLID, "vm/gt_%s.qvm", gametype);
+	if (!s_read_file(file, filemem)) {
+		QMM_WRITEQMMLOG(PLID, QMM_VARARGS(PLID, "s_preload_qvm(\"%s\"): Could not open QVM for reading for gametype '%s'\n", file, gametype), QMMLOG_DEBUG);
+		return;
+	}
+
+	int flags;
+	qvm_alloc_t* allocator;
+	s_qvm_options(flags, allocator);
+	preload_start(gametype, std::move(filemem), SOF2GT_qvm_syscall, flags, allocator);
+}
+
+
+// read a file with engine functions (so it can come from pk3s)
+static bool s_read_file(const char* file, std::vector<uint8_t>& filemem) {
+	int fpk3;
+	intptr_t filelen = g_syscall(G_FS_FOPEN_FILE, file, &fpk3, FS_READ);
+	if (filelen <= 0) {
+		g_syscall(G_FS_FCLOSE_FILE, fpk3);
+		return false;
+	}
+	filemem.resize((size_t)filelen);
+
+	g_syscall(G_FS_READ, filemem.data(), filelen, fpk3);
+	g_syscall(G_FS_FCLOSE_FILE, fpk3);
+	return true;
+}
+
+
+// write a file with engine functions (into the mod directory)
+static bool s_write_file(const char* file, const std::string& contents) {
+	int fh = 0;
+	g_syscall(G_FS_FOPEN_FILE, file, &fh, FS_WRITE);
+	if (!fh)
+		return false;
+
+	g_syscall(G_FS_WRITE, contents.data(), (int)contents.size(), fh);
+	g_syscall(G_FS_FCLOSE_FILE, fh);
 	return true;
 }
+
+
+// get qvm_load flags and allocator from cvars
+static void s_qvm_options(int& flags, qvm_alloc_t*& allocator) {
+	// "sof2gt_optimize 1" optimizes bytecode at load time. off by default, check a gametype with sof2gt_shadow before
+	// turning it on
+	flags = QVM_LOAD_VERIFY_DATA;
+	g_syscall(G_CVAR_REGISTER, nullptr, "sof2gt_optimize", "0", CVAR_ARCHIVE);
+	if (g_syscall(G_CVAR_VARIABLE_INTEGER_VALUE, "sof2gt_optimize"))
+		flags |= QVM_LOAD_OPTIMIZE;
+
+	// inlining is separate: it stops gt_override from working on inlined functions, and is often slower
+	// ("sof2gt_inline 1", only with sof2gt_optimize)
+	g_syscall(G_CVAR_REGISTER, nullptr, "sof2gt_inline", "0", CVAR_ARCHIVE);
+	if ((flags & QVM_LOAD_OPTIMIZE) && g_syscall(G_CVAR_VARIABLE_INTEGER_VALUE, "sof2gt_inline"))
+		flags |= QVM_LOAD_INLINE;
+
+	// VM memory comes from malloc, or from page allocations (prefaulted, huge pages where available) with
+	// "sof2gt_allocator mmap"
+	char allocname[16];
+	g_syscall(G_CVAR_REGISTER, nullptr, "sof2gt_allocator", "malloc", CVAR_ARCHIVE);
+	g_syscall(G_CVAR_VARIABLE_STRING_BUFFER, "sof2gt_allocator", allocname, sizeof(allocname));
+	allocator = strcmp(allocname, "mmap") ? &qvm_allocator_default : &qvm_allocator_mmap;
+
+	// decoded code is shared with other servers on this host with "sof2gt_sharecode 1"
+	g_syscall(G_CVAR_REGISTER, nullptr, "sof2gt_sharecode", "0", CVAR_ARCHIVE);
+	if (g_syscall(G_CVAR_VARIABLE_INTEGER_VALUE, "sof2gt_sharecode"))
+		flags |= QVM_LOAD_SHARE_CODE;
+}
+
+
+// handle "sof2gt" server console command
+static bool s_console_command() {
+	char arg[64];
+	g_syscall(G_ARGV, 0, arg, sizeof(arg));
+	if (strcmp(arg, "sof2gt"))
+		return false;
+
+	g_syscall(G_ARGV, 1, arg, sizeof(arg));
+	if (!strcmp(arg, "flushdll")) {
+		size_t count = dllcache_flush();
+		g_syscall(G_PRINT, QMM_VARARGS(PLID, "[SOF2GT] Unloaded %d resident gametype DLLs\n", (int)count));
+	}
+	else if (!strcmp(arg, "stats")) {
+		// print and reset syscall/cvar/registration cache hit rates
+		std::string stats = syscall_cache_stats();
+		g_syscall(G_PRINT, "[SOF2GT] Syscall cache stats:\n");
+		g_syscall(G_PRINT, stats.c_str());
+		syscall_cache_reset_stats();
+		stats = cvar_cache_stats();
+		g_syscall(G_PRINT, stats.c_str());
+		cvar_cache_reset_stats();
+		stats = register_cache_stats();
+		g_syscall(G_PRINT, stats.c_str());
+		register_cache_reset_stats();
+	}
+	else if (!strcmp(arg, "trace")) {
+		// "sof2gt trace start [events]" records the last [events] spans, "sof2gt trace stop [file]" writes them
+		g_syscall(G_ARGV, 2, arg, sizeof(arg));
+		if (!strcmp(arg, "start")) {
+			g_syscall(G_ARGV, 3, arg, sizeof(arg));
+			int events = atoi(arg);
+			trace_start(events > 0 ? (size_t)events : 65536);
+			g_syscall(G_PRINT, "[SOF2GT] Tracing started\n");
+		}
+		else if (!strcmp(arg, "stop")) {
+			g_syscall(G_ARGV, 3, arg, sizeof(arg));
+			const char* file = *arg ? arg : "sof2gt_trace.json";
+			std::string json = trace_stop();
+			if (s_write_file(file, json))
+				g_syscall(G_PRINT, QMM_VARARGS(PLID, "[SOF2GT] Wrote trace to %s\n", file));
+			else
+				g_syscall(G_PRINT, QMM_VARARGS(PLID, "[SOF2GT] Could not write trace to %s\n", file));
+		}
+		else {
+			g_syscall(G_PRINT, "[SOF2GT] Usage: sof2gt trace <start [events]|stop [file]>\n");
+		}
+	}
+	else if (!strcmp(arg, "perf")) {
+		// "sof2gt perf start" opens CPU counters, "sof2gt perf" prints per-cmd averages, "sof2gt perf stop" closes them
+		g_syscall(G_ARGV, 2, arg, sizeof(arg));
+		if (!strcmp(arg, "start")) {
+			if (perfcount_start())
+				g_syscall(G_PRINT, "[SOF2GT] Performance counters started\n");
+			else
+				g_syscall(G_PRINT, "[SOF2GT] Could not open performance counters\n");
+		}
+		else if (!strcmp(arg, "stop")) {
+			perfcount_stop();
+			g_syscall(G_PRINT, "[SOF2GT] Performance counters stopped\n");
+		}
+		else {
+			std::string report = perfcount_report();
+			g_syscall(G_PRINT, report.c_str());
+			if (!perfcount_active())
+				g_syscall(G_PRINT, "[SOF2GT] Usage: sof2gt perf <start|stop>\n");
+		}
+	}
+	else if (!strcmp(arg, "plugins")) {
+		// "sof2gt plugins [time|avg|calls|override|supercede|name]" prints time spent in each plugin's hook handlers
+		g_syscall(G_ARGV, 2, arg, sizeof(arg));
+		if (!strcmp(arg, "reset")) {
+			plugin_hooks_reset_stats();
+			observers_reset_stats();
+			g_syscall(G_PRINT, "[SOF2GT] Plugin hook stats reset\n");
+		}
+		else {
+			std::string report = plugin_hooks_report(arg) + observers_report();
+			g_syscall(G_PRINT, report.c_str());
+		}
+	}
+	else if (!strcmp(arg, "shadow")) {
+		// "sof2gt shadow" prints shadow execution results (see "sof2gt_shadow")
+		std::string report = shadow_report();
+		g_syscall(G_PRINT, report.c_str());
+	}
+	else if (!strcmp(arg, "reload")) {
+		// "sof2gt reload [force] [global ...]" switches to a new version of the gametype QVM without a map restart
+		bool force = false;
+		std::vector<std::string> keep;
+		int argc = (int)g_syscall(G_ARGC);
+		for (int i = 2; i < argc; i++) {
+			g_syscall(G_ARGV, i, arg, sizeof(arg));
+			if (!strcmp(arg, "force"))
+				force = true;
+			else
+				keep.push_back(arg);
+		}
+		s_reload_qvm(force, keep);
+	}
+	else {
+		g_syscall(G_PRINT, QMM_VARARGS(PLID, "[SOF2GT] %d resident gametype DLLs\n", (int)dllcache_count()));
+		g_syscall(G_PRINT, "[SOF2GT] Usage: sof2gt <flushdll|stats|trace|perf|plugins|shadow|reload>\n");
+	}
+	return true;
+}
+
+
+// pass syscall on to the engine, unless it can be served from the cvar or registration caches
+static intptr_t s_engine_syscall(intptr_t* args) {
+	intptr_t ret = 0;
+	if (cvar_cache_syscall(args, ret)) {
+		metrics_cache_hit(METRICS_CVAR_CACHE);
+		return ret;
+	}
+	if (register_cache_lookup(args, ret)) {
+		metrics_cache_hit(METRICS_REGISTER_CACHE);
+		return ret;
+	}
+
+	uint64_t t = trace_begin();
+	ret = gt_pluginvars.gt_syscall(args[0], args[1], args[2], args[3], args[4], args[5], args[6]);
+	trace_end("engine", args[0], t);
+	register_cache_store(args, ret);
+	return ret;
+}
@@ -0,0 +1,216 @@
+/*
+SoF2GT_QMM - Hook gametype dlls/qvms for Soldier of Fortune 2
+Copyright 2025-2026
+https://github.com/thecybermind/sof2gt_qmm/
+3-clause BSD license: https://opensource.org/license/bsd-3-clause
+
+Created By:
+	Kevin Masterson < k.m.masterson@gmail.com >
+
+*/
+
+#define _CRT_SECURE_NO_WARNINGS 1
+
+#include <atomic>
+#include <cstdio>
+#include <cstring>
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+
+#include "metrics.h"
+#include "util.h"
+#include "trace.h"
+
+static sof2gt_metrics_t* s_metrics = nullptr;
+static char s_name[64];
+static int s_port = 0;
+#ifdef _WIN32
+static HANDLE s_handle = nullptr;
+#endif
+// last value of the QVM's cumulative instruction counter
+static uint64_t s_lastinstructions = 0;
+
+
+// start an update: make 'seq' odd before any counter changes
+static inline void s_write_begin() {
+	std::atomic_thread_fence(std::memory_order_seq_cst);
+	s_metrics->seq++;
+	std::atomic_thread_fence(std::memory_order_release);
+}
+
+
+// end an update: make 'seq' even after all counter changes
+static inline void s_write_end() {
+	std::atomic_thread_fence(std::memory_order_release);
+	s_metrics->seq++;
+}
+
+
+// create the shared memory object for the given server port
+bool metrics_open(int port) {
+	if (s_metrics && s_port == port)
+		return true;
+	metrics_close();
+
+	void* view = nullptr;
+	size_t size = sizeof(sof2gt_metrics_t);
+#ifdef _WIN32
+	char name[sizeof(s_name)];
+	snprintf(name, sizeof(name), SOF2GT_METRICS_NAME, port);
+	snprintf(s_name, sizeof(s_name), "Local\\%s", name);
+	s_handle = CreateFileMappingA(INVALID_HANDLE_VALUE, nullptr, PAGE_READWRITE, 0, (DWORD)size, s_name);
+	if (!s_handle)
+		return false;
+	view = MapViewOfFile(s_handle, FILE_MAP_WRITE, 0, 0, size);
+	if (!view) {
+		CloseHandle(s_handle);
+		s_handle = nullptr;
+		return false;
+	}
+#else
+	s_name[0] = '/';
+	snprintf(s_name + 1, sizeof(s_name) - 1, SOF2GT_METRICS_NAME, port);
+	// a previous server on this port may have crashed without removing its object
+	shm_unlink(s_name);
+	// readable by monitoring agents running as other users
+	int fd = shm_open(s_name, O_RDWR | O_CREAT | O_EXCL, 0644);
+	if (fd < 0)
+		return false;
+	if (ftruncate(fd, (off_t)size) < 0 ||
+		(view = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0)) == MAP_FAILED) {
+		close(fd);
+		shm_unlink(s_name);
+		return false;
+	}
+	close(fd);
+#endif
+
+	s_metrics = (sof2gt_metrics_t*)view;
+	memset(s_metrics, 0, size);
+	s_metrics->version = SOF2GT_METRICS_VERSION;
+	s_metrics->size = (uint32_t)size;
+#ifdef _WIN32
+	s_metrics->pid = (int32_t)GetCurrentProcessId();
+#else
+	s_metrics->pid = (int32_t)getpid();
+#endif
+	s_metrics->port = port;
+	s_port = port;
+	s_lastinstructions = 0;
+	// readers check the magic last
+	std::atomic_thread_fence(std::memory_order_release);
+	s_metrics->magic = SOF2GT_METRICS_MAGIC;
+	return true;
+}
+
+
+// remove the shared memory object
+void metrics_close() {
+	if (!s_metrics)
+		return;
+
+	s_metrics->magic = 0;
+#ifdef _WIN32
+	UnmapViewOfFile(s_metrics);
+	CloseHandle(s_handle);
+	s_handle = nullptr;
+#else
+	munmap(s_metrics, sizeof(sof2gt_metrics_t));
+	shm_unlink(s_name);
+#endif
+	s_metrics = nullptr;
+}
+
+
+// start timing something
+uint64_t metrics_begin() {
+	return s_metrics ? trace_now() : 0;
+}
+
+
+// count a syscall that started at 'begin'
+void metrics_syscall(intptr_t cmd, uint64_t begin) {
+	if (!s_metrics || !begin)
+		return;
+	uint64_t ns = trace_now() - begin;
+	if (cmd < 0 || cmd >= SOF2GT_METRICS_SYSCALLS)
+		cmd = SOF2GT_METRICS_SYSCALLS - 1;
+	s_write_begin();
+	s_metrics->syscalls[cmd].calls++;
+	s_metrics->syscalls[cmd].ns += ns;
+	s_write_end();
+}
+
+
+// count a vmMain call that started at 'begin'
+void metrics_vmmain(intptr_t cmd, uint64_t begin) {
+	if (!s_metrics || !begin)
+		return;
+	uint64_t ns = trace_now() - begin;
+	if (cmd < 0 || cmd >= SOF2GT_METRICS_VMMAIN)
+		cmd = SOF2GT_METRICS_VMMAIN - 1;
+	s_write_begin();
+	s_metrics->vmmain[cmd].calls++;
+	s_metrics->vmmain[cmd].ns += ns;
+	s_write_end();
+}
+
+
+// add instructions executed by the QVM since the last call
+void metrics_qvm_instructions(uint64_t counter) {
+	if (!s_metrics)
+		return;
+	// the counter starts over when a QVM is loaded
+	if (counter < s_lastinstructions)
+		s_lastinstructions = 0;
+	s_write_begin();
+	s_metrics->qvm_instructions += counter - s_lastinstructions;
+	s_write_end();
+	s_lastinstructions = counter;
+}
+
+
+// count a QVM run-time error
+void metrics_runtime_error() {
+	if (!s_metrics)
+		return;
+	s_write_begin();
+	s_metrics->runtime_errors++;
+	s_write_end();
+}
+
+
+// count a load of the given gametype that started at 'begin'
+void metrics_load(const char* gametype, uint64_t begin) {
+	if (!s_metrics || !begin)
+		return;
+	uint64_t ns = trace_now() - begin;
+	s_write_begin();
+	strncpyz(s_metrics->gametype, gametype, sizeof(s_metrics->gametype));
+	s_metrics->loads.calls++;
+	s_metrics->loads.ns += ns;
+	s_write_end();
+	s_lastinstructions = 0;
+}
+
+
+// count a cache hit
+void metrics_cache_hit(int cache) {
+	if (!s_metrics)
+		return;
+	s_write_begin();
+	if (cache == METRICS_SYSCALL_CACHE)
+		s_metrics->syscall_cache_hits++;
+	else if (cache == METRICS_CVAR_CACHE)
+		s_metrics->cvar_cache_hits++;
+	else if (cache == METRICS_REGISTER_CACHE)
+		s_metrics->register_cache_hits++;
+	s_write_end();
+}
@@ -0,0 +1,409 @@
+/*
+SoF2GT_QMM - Hook gametype dlls/qvms for Soldier of Fortune 2
+Copyright 2025-2026
+https://github.com/thecybermind/sof2gt_qmm/
+3-clause BSD license: https://opensource.org/license/bsd-3-clause
+
+Created By:
+    Kevin Masterson < k.m.masterson@gmail.com >
+
+*/
+
+#define _CRT_SECURE_NO_WARNINGS 1
+
+#include <qmmapi.h>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdio>
+#include <cstring>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "game.h"
+#include "trace.h"
+#include "observers.h"
+
+// number of slots in the ring (power of 2)
+#define OBSERVE_QUEUE_SIZE 2048
+
+// a registered observer (entries stay after unregistering so their counts can still be reported, and so the worker
+// can keep pointers to them). the counts are written by the worker and read/reset by the game thread
+struct observer_entry_t {
+	std::string name;
+	std::atomic<sof2gt_observer_t> observer{ nullptr };
+	std::atomic<uint64_t> calls{ 0 };
+	std::atomic<uint64_t> ns{ 0 };
+};
+
+// what a syscall pointer argument points to
+enum {
+	ARG_VALUE,			// not a pointer
+	ARG_STRING,			// null-terminated string
+	ARG_BUFFER,			// string buffer, size in the next argument
+	ARG_INTS,			// int array, count in the next argument
+	ARG_VEC3,			// vec3_t
+	ARG_MATRIX,			// float[3][3]
+	ARG_CVAR,			// vmCvar_t
+	ARG_ITEMDEF,		// gtItemDef_t
+	ARG_TRIGGERDEF,		// gtTriggerDef_t
+	ARG_OTHER,			// anything else (not copied)
+};
+
+// the ring is written only by the game thread (head) and read only by the worker (tail). the observer list is shared
+// and guarded by 'mutex', which is only held to change or copy the list. the worker delivers to its own copy while
+// holding 'delivering', which unregistering takes so it waits for a call in progress
+struct observers_t {
+	std::vector<sof2gt_observation_t> queue;
+	std::atomic<size_t> head{ 0 };			// next slot to fill
+	std::atomic<size_t> tail{ 0 };			// next slot to deliver
+
+	std::mutex mutex;
+	std::vector<std::unique_ptr<observer_entry_t>> observers;
+	std::atomic<unsigned int> version{ 0 };	// changed whenever the list is, so the worker knows to copy it again
+	std::mutex delivering;
+
+	std::thread worker;
+	std::mutex wakemutex;
+	std::condition_variable wake;
+	std::atomic<bool> waiting{ false };		// worker is (about to be) asleep, the game thread has to wake it
+	std::atomic<bool> stop{ false };
+
+	// written by the game thread only (so the counts don't need atomic increments)
+	int active = 0;							// number of registered observers
+	std::atomic<uint64_t> queued{ 0 };
+	std::atomic<uint64_t> dropped{ 0 };
+
+	// make sure the worker is done before the plugin goes away
+	~observers_t() {
+		observers_stop();
+	}
+};
+static observers_t s_observers;
+
+
+// kinds of each pointer argument (args[1] onwards) of a syscall, as passed to SOF2GT_syscall
+static void s_arg_kinds(intptr_t cmd, int kinds[SOF2GT_OBSERVE_ARGS]) {
+	std::fill(kinds, kinds + SOF2GT_OBSERVE_ARGS, ARG_VALUE);
+
+	switch (cmd) {
+	case GT_PRINT:							// ( const char *string );
+	case GT_ERROR:							// ( const char *string );
+	case GT_CVAR_VARIABLE_INTEGER_VALUE:	// ( const char *var_name );
+	case GT_REGISTERSOUND:					// int  ( const char* filename );
+	case GT_REGISTEREFFECT:					// int	( const char* name );
+	case GT_REGISTERICON:					// int	( const char* icon );
+	case GT_USETARGETS:						// void ( const char* targetname );
+	case GT_TESTPRINTINT:					// (char*, int)
+	case GT_TESTPRINTFLOAT:					// (char*, float)
+		kinds[1] = ARG_STRING;
+		break;
+	case GT_CVAR_UPDATE:					// ( vmCvar_t *vmCvar );
+		kinds[1] = ARG_CVAR;
+		break;
+	case GT_TEXTMESSAGE:					// void ( int clientid, const char* message );
+	case GT_RADIOMESSAGE:					// void ( int clientid, const char* message );
+		kinds[2] = ARG_STRING;
+		break;
+	case GT_GETCLIENTORIGIN:				// void ( int clientid, vec3_t origin );
+	case GT_STARTSOUND:						// void ( int soundid, vec3_t origin );
+		kinds[2] = ARG_VEC3;
+		break;
+	case GT_CVAR_SET:						// ( const char *var_name, const char *value );
+		kinds[1] = kinds[2] = ARG_STRING;
+		break;
+	case GT_PERPENDICULARVECTOR:			// (vec3_t dst, const vec3_t src)
+		kinds[1] = kinds[2] = ARG_VEC3;
+		break;
+	case GT_MEMSET:							// (void* dest, int c, size_t count)
+		kinds[1] = ARG_OTHER;
+		break;
+	case GT_MEMCPY:							// (void* dest, const void* src, size_t count)
+		kinds[1] = kinds[2] = ARG_OTHER;
+		break;
+	case GT_STRNCPY:						// (char* strDest, const char* strSource, size_t count)
+		kinds[1] = ARG_OTHER;
+		kinds[2] = ARG_STRING;
+		break;
+	case GT_GETCLIENTNAME:					// void ( int clientid, const char* buffer, int buffersize );
+	case GT_GETTRIGGERTARGET:				// void ( int triggerid, char* buffer, int buffersize );
+		kinds[2] = ARG_BUFFER;
+		break;
+	case GT_GETCLIENTITEMS:					// void ( int clientid, int* buffer, int buffersize );
+	case GT_GETCLIENTLIST:					// int  ( team_t team, int* clients, int clientcount );
+		kinds[2] = ARG_INTS;
+		break;
+	case GT_CVAR_VARIABLE_STRING_BUFFER:	// ( const char *var_name, char *buffer, int bufsize );
+		kinds[1] = ARG_STRING;
+		kinds[2] = ARG_BUFFER;
+		break;
+	case GT_REGISTERITEM:					// bool ( int itemid, const char* name, gtItemDef_t* def );
+		kinds[2] = ARG_STRING;
+		kinds[3] = ARG_ITEMDEF;
+		break;
+	case GT_REGISTERTRIGGER:				// bool ( int trigid, const char* name, gtTriggerDef_t* def );
+		kinds[2] = ARG_STRING;
+		kinds[3] = ARG_TRIGGERDEF;
+		break;
+	case GT_PLAYEFFECT:						// void	( int effect, vec3_t origin, vec3_t angles );
+	case GT_SPAWNITEM:						// void ( int itemid, vec3_t origin, vec3_t angles );
+		kinds[2] = kinds[3] = ARG_VEC3;
+		break;
+	case GT_MATRIXMULTIPLY:					// (float in1[3][3], float in2[3][3], float out[3][3])
+		kinds[1] = kinds[2] = kinds[3] = ARG_MATRIX;
+		break;
+	case GT_CVAR_REGISTER:					// ( vmCvar_t *vmCvar, const char *varName, const char *defaultValue, int flags );
+		kinds[1] = ARG_CVAR;
+		kinds[2] = kinds[3] = ARG_STRING;
+		break;
+	case GT_ANGLEVECTORS:					// (const vec3_t angles, vec3_t forward, vec3_t right, vec3_t up)
+		kinds[1] = kinds[2] = kinds[3] = kinds[4] = ARG_VEC3;
+		break;
+	default:
+		break;
+	}
+}
+
+
+// copy what syscall pointer arguments point to into the observation's data, and point the arguments at the copies
+static void s_copy_pointers(sof2gt_observation_t& obs) {
+	int kinds[SOF2GT_OBSERVE_ARGS];
+	s_arg_kinds(obs.args[0], kinds);
+
+	size_t used = 0;
+	for (int i = 1; i < obs.numargs; i++) {
+		if (kinds[i] == ARG_VALUE)
+			continue;
+
+		const uint8_t* src = (const uint8_t*)obs.args[i];
+		intptr_t next = i + 1 < obs.numargs ? obs.args[i + 1] : 0;
+		size_t space = SOF2GT_OBSERVE_DATA - used;
+		size_t len = 0;
+		bool terminate = false;
+		switch (kinds[i]) {
+		case ARG_STRING:
+			len = src && space ? strnlen((const char*)src, space - 1) : 0;
+			terminate = true;
+			break;
+		case ARG_BUFFER:
+			len = src && space && next > 0 ? strnlen((const char*)src, std::min((size_t)next, space) - 1) : 0;
+			terminate = true;
+			break;
+		case ARG_INTS:
+			len = next > 0 ? (size_t)next * sizeof(int) : 0;
+			break;
+		case ARG_VEC3:
+			len = sizeof(float[3]);
+			break;
+		case ARG_MATRIX:
+			len = sizeof(float[3][3]);
+			break;
+		case ARG_CVAR:
+			len = sizeof(vmCvar_t);
+			break;
+		case ARG_ITEMDEF:
+			len = sizeof(gtItemDef_t);
+			break;
+		case ARG_TRIGGERDEF:
+			len = sizeof(gtTriggerDef_t);
+			break;
+		default:
+			src = nullptr;
+			break;
+		}
+
+		// strings are cut short to fit, anything else is left out
+		if (!src || len + (terminate ? 1 : 0) > space || (terminate && !space)) {
+			obs.args[i] = 0;
+			continue;
+		}
+		uint8_t* dst = obs.data + used;
+		memcpy(dst, src, len);
+		if (terminate)
+			dst[len++] = '\0';
+		obs.args[i] = (intptr_t)dst;
+		// keep copies aligned for the float/int arrays after them
+		used += (len + 7) & ~(size_t)7;
+		if (used > SOF2GT_OBSERVE_DATA)
+			used = SOF2GT_OBSERVE_DATA;
+	}
+}
+
+
+// worker thread: hand queued calls to the observers in order, sleep when there are none. the game thread only wakes
+// it once per top-level vmMain call (observers_wake), so it also checks every 100ms
+static void s_worker() {
+	std::vector<observer_entry_t*> observers;
+	unsigned int version = 0;
+	for (;;) {
+		size_t tail = s_observers.tail.load(std::memory_order_relaxed);
+		if (tail == s_observers.head.load()) {
+			if (s_observers.stop)
+				return;
+			std::unique_lock<std::mutex> lock(s_observers.wakemutex);
+			s_observers.waiting = true;
+			s_observers.wake.wait_for(lock, std::chrono::milliseconds(100), [tail] {
+				return s_observers.stop || tail != s_observers.head.load();
+			});
+			s_observers.waiting = false;
+			continue;
+		}
+
+		// entries are never removed, so the copy stays valid until the next change
+		if (version != s_observers.version.load(std::memory_order_acquire)) {
+			std::lock_guard<std::mutex> lock(s_observers.mutex);
+			version = s_observers.version.load(std::memory_order_relaxed);
+			observers.clear();
+			for (auto& entry : s_observers.observers)
+				observers.push_back(entry.get());
+		}
+
+		const sof2gt_observation_t& obs = s_observers.queue[tail & (OBSERVE_QUEUE_SIZE - 1)];
+		{
+			std::lock_guard<std::mutex> lock(s_observers.delivering);
+			for (observer_entry_t* entry : observers) {
+				sof2gt_observer_t observer = entry->observer.load();
+				if (!observer)
+					continue;
+				uint64_t begin = trace_now();
+				observer(&obs);
+				entry->ns.fetch_add(trace_now() - begin, std::memory_order_relaxed);
+				entry->calls.fetch_add(1, std::memory_order_relaxed);
+			}
+		}
+		// the slot can be reused once this is stored
+		s_observers.tail.store(tail + 1, std::memory_order_release);
+	}
+}
+
+
+// register a plugin's observer (or unregister it if observer is nullptr)
+bool observers_register(const char* name, sof2gt_observer_t observer) {
+	if (!name || !*name)
+		return false;
+
+	sof2gt_observer_t previous;
+	{
+		std::lock_guard<std::mutex> lock(s_observers.mutex);
+
+		observer_entry_t* entry = nullptr;
+		for (auto& e : s_observers.observers) {
+			if (e->name == name)
+				entry = e.get();
+		}
+		if (!entry) {
+			if (!observer)
+				return false;
+			s_observers.observers.push_back(std::make_unique<observer_entry_t>());
+			entry = s_observers.observers.back().get();
+			entry->name = name;
+			s_observers.version++;
+		}
+		previous = entry->observer.exchange(observer);
+		if (!previous != !observer)
+			s_observers.active += observer ? 1 : -1;
+
+		if (s_observers.active && !s_observers.worker.joinable()) {
+			if (s_observers.queue.empty())
+				s_observers.queue.resize(OBSERVE_QUEUE_SIZE);
+			s_observers.stop = false;
+			s_observers.worker = std::thread(s_worker);
+		}
+	}
+
+	// the old observer may be in the middle of a call. wait for it to finish, so it is never called after this
+	// returns (unless this is the observer itself unregistering from its own callback)
+	if (previous && previous != observer && std::this_thread::get_id() != s_observers.worker.get_id())
+		std::lock_guard<std::mutex> wait(s_observers.delivering);
+	return true;
+}
+
+
+// queue a finished call for observers
+void observers_push(int msg, const intptr_t* args, int numargs, intptr_t ret) {
+	if (!s_observers.active)
+		return;
+
+	size_t head = s_observers.head.load(std::memory_order_relaxed);
+	if (head - s_observers.tail.load(std::memory_order_acquire) >= OBSERVE_QUEUE_SIZE) {
+		s_observers.dropped.store(s_observers.dropped.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+		return;
+	}
+
+	sof2gt_observation_t& obs = s_observers.queue[head & (OBSERVE_QUEUE_SIZE - 1)];
+	obs.msg = msg;
+	obs.numargs = std::min(numargs, SOF2GT_OBSERVE_ARGS);
+	memcpy(obs.args, args, obs.numargs * sizeof(args[0]));
+	obs.ret = ret;
+	if (msg == SOF2GT_MSG_SYSCALL_POST)
+		s_copy_pointers(obs);
+
+	// publish the slot. the worker isn't woken for every call, see observers_wake
+	s_observers.head.store(head + 1);
+	s_observers.queued.store(s_observers.queued.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+}
+
+
+// wake the worker if it went to sleep with calls queued
+void observers_wake() {
+	if (!s_observers.active)
+		return;
+	// both are sequentially consistent, so either the worker sees the new head before sleeping or this sees that it
+	// is waiting. anything this misses is picked up by the worker's timed wait
+	if (s_observers.waiting && s_observers.head.load() != s_observers.tail.load(std::memory_order_relaxed)) {
+		std::lock_guard<std::mutex> lock(s_observers.wakemutex);
+		s_observers.wake.notify_one();
+	}
+}
+
+
+// deliver anything still queued and stop the worker
+void observers_stop() {
+	if (!s_observers.worker.joinable())
+		return;
+	{
+		std::lock_guard<std::mutex> lock(s_observers.wakemutex);
+		s_observers.stop = true;
+		s_observers.wake.notify_one();
+	}
+	s_observers.worker.join();
+}
+
+
+// per-observer report. this doesn't wait for an observer call in progress
+std::string observers_report() {
+	std::lock_guard<std::mutex> lock(s_observers.mutex);
+	if (s_observers.observers.empty())
+		return "";
+
+	char line[256];
+	snprintf(line, sizeof(line), "Observers: %llu calls queued, %llu dropped (queue full), %llu waiting\n",
+		(unsigned long long)s_observers.queued, (unsigned long long)s_observers.dropped,
+		(unsigned long long)(s_observers.head - s_observers.tail));
+	std::string ret = line;
+	for (auto& entry : s_observers.observers) {
+		uint64_t calls = entry->calls.load(std::memory_order_relaxed);
+		uint64_t ns = entry->ns.load(std::memory_order_relaxed);
+		snprintf(line, sizeof(line), "%-24s %-20s %10llu calls %10.3f ms %8.3f us/call (worker thread)%s\n", entry->name.c_str(), "(observer)",
+			(unsigned long long)calls, ns / 1000000.0, calls ? ns / 1000.0 / calls : 0.0, entry->observer ? "" : " (unregistered)");
+		ret += line;
+	}
+	return ret;
+}
+
+
+// reset counts. this doesn't wait for an observer call in progress
+void observers_reset_stats() {
+	std::lock_guard<std::mutex> lock(s_observers.mutex);
+	for (auto& entry : s_observers.observers) {
+		entry->calls = 0;
+		entry->ns = 0;
+	}
+	s_observers.queued = 0;
+	s_observers.dropped = 0;
+}
@@ -0,0 +1,238 @@
+/*
+SoF2GT_QMM - Hook gametype dlls/qvms for Soldier of Fortune 2
+Copyright 2025-2026
+https://github.com/thecybermind/sof2gt_qmm/
+3-clause BSD license: https://opensource.org/license/bsd-3-clause
+
+Created By:
+	Kevin Masterson < k.m.masterson@gmail.com >
+
+*/
+
+#define _CRT_SECURE_NO_WARNINGS 1
+
+#include <cstdio>
+#include <cstring>
+#include <map>
+#include <string>
+
+#ifdef __linux__
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+#include "perfcount.h"
+
+// totals for one vmMain cmd
+struct perfcount_total_t {
+	uint64_t calls[PERFCOUNT_SECTIONS];
+	uint64_t values[PERFCOUNT_SECTIONS][PERFCOUNT_MAX_COUNTERS];
+};
+
+static const char* s_section_names[PERFCOUNT_SECTIONS] = { "qvm_exec", "plugins" };
+
+// names of the open counters, in group read order
+static const char* s_names[PERFCOUNT_MAX_COUNTERS];
+static int s_numcounters = 0;
+static bool s_hardware = false;
+static int s_depth[PERFCOUNT_SECTIONS];
+static std::map<intptr_t, perfcount_total_t> s_totals;
+
+#ifdef __linux__
+
+// a counter to try to open
+struct perfcount_def_t {
+	const char* name;
+	uint32_t type;
+	uint64_t config;
+};
+
+#define PERFCOUNT_CACHE(cache) ((cache) | (PERF_COUNT_HW_CACHE_OP_READ << 8) | (PERF_COUNT_HW_CACHE_RESULT_MISS << 16))
+
+static perfcount_def_t s_hw_defs[] = {
+	{ "cycles", PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES },
+	{ "instructions", PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS },
+	{ "branch-misses", PERF_TYPE_HARDWARE, PERF_COUNT_HW_BRANCH_MISSES },
+	{ "L1d-misses", PERF_TYPE_HW_CACHE, PERFCOUNT_CACHE(PERF_COUNT_HW_CACHE_L1D) },
+	{ "L1i-misses", PERF_TYPE_HW_CACHE, PERFCOUNT_CACHE(PERF_COUNT_HW_CACHE_L1I) },
+};
+
+// used when the kernel/VM doesn't expose a PMU
+static perfcount_def_t s_sw_defs[] = {
+	{ "task-clock-ns", PERF_TYPE_SOFTWARE, PERF_COUNT_SW_TASK_CLOCK },
+	{ "context-switches", PERF_TYPE_SOFTWARE, PERF_COUNT_SW_CONTEXT_SWITCHES },
+	{ "page-faults", PERF_TYPE_SOFTWARE, PERF_COUNT_SW_PAGE_FAULTS },
+	{ "cpu-migrations", PERF_TYPE_SOFTWARE, PERF_COUNT_SW_CPU_MIGRATIONS },
+};
+
+static int s_fds[PERFCOUNT_MAX_COUNTERS];
+static int s_leader = -1;
+
+
+// open a counter for the calling thread, in the group led by 'leader' (or as a new group leader if -1)
+static int s_open(const perfcount_def_t& def, int leader) {
+	struct perf_event_attr attr;
+	memset(&attr, 0, sizeof(attr));
+	attr.size = sizeof(attr);
+	attr.type = def.type;
+	attr.config = def.config;
+	attr.disabled = leader == -1 ? 1 : 0;
+	attr.exclude_kernel = 1;
+	attr.exclude_hv = 1;
+	attr.read_format = PERF_FORMAT_GROUP;
+	return (int)syscall(__NR_perf_event_open, &attr, 0, -1, leader, 0);
+}
+
+
+// open a group from a list of counters. the first one must open, the rest are skipped if they can't
+static bool s_open_group(perfcount_def_t* defs, int count) {
+	s_leader = s_open(defs[0], -1);
+	if (s_leader < 0)
+		return false;
+
+	s_fds[0] = s_leader;
+	s_names[0] = defs[0].name;
+	s_numcounters = 1;
+	for (int i = 1; i < count && s_numcounters < PERFCOUNT_MAX_COUNTERS; i++) {
+		int fd = s_open(defs[i], s_leader);
+		if (fd < 0)
+			continue;
+		s_fds[s_numcounters] = fd;
+		s_names[s_numcounters] = defs[i].name;
+		s_numcounters++;
+	}
+	return true;
+}
+
+
+// read all counters in the group
+static bool s_read(uint64_t* values) {
+	uint64_t buf[PERFCOUNT_MAX_COUNTERS + 1];
+	ssize_t len = read(s_leader, buf, sizeof(buf));
+	if (len < (ssize_t)sizeof(uint64_t) || buf[0] != (uint64_t)s_numcounters)
+		return false;
+	memcpy(values, &buf[1], s_numcounters * sizeof(uint64_t));
+	return true;
+}
+
+
+// open counters and start counting
+bool perfcount_start() {
+	perfcount_stop();
+
+	s_hardware = s_open_group(s_hw_defs, (int)(sizeof(s_hw_defs) / sizeof(s_hw_defs[0])));
+	if (!s_hardware && !s_open_group(s_sw_defs, (int)(sizeof(s_sw_defs) / sizeof(s_sw_defs[0]))))
+		return false;
+
+	s_totals.clear();
+	memset(s_depth, 0, sizeof(s_depth));
+	ioctl(s_leader, PERF_EVENT_IOC_RESET, PERF_IOC_FLAG_GROUP);
+	ioctl(s_leader, PERF_EVENT_IOC_ENABLE, PERF_IOC_FLAG_GROUP);
+	return true;
+}
+
+
+// stop counting and close counters
+void perfcount_stop() {
+	if (s_leader < 0)
+		return;
+
+	ioctl(s_leader, PERF_EVENT_IOC_DISABLE, PERF_IOC_FLAG_GROUP);
+	// close members before the leader
+	for (int i = s_numcounters - 1; i >= 0; i--)
+		close(s_fds[i]);
+	s_leader = -1;
+}
+
+
+// is counting active
+bool perfcount_active() {
+	return s_leader >= 0;
+}
+
+#else
+
+// perf_event_open is Linux only
+static bool s_read(uint64_t*) {
+	return false;
+}
+
+
+bool perfcount_start() {
+	return false;
+}
+
+
+void perfcount_stop() {
+}
+
+
+bool perfcount_active() {
+	return false;
+}
+
+#endif // __linux__
+
+
+// start of a section
+void perfcount_begin(int section, perfcount_sample_t& sample) {
+	sample.active = false;
+	if (!perfcount_active())
+		return;
+
+	// only the outermost section is counted, or nested qvm_exec calls would be counted twice
+	if (s_depth[section]++)
+		return;
+	sample.active = s_read(sample.values);
+}
+
+
+// end of a section, add to totals for 'cmd'
+void perfcount_end(int section, intptr_t cmd, perfcount_sample_t& sample) {
+	if (!perfcount_active())
+		return;
+	if (s_depth[section] > 0)
+		s_depth[section]--;
+
+	uint64_t values[PERFCOUNT_MAX_COUNTERS];
+	if (!sample.active || !s_read(values))
+		return;
+
+	perfcount_total_t& total = s_totals[cmd];
+	total.calls[section]++;
+	for (int i = 0; i < s_numcounters; i++)
+		total.values[section][i] += values[i] - sample.values[i];
+}
+
+
+// per-cmd totals
+std::string perfcount_report() {
+	if (s_totals.empty())
+		return "No samples\n";
+
+	std::string ret = s_hardware ? "Hardware counters, averages per call:\n" : "Software counters (no PMU available), averages per call:\n";
+	char buf[128];
+	for (auto& entry : s_totals) {
+		perfcount_total_t& total = entry.second;
+		for (int section = 0; section < PERFCOUNT_SECTIONS; section++) {
+			uint64_t calls = total.calls[section];
+			if (!calls)
+				continue;
+			snprintf(buf, sizeof(buf), "cmd %d %s: %llu calls", (int)entry.first, s_section_names[section], (unsigned long long)calls);
+			ret += buf;
+			for (int i = 0; i < s_numcounters; i++) {
+				snprintf(buf, sizeof(buf), ", %s %.1f", s_names[i], (double)total.values[section][i] / calls);
+				ret += buf;
+			}
+			// instructions per cycle
+			if (s_hardware && s_numcounters >= 2 && !strcmp(s_names[1], "instructions") && total.values[section][0]) {
+				snprintf(buf, sizeof(buf), ", IPC %.2f", (double)total.values[section][1] / total.values[section][0]);
+				ret += buf;
+			}
+			ret += "\n";
+		}
+	}
+	return ret;
+}
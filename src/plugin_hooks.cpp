@@ -0,0 +1,162 @@
+/*
+SoF2GT_QMM - Hook gametype dlls/qvms for Soldier of Fortune 2
+Copyright 2025-2026
+https://github.com/thecybermind/sof2gt_qmm/
+3-clause BSD license: https://opensource.org/license/bsd-3-clause
+
+Created By:
+	Kevin Masterson < k.m.masterson@gmail.com >
+
+*/
+
+#define _CRT_SECURE_NO_WARNINGS 1
+
+#include <qmmapi.h>
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#include "main.h"
+#include "trace.h"
+#include "plugin_hooks.h"
+
+// counts for one plugin and message
+struct plugin_stat_t {
+	uint64_t calls;
+	uint64_t ns;
+	uint64_t overrides;
+	uint64_t supercedes;
+};
+
+// a registered plugin (entries stay after unregistering so their counts can still be reported)
+struct plugin_entry_t {
+	std::string name;
+	sof2gt_handler_t handler;
+	plugin_stat_t stats[SOF2GT_MSG_COUNT];
+};
+
+static const char* s_messages[SOF2GT_MSG_COUNT] = { "SOF2GT_vmMain", "SOF2GT_vmMain_Post", "SOF2GT_syscall", "SOF2GT_syscall_Post" };
+
+// entry 0 counts the QMM broadcast to plugins without a registered handler (all of them together)
+static std::vector<plugin_entry_t> s_plugins = { { "(broadcast)", nullptr, {} } };
+static bool s_timing = false;
+
+
+// count a handler call from the result it set
+static void s_count(plugin_stat_t& stat, uint64_t begin) {
+	stat.calls++;
+	if (begin)
+		stat.ns += trace_now() - begin;
+	if (gt_pluginvars.gt_result == QMM_OVERRIDE)
+		stat.overrides++;
+	else if (gt_pluginvars.gt_result == QMM_SUPERCEDE)
+		stat.supercedes++;
+}
+
+
+// register a plugin's handler (or unregister it if handler is nullptr)
+bool plugin_hooks_register(const char* name, sof2gt_handler_t handler) {
+	if (!name || !*name)
+		return false;
+
+	for (size_t i = 1; i < s_plugins.size(); i++) {
+		if (s_plugins[i].name == name) {
+			s_plugins[i].handler = handler;
+			return true;
+		}
+	}
+	if (!handler)
+		return false;
+
+	s_plugins.push_back({ name, handler, {} });
+	return true;
+}
+
+
+// measure time spent in each handler
+void plugin_hooks_timing(bool enable) {
+	s_timing = enable;
+}
+
+
+// send a hook message to registered handlers and then to all other plugins. each handler (and the broadcast) starts
+// from QMM_UNUSED so its own result can be counted, and the highest result is kept, like QMM does for plugins
+void plugin_hooks_run(int msg, intptr_t* args, int numargs) {
+	pluginres_t result = gt_pluginvars.gt_result;
+
+	// handlers may register other handlers, so don't hold on to entries across calls
+	for (size_t i = 1; i < s_plugins.size(); i++) {
+		sof2gt_handler_t handler = s_plugins[i].handler;
+		if (!handler)
+			continue;
+		gt_pluginvars.gt_result = QMM_UNUSED;
+		uint64_t begin = s_timing ? trace_now() : 0;
+		handler(msg, args, numargs);
+		s_count(s_plugins[i].stats[msg], begin);
+		result = std::max(result, gt_pluginvars.gt_result);
+	}
+
+	// QMM can only broadcast to all plugins at once, so the ones without a handler are timed together
+	gt_pluginvars.gt_result = QMM_UNUSED;
+	uint64_t begin = s_timing ? trace_now() : 0;
+	QMM_PLUGIN_BROADCAST(PLID, s_messages[msg], args, numargs);
+	s_count(s_plugins[0].stats[msg], begin);
+	gt_pluginvars.gt_result = std::max(result, gt_pluginvars.gt_result);
+}
+
+
+// per-plugin report
+std::string plugin_hooks_report(const char* sort) {
+	// one row per plugin and message that was called
+	struct row_t {
+		const plugin_entry_t* plugin;
+		int msg;
+		const plugin_stat_t* stat;
+	};
+	std::vector<row_t> rows;
+	for (const plugin_entry_t& plugin : s_plugins) {
+		for (int msg = 0; msg < SOF2GT_MSG_COUNT; msg++) {
+			if (plugin.stats[msg].calls)
+				rows.push_back({ &plugin, msg, &plugin.stats[msg] });
+		}
+	}
+	if (rows.empty())
+		return "No plugin hook calls\n";
+
+	std::string key = sort && *sort ? sort : "time";
+	std::stable_sort(rows.begin(), rows.end(), [&key](const row_t& a, const row_t& b) {
+		if (key == "name")
+			return a.plugin->name < b.plugin->name;
+		if (key == "calls")
+			return a.stat->calls > b.stat->calls;
+		if (key == "avg")
+			return (double)a.stat->ns / a.stat->calls > (double)b.stat->ns / b.stat->calls;
+		if (key == "override")
+			return a.stat->overrides > b.stat->overrides;
+		if (key == "supercede")
+			return a.stat->supercedes > b.stat->supercedes;
+		return a.stat->ns > b.stat->ns;
+	});
+
+	std::string ret;
+	if (!s_timing)
+		ret = "Timing is off (sof2gt_pluginstats 0), only calls and results are counted\n";
+	char line[256];
+	for (const row_t& row : rows) {
+		snprintf(line, sizeof(line), "%-24s %-20s %10llu calls %10.3f ms %8.3f us/call %8llu override %8llu supercede\n",
+			row.plugin->name.c_str(), s_messages[row.msg], (unsigned long long)row.stat->calls, row.stat->ns / 1000000.0,
+			row.stat->ns / 1000.0 / row.stat->calls, (unsigned long long)row.stat->overrides, (unsigned long long)row.stat->supercedes);
+		ret += line;
+	}
+	return ret;
+}
+
+
+// reset counts
+void plugin_hooks_reset_stats() {
+	for (plugin_entry_t& plugin : s_plugins)
+		memset(plugin.stats, 0, sizeof(plugin.stats));
+}
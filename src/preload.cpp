@@ -0,0 +1,111 @@
+/*
+SoF2GT_QMM - Hook gametype dlls/qvms for Soldier of Fortune 2
+Copyright 2025-2026
+https://github.com/thecybermind/sof2gt_qmm/
+3-clause BSD license: https://opensource.org/license/bsd-3-clause
+
+Created By:
+	Kevin Masterson < k.m.masterson@gmail.com >
+
+*/
+
+#define _CRT_SECURE_NO_WARNINGS 1
+
+#include <qmmapi.h>
+
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "game.h"
+#include "util.h"
+#include "preload.h"
+
+// the standby VM. the worker thread only touches qvm/loaded/log, and the game thread only reads them after join()
+struct preload_t {
+	std::thread thread;
+	std::string gametype;
+	int flags = 0;
+	qvm_alloc_t* allocator = nullptr;
+
+	qvm_t qvm = {};
+	bool loaded = false;
+	std::vector<log_msg_t> log;
+
+	// wait for the worker and write out anything it logged
+	void join() {
+		if (thread.joinable())
+			thread.join();
+		log_c_flush(log);
+	}
+
+	// make sure the worker is done before the plugin goes away
+	~preload_t() {
+		if (thread.joinable())
+			thread.join();
+		qvm_unload(&qvm);
+	}
+};
+static preload_t s_preload;
+
+
+// keep messages from qvm_load on the worker thread for join()
+static void s_preload_log(qvm_t* qvm, int severity, const char* msg) {
+	((std::vector<log_msg_t>*)qvm->userdata)->push_back({ severity, msg });
+}
+
+
+// start loading a gametype QVM on a worker thread (replaces any other preload)
+void preload_start(const char* gametype, std::vector<uint8_t>&& filemem, vmsyscall_t vmsyscall, int flags, qvm_alloc_t* allocator) {
+	preload_cancel();
+
+	s_preload.gametype = gametype;
+	s_preload.flags = flags;
+	s_preload.allocator = allocator;
+	s_preload.qvm.userdata = &s_preload.log;
+	s_preload.qvm.log = s_preload_log;
+
+	QMM_WRITEQMMLOG(PLID, QMM_VARARGS(PLID, "preload_start(\"%s\"): Loading QVM in the background\n", gametype), QMMLOG_DEBUG);
+
+	s_preload.thread = std::thread([filemem = std::move(filemem), vmsyscall, flags, allocator]() {
+		s_preload.loaded = qvm_load(&s_preload.qvm, filemem.data(), filemem.size(), vmsyscall, flags, allocator) != 0;
+	});
+}
+
+
+// wait for a preload of the given gametype with the same load options to finish and move it into qvm
+bool preload_take(const char* gametype, int flags, qvm_alloc_t* allocator, qvm_t* qvm) {
+	if (!s_preload.thread.joinable() && !s_preload.loaded)
+		return false;
+
+	s_preload.join();
+
+	if (!s_preload.loaded || s_preload.gametype != gametype || s_preload.flags != flags || s_preload.allocator != allocator) {
+		QMM_WRITEQMMLOG(PLID, QMM_VARARGS(PLID, "preload_take(\"%s\"): Discarding preload of '%s'\n", gametype, s_preload.gametype.c_str()), QMMLOG_DEBUG);
+		preload_cancel();
+		return false;
+	}
+
+	*qvm = s_preload.qvm;
+	qvm->userdata = nullptr;
+	qvm->log = nullptr;
+	s_preload.qvm = {};
+	s_preload.loaded = false;
+	s_preload.gametype.clear();
+	return true;
+}
+
+
+// check if the given gametype is being (or has been) preloaded
+bool preload_pending(const char* gametype) {
+	return (s_preload.thread.joinable() || s_preload.loaded) && s_preload.gametype == gametype;
+}
+
+
+// wait for and discard any preload
+void preload_cancel() {
+	s_preload.join();
+	qvm_unload(&s_preload.qvm);
+	s_preload.loaded = false;
+	s_preload.gametype.clear();
+}
@@ -12,9 +12,24 @@ Created By:
 #define QMM_LOGGING
 
 #include <stdint.h>
+#include <stdarg.h>
+#include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <time.h>
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+#else
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <signal.h>
+#include <errno.h>
+#endif
 #include "qvm.h"
+#include "qvm_mem.h"
 
 #ifdef QMM_LOGGING
 void log_c(int severity, const char* tag, const char* fmt, ...);
@@ -24,99 +39,67 @@ enum { QMM_LOG_TRACE, QMM_LOG_DEBUG, QMM_LOG_INFO, QMM_LOG_NOTICE, QMM_LOG_WARNI
 #endif
 
 
-int qvm_load(qvm_t* qvm, const uint8_t* filemem, size_t filesize, vmsyscall_t vmsyscall, int verify_data, qvm_alloc_t* allocator) {
-    if (!qvm || qvm->memory || !filemem || !filesize || !vmsyscall)
-        return 0;
-
-    if (filesize < sizeof(qvmheader_t)) {
-        log_c(QMM_LOG_ERROR, "SOF2GT_QMM", "qvm_load(): Invalid QVM file: too small for header\n");
-        goto fail;
-    }
-
-    qvm->filesize = filesize;
-    qvm->vmsyscall = vmsyscall;
-    qvm->verify_data = verify_data;
-    // if null, use default allocator (uses malloc/free)
-    qvm->allocator = allocator ? allocator : &qvm_allocator_default;
+// log a message through the VM's log function, or log_c if it doesn't have one
+static void qvm_log(qvm_t* qvm, int severity, const char* fmt, ...) {
+    char buf[1024];
+    va_list argptr;
+    va_start(argptr, fmt);
+    vsnprintf(buf, sizeof(buf), fmt, argptr);
+    va_end(argptr);
 
-    qvmheader_t header;
+    if (qvm->log)
+        qvm->log(qvm, severity, buf);
+    else
+        log_c(severity, "SOF2GT_QMM", "%s", buf);
+}
 
-    // grab a copy of the header
-    memcpy(&header, filemem, sizeof(qvmheader_t));
 
-    // check header fields for oddities
-    if (header.magic != QVM_MAGIC) {
-        log_c(QMM_LOG_ERROR, "SOF2GT_QMM", "qvm_load(): Invalid QVM file: incorrect magic number\n");
-        goto fail;
-    }
-    if (filesize < sizeof(header) + header.codelen + header.datalen + header.litlen) {
-        log_c(QMM_LOG_ERROR, "SOF2GT_QMM", "qvm_load(): Invalid QVM file: filesize too small for segment sizes\n");
-        goto fail;
-    }
-    if (header.codeoffset < sizeof(header) ||
-        header.codeoffset > filesize ||
-        header.codeoffset + header.codelen > filesize) {
-        log_c(QMM_LOG_ERROR, "SOF2GT_QMM", "qvm_load(): Invalid QVM file: code offset/length has invalid value\n");
-        goto fail;
-    }
-    if (header.dataoffset < sizeof(header) ||
-        header.dataoffset > filesize ||
-        header.dataoffset + header.datalen + header.litlen > filesize) {
-        log_c(QMM_LOG_ERROR, "SOF2GT_QMM", "qvm_load(): Invalid QVM file: data offset/length has invalid value\n");
-        goto fail;
-    }
-    if (header.instructioncount < header.codelen / 5 || // assume each op in the code segment is 5 bytes for a minimum
-        header.instructioncount > header.codelen) {
-        log_c(QMM_LOG_ERROR, "SOF2GT_QMM", "qvm_load(): Invalid QVM file: numops has invalid value\n");
-        goto fail;
+// header at the start of a shared code image (QVM_LOAD_SHARE_CODE). the image itself starts at QVM_SHARED_IMAGE_OFFSET
+typedef struct qvm_sharedheader_s {
+    uint32_t ready;                 // QVM_SHARED_READY once the creating process has finished writing the image
+    uint32_t filesize;              // .qvm file size
+    uint32_t instructioncount;      // number of instructions, from qvm header
+    uint32_t codecount;             // number of instructions in code segment
+    uint32_t codeseglen;            // size of code segment
+    uint32_t codemapsize;           // number of codemap entries
+    uint64_t hash;                  // hash of .qvm file and load options (see qvm_share_hash)
+    uint32_t creator;               // pid of the creating process, set as soon as the object is mapped
+} qvm_sharedheader_t;
+
+#define QVM_SHARED_READY            0x31534D51  // "QMS1"
+#define QVM_SHARED_IMAGE_OFFSET     64
+// bump when the decoded image layout or optimizer output changes
+#define QVM_SHARED_VERSION          2
+
+
+// decode instructions from the file into malloc'd code/origindex/codemap arrays. sets qvm->codecount, codeseglen and codemapsize
+static int qvm_decode(qvm_t* qvm, const qvmheader_t* header, const uint8_t* filemem, int flags, qvmop_t** pcode, int** porigindex, int** pcodemap) {
+    qvmop_t* code = (qvmop_t*)malloc(header->instructioncount * sizeof(qvmop_t));
+    int* origindex = (int*)malloc(header->instructioncount * sizeof(int));
+    // codemap is rounded up to the next power of 2 so function pointers/jump table entries can be masked
+    size_t codemapsize = header->instructioncount;
+    QVM_NEXT_POW_2(codemapsize);
+    int* codemap = (int*)malloc(codemapsize * sizeof(int));
+
+    // hand the arrays to the caller right away, it frees them
+    *pcode = code;
+    *porigindex = origindex;
+    *pcodemap = codemap;
+
+    if (!code || !origindex || !codemap) {
+        qvm_log(qvm, QMM_LOG_ERROR, "qvm_load(): Unable to allocate memory for %d instructions\n", header->instructioncount);
+        return 0;
     }
 
-    // store numops in qvm object
-    qvm->instructioncount = header.instructioncount;
-
-    // each opcode is 8 bytes long, calculate total size of instructions
-    size_t codeseglen = header.instructioncount * sizeof(qvmop_t);
-    // the q3 engine rounds the data segment size up to the next power of 2 for masking data accesses,
-    // but we can also do that with code segment too. the remainder of the code segment will be filled
-    // out with byte 0 (QVM_OP_UNDEF) which will immediately fail if the instruction pointer ends up
-    // in that space
-    QVM_NEXT_POW_2(codeseglen);
-    qvm->codeseglen = codeseglen;
-
-    // data segment is all the data segment lengths combined (plus optional extra stack space)
-    size_t dataseglen = header.datalen + header.litlen + header.bsslen + QVM_EXTRA_PROGRAMSTACK_SIZE;
-    // save actual dataseglen before rounding up
-    size_t orig_dataseglen = dataseglen;
-    // round data segment size up to next power of 2 for masking data accesses
-    QVM_NEXT_POW_2(dataseglen);
-    qvm->dataseglen = dataseglen;
-
-    // allow stack to use any extra space from rounding up
-    qvm->stacksize = QVM_PROGRAMSTACK_SIZE + (dataseglen - orig_dataseglen) + QVM_EXTRA_PROGRAMSTACK_SIZE;
-
-    // allocate vm memory
-    qvm->memorysize = qvm->codeseglen + qvm->dataseglen;
-    qvm->memory = (uint8_t*)qvm->allocator->alloc(qvm->memorysize, qvm->allocator->ctx);
-
-    // zero out memory
-    memset(qvm->memory, 0, qvm->memorysize);
-
-    // set segment pointers
-    // | CODE | DATA | <- program stack starts here and grows down
-    // program stack is for arguments and local variables
-    qvm->codesegment = (qvmop_t*)qvm->memory;
-    qvm->datasegment = qvm->memory + qvm->codeseglen;
-    qvm->stackptr = (int*)(qvm->datasegment + qvm->dataseglen);
-
-    // start loading instructions from the file's code offset into VM memory block
-    const uint8_t* codeoffset = filemem + header.codeoffset;
+    // start loading instructions from the file's code offset
+    const uint8_t* codeoffset = filemem + header->codeoffset;
 
     // loop through each op
-    for (uint32_t i = 0; i < header.instructioncount; ++i) {
+    for (uint32_t i = 0; i < header->instructioncount; ++i) {
         // make sure we're not reading past the end of the codesegment in the file
-        if (codeoffset >= filemem + header.codeoffset + header.codelen) {
-            log_c(QMM_LOG_ERROR, "SOF2GT_QMM", "qvm_load(): Invalid QVM file: can't read instruction at %d, reached end of file\n", i);
-            goto fail;
+        if (codeoffset >= filemem + header->codeoffset + header->codelen) {
+            qvm_log(qvm, QMM_LOG_ERROR, "qvm_load(): Invalid QVM file: can't read instruction at %d, reached end of file\n", i);
+            return 0;
         }
 
         // get the opcode
@@ -124,12 +107,14 @@ int qvm_load(qvm_t* qvm, const uint8_t* filemem, size_t filesize, vmsyscall_t vm
 
         // make sure opcode is valid
         if (opcode < 0 || opcode >= QVM_OP_NUM_OPS) {
-            log_c(QMM_LOG_ERROR, "SOF2GT_QMM", "qvm_load(): Invalid QVM file: invalid opcode value at %d: %d\n", i, opcode);
-            goto fail;
+            qvm_log(qvm, QMM_LOG_ERROR, "qvm_load(): Invalid QVM file: invalid opcode value at %d: %d\n", i, opcode);
+            return 0;
         }
 
         // write opcode (to qvmop_t)
-        qvm->codesegment[i].op = opcode;
+        code[i].op = opcode;
+        origindex[i] = (int)i;
+        codemap[i] = (int)i;
 
         // move to next byte
         codeoffset++;
@@ -158,86 +143,642 @@ int qvm_load(qvm_t* qvm, const uint8_t* filemem, size_t filesize, vmsyscall_t vm
         case QVM_OP_BLOCK_COPY:
             // all the above instructions have 4-byte params
             // make sure we're not reading an int past the end of the codesegment in the file
-            if (codeoffset + 3 >= filemem + header.codeoffset + header.codelen) {
-                log_c(QMM_LOG_ERROR, "SOF2GT_QMM", "qvm_load(): Invalid QVM file: can't read instruction %d, reached end of file\n", i);
-                goto fail;
+            if (codeoffset + 3 >= filemem + header->codeoffset + header->codelen) {
+                qvm_log(qvm, QMM_LOG_ERROR, "qvm_load(): Invalid QVM file: can't read instruction %d, reached end of file\n", i);
+                return 0;
             }
-            qvm->codesegment[i].param = *(int*)codeoffset;
+            code[i].param = *(int*)codeoffset;
             codeoffset += 4;
             break;
 
         case QVM_OP_ARG:
             // this instruction has a 1-byte param
             // make sure we're not reading past the end of the codesegment in the file
-            if (codeoffset >= filemem + header.codeoffset + header.codelen) {
-                log_c(QMM_LOG_ERROR, "SOF2GT_QMM", "qvm_load(): Invalid QVM file: can't read instruction %d, reached end of file\n", i);
-                goto fail;
+            if (codeoffset >= filemem + header->codeoffset + header->codelen) {
+                qvm_log(qvm, QMM_LOG_ERROR, "qvm_load(): Invalid QVM file: can't read instruction %d, reached end of file\n", i);
+                return 0;
             }
-            qvm->codesegment[i].param = (int)*codeoffset;
+            code[i].param = (int)*codeoffset;
             codeoffset++;
             break;
 
         default:
             // remaining instructions have no param
-            qvm->codesegment[i].param = 0;
+            code[i].param = 0;
             break;
         }
     }
 
+    size_t codecount = header->instructioncount;
+    if (flags & QVM_LOAD_OPTIMIZE) {
+        size_t optcount = qvm_optimize(pcode, porigindex, codemap, codecount, filemem + header->dataoffset, header->datalen + header->litlen, flags);
+        if (optcount) {
+            qvm_log(qvm, QMM_LOG_INFO, "qvm_load(): Optimized %d instructions into %d\n", (int)codecount, (int)optcount);
+            codecount = optcount;
+            code = *pcode;
+        }
+        else {
+            qvm_log(qvm, QMM_LOG_WARNING, "qvm_load(): Optimization failed, using original instructions\n");
+        }
+    }
+    qvm->codecount = codecount;
+    qvm->codemapsize = codemapsize;
+    // out-of-range function pointers land on the QVM_OP_UNDEF padding
+    for (size_t i = header->instructioncount; i < codemapsize; i++)
+        codemap[i] = (int)codecount;
+
+    // select specialized handlers for common QVM_OP_BLOCK_COPY sizes
+    for (size_t i = 0; i < codecount; i++) {
+        if (code[i].op != QVM_OP_BLOCK_COPY)
+            continue;
+        switch (code[i].param) {
+        case 12: code[i].op = QVM_OP_BLOCK_COPY12; break;
+        case 16: code[i].op = QVM_OP_BLOCK_COPY16; break;
+        case 32: code[i].op = QVM_OP_BLOCK_COPY32; break;
+        case 64: code[i].op = QVM_OP_BLOCK_COPY64; break;
+        default: break;
+        }
+    }
+
+    // each opcode is 8 bytes long, calculate total size of instructions (+1 so there is always at least 1
+    // QVM_OP_UNDEF after the last instruction)
+    size_t codeseglen = (codecount + 1) * sizeof(qvmop_t);
+    // the q3 engine rounds the data segment size up to the next power of 2 for masking data accesses,
+    // but we can also do that with code segment too. the remainder of the code segment will be filled
+    // out with byte 0 (QVM_OP_UNDEF) which will immediately fail if the instruction pointer ends up
+    // in that space
+    QVM_NEXT_POW_2(codeseglen);
+    qvm->codeseglen = codeseglen;
+
+    return 1;
+}
+
+
+// size of the code image: | CODE | CODEMAP | ORIGINDEX |
+// origindex has an entry for every code segment slot, including the QVM_OP_UNDEF padding
+static size_t qvm_codeimage_size(qvm_t* qvm) {
+    return qvm->codeseglen + qvm->codemapsize * sizeof(int) + qvm->codeseglen / sizeof(qvmop_t) * sizeof(int);
+}
+
+
+// point the code segment and instruction maps into a code image
+static void qvm_set_codeimage(qvm_t* qvm, uint8_t* image) {
+    qvm->codesegment = (qvmop_t*)image;
+    qvm->codemap = (int*)(image + qvm->codeseglen);
+    qvm->origindex = qvm->codemap + qvm->codemapsize;
+}
+
+
+// copy decoded instructions and maps into a zeroed code image
+static void qvm_write_codeimage(qvm_t* qvm, uint8_t* image, const qvmop_t* code, const int* origindex, const int* codemap) {
+    qvm_set_codeimage(qvm, image);
+    memcpy(qvm->codesegment, code, qvm->codecount * sizeof(qvmop_t));
+    memcpy(qvm->codemap, codemap, qvm->codemapsize * sizeof(int));
+    memcpy(qvm->origindex, origindex, qvm->codecount * sizeof(int));
+    for (size_t i = qvm->codecount; i < qvm->codeseglen / sizeof(qvmop_t); i++)
+        qvm->origindex[i] = (int)qvm->instructioncount;
+}
+
+
+// hash the .qvm file along with everything else that changes the decoded image (FNV-1a)
+static uint64_t qvm_share_hash(const uint8_t* filemem, size_t filesize, int flags) {
+    uint64_t hash = 0xCBF29CE484222325ULL;
+    for (size_t i = 0; i < filesize; i++) {
+        hash ^= filemem[i];
+        hash *= 0x100000001B3ULL;
+    }
+    int extra[] = { QVM_SHARED_VERSION, flags & (QVM_LOAD_OPTIMIZE | QVM_LOAD_INLINE), QVM_INLINE_MAX_INSTRUCTIONS, QVM_INLINE_MAX_FRAMESIZE, (int)sizeof(qvmop_t) };
+    for (size_t i = 0; i < sizeof(extra); i++) {
+        hash ^= ((const uint8_t*)extra)[i];
+        hash *= 0x100000001B3ULL;
+    }
+    return hash;
+}
+
+
+static void qvm_share_sleep(void) {
+#ifdef _WIN32
+    Sleep(1);
+#else
+    usleep(1000);
+#endif
+}
+
+
+#ifndef _WIN32
+// remove a shared code image that will never be finished, so qvm_share_create can make a new one. if another process
+// did the same and already created a new image, that one is removed too; both then just use private memory
+static void qvm_share_remove_stale(qvm_t* qvm, const char* name) {
+    qvm_log(qvm, QMM_LOG_WARNING, "qvm_load(): Removing stale shared code image %s\n", name);
+    shm_unlink(name);
+}
+#endif
+
+
+// map a code image published by another process. returns pointer to the image, or NULL if it doesn't exist or isn't
+// usable. an unfinished image whose creator has died (or that isn't finished within QVM_SHARED_WAIT_MS) is removed
+static uint8_t* qvm_share_attach(qvm_t* qvm, const char* name, uint64_t hash) {
+    void* view = NULL;
+    size_t size = 0;
+    int waited = 0;
+#ifdef _WIN32
+    HANDLE handle = OpenFileMappingA(FILE_MAP_READ, FALSE, name);
+    if (!handle)
+        return NULL;
+    view = MapViewOfFile(handle, FILE_MAP_READ, 0, 0, 0);
+    MEMORY_BASIC_INFORMATION info;
+    if (!view || !VirtualQuery(view, &info, sizeof(info))) {
+        if (view)
+            UnmapViewOfFile(view);
+        CloseHandle(handle);
+        return NULL;
+    }
+    size = info.RegionSize;
+#else
+    int fd = shm_open(name, O_RDONLY, 0);
+    if (fd < 0)
+        return NULL;
+    // the creator sizes the object right after creating it
+    struct stat st;
+    for (;;) {
+        if (fstat(fd, &st) < 0) {
+            qvm_log(qvm, QMM_LOG_WARNING, "qvm_load(): Ignoring shared code image %s: fstat failed\n", name);
+            close(fd);
+            return NULL;
+        }
+        if ((size_t)st.st_size >= QVM_SHARED_IMAGE_OFFSET || waited >= QVM_SHARED_WAIT_MS)
+            break;
+        qvm_share_sleep();
+        waited++;
+    }
+    // only trust images created by this user that nobody else can write to
+    if (st.st_uid != geteuid() || (st.st_mode & (S_IWGRP | S_IWOTH))) {
+        qvm_log(qvm, QMM_LOG_WARNING, "qvm_load(): Ignoring shared code image %s: bad owner\n", name);
+        close(fd);
+        return NULL;
+    }
+    // never sized: the creator died right after creating it
+    if ((size_t)st.st_size < QVM_SHARED_IMAGE_OFFSET) {
+        close(fd);
+        qvm_share_remove_stale(qvm, name);
+        return NULL;
+    }
+    size = (size_t)st.st_size;
+    view = mmap(NULL, size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (view == MAP_FAILED)
+        return NULL;
+#endif
+
+    // wait for the creator to finish writing the image
+    const qvm_sharedheader_t* shared = (const qvm_sharedheader_t*)view;
+    uint32_t ready;
+    int stale = 0;
+    for (;;) {
+#ifdef _WIN32
+        ready = *(volatile const uint32_t*)&shared->ready;
+        MemoryBarrier();
+#else
+        ready = __atomic_load_n(&shared->ready, __ATOMIC_ACQUIRE);
+#endif
+        if (ready == QVM_SHARED_READY)
+            break;
+        // an image that is never finished was left behind by a process that died while writing it. on Windows the
+        // object goes away with the last handle to it, so this can only happen here
+#ifndef _WIN32
+        uint32_t creator = __atomic_load_n(&shared->creator, __ATOMIC_RELAXED);
+        if (waited >= QVM_SHARED_WAIT_MS || (creator && kill((pid_t)creator, 0) < 0 && errno == ESRCH)) {
+            stale = 1;
+            break;
+        }
+#else
+        if (waited >= QVM_SHARED_WAIT_MS)
+            break;
+#endif
+        qvm_share_sleep();
+        waited++;
+    }
+
+#ifndef _WIN32
+    if (stale) {
+        munmap(view, size);
+        qvm_share_remove_stale(qvm, name);
+        return NULL;
+    }
+#else
+    (void)stale;
+#endif
+
+    // make sure the image matches this file and fits inside the mapping
+    qvm->codecount = shared->codecount;
+    qvm->codeseglen = shared->codeseglen;
+    qvm->codemapsize = shared->codemapsize;
+    if (ready != QVM_SHARED_READY ||
+        shared->hash != hash ||
+        shared->filesize != qvm->filesize ||
+        shared->instructioncount != qvm->instructioncount ||
+        !qvm->codeseglen || (qvm->codeseglen & (qvm->codeseglen - 1)) || qvm->codeseglen < (qvm->codecount + 1) * sizeof(qvmop_t) ||
+        !qvm->codemapsize || (qvm->codemapsize & (qvm->codemapsize - 1)) || qvm->codemapsize < qvm->instructioncount ||
+        QVM_SHARED_IMAGE_OFFSET + qvm_codeimage_size(qvm) > size) {
+        qvm_log(qvm, QMM_LOG_WARNING, "qvm_load(): Ignoring shared code image %s: %s\n", name, ready == QVM_SHARED_READY ? "mismatched image" : "timed out waiting for image");
+#ifdef _WIN32
+        UnmapViewOfFile(view);
+        CloseHandle(handle);
+#else
+        munmap(view, size);
+#endif
+        return NULL;
+    }
+
+    qvm->sharedimage = view;
+    qvm->sharedimagesize = size;
+#ifdef _WIN32
+    qvm->sharedhandle = handle;
+#endif
+    return (uint8_t*)view + QVM_SHARED_IMAGE_OFFSET;
+}
+
+
+// create a new shared memory object for the code image. returns pointer to the (zeroed) image, or NULL if it already
+// exists (another process got there first) or can't be created
+static uint8_t* qvm_share_create(qvm_t* qvm, const char* name) {
+    size_t size = QVM_SHARED_IMAGE_OFFSET + qvm_codeimage_size(qvm);
+    void* view = NULL;
+#ifdef _WIN32
+    HANDLE handle = CreateFileMappingA(INVALID_HANDLE_VALUE, NULL, PAGE_READWRITE, (DWORD)((uint64_t)size >> 32), (DWORD)size, name);
+    if (!handle)
+        return NULL;
+    if (GetLastError() == ERROR_ALREADY_EXISTS) {
+        CloseHandle(handle);
+        return NULL;
+    }
+    view = MapViewOfFile(handle, FILE_MAP_WRITE, 0, 0, size);
+    if (!view) {
+        CloseHandle(handle);
+        return NULL;
+    }
+    qvm->sharedhandle = handle;
+#else
+    int fd = shm_open(name, O_RDWR | O_CREAT | O_EXCL, 0600);
+    if (fd < 0)
+        return NULL;
+    if (ftruncate(fd, (off_t)size) < 0 ||
+        (view = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0)) == MAP_FAILED) {
+        close(fd);
+        shm_unlink(name);
+        return NULL;
+    }
+    close(fd);
+    // let other processes tell if this one dies before publishing the image
+    __atomic_store_n(&((qvm_sharedheader_t*)view)->creator, (uint32_t)getpid(), __ATOMIC_RELAXED);
+#endif
+    qvm->sharedimage = view;
+    qvm->sharedimagesize = size;
+    return (uint8_t*)view + QVM_SHARED_IMAGE_OFFSET;
+}
+
+
+// fill in the header of a newly written code image, mark it ready for other processes, and make it read-only
+static void qvm_share_publish(qvm_t* qvm, uint64_t hash) {
+    qvm_sharedheader_t* shared = (qvm_sharedheader_t*)qvm->sharedimage;
+    shared->filesize = (uint32_t)qvm->filesize;
+    shared->instructioncount = (uint32_t)qvm->instructioncount;
+    shared->codecount = (uint32_t)qvm->codecount;
+    shared->codeseglen = (uint32_t)qvm->codeseglen;
+    shared->codemapsize = (uint32_t)qvm->codemapsize;
+    shared->hash = hash;
+#ifdef _WIN32
+    InterlockedExchange((volatile LONG*)&shared->ready, QVM_SHARED_READY);
+    DWORD oldprotect;
+    VirtualProtect(qvm->sharedimage, qvm->sharedimagesize, PAGE_READONLY, &oldprotect);
+#else
+    __atomic_store_n(&shared->ready, QVM_SHARED_READY, __ATOMIC_RELEASE);
+    mprotect(qvm->sharedimage, qvm->sharedimagesize, PROT_READ);
+#endif
+}
+
+
+// unmap the shared code image
+static void qvm_share_close(qvm_t* qvm) {
+    if (!qvm->sharedimage)
+        return;
+#ifdef _WIN32
+    UnmapViewOfFile(qvm->sharedimage);
+    CloseHandle((HANDLE)qvm->sharedhandle);
+#else
+    munmap(qvm->sharedimage, qvm->sharedimagesize);
+#endif
+}
+
+
+int qvm_load(qvm_t* qvm, const uint8_t* filemem, size_t filesize, vmsyscall_t vmsyscall, int flags, qvm_alloc_t* allocator) {
+    // temporary decoded instructions and maps, since optimization may change the instruction count
+    qvmop_t* code = NULL;
+    int* origindex = NULL;
+    int* codemap = NULL;
+    // shared code image name, set if this process created it (so it can be removed if the load fails before it's published)
+    char sharename[64] = "";
+    int sharecreated = 0;
+
+    if (!qvm || qvm->memory || !filemem || !filesize || !vmsyscall)
+        return 0;
+
+    if (filesize < sizeof(qvmheader_t)) {
+        qvm_log(qvm, QMM_LOG_ERROR, "qvm_load(): Invalid QVM file: too small for header\n");
+        goto fail;
+    }
+
+    qvm->filesize = filesize;
+    qvm->vmsyscall = vmsyscall;
+    qvm->verify_data = flags & QVM_LOAD_VERIFY_DATA;
+    // if null, use default allocator (uses malloc/free)
+    qvm->allocator = allocator ? allocator : &qvm_allocator_default;
+
+    qvmheader_t header;
+
+    // grab a copy of the header
+    memcpy(&header, filemem, sizeof(qvmheader_t));
+
+    // check header fields for oddities
+    if (header.magic != QVM_MAGIC) {
+        qvm_log(qvm, QMM_LOG_ERROR, "qvm_load(): Invalid QVM file: incorrect magic number\n");
+        goto fail;
+    }
+    if (filesize < sizeof(header) + header.codelen + header.datalen + header.litlen) {
+        qvm_log(qvm, QMM_LOG_ERROR, "qvm_load(): Invalid QVM file: filesize too small for segment sizes\n");
+        goto fail;
+    }
+    if (header.codeoffset < sizeof(header) ||
+        header.codeoffset > filesize ||
+        header.codeoffset + header.codelen > filesize) {
+        qvm_log(qvm, QMM_LOG_ERROR, "qvm_load(): Invalid QVM file: code offset/length has invalid value\n");
+        goto fail;
+    }
+    if (header.dataoffset < sizeof(header) ||
+        header.dataoffset > filesize ||
+        header.dataoffset + header.datalen + header.litlen > filesize) {
+        qvm_log(qvm, QMM_LOG_ERROR, "qvm_load(): Invalid QVM file: data offset/length has invalid value\n");
+        goto fail;
+    }
+    if (header.instructioncount < header.codelen / 5 || // assume each op in the code segment is 5 bytes for a minimum
+        header.instructioncount > header.codelen) {
+        qvm_log(qvm, QMM_LOG_ERROR, "qvm_load(): Invalid QVM file: numops has invalid value\n");
+        goto fail;
+    }
+
+    // store numops in qvm object
+    qvm->instructioncount = header.instructioncount;
+
+    // data segment is all the data segment lengths combined (plus optional extra stack space)
+    size_t dataseglen = header.datalen + header.litlen + header.bsslen + QVM_EXTRA_PROGRAMSTACK_SIZE;
+    // save actual dataseglen before rounding up
+    size_t orig_dataseglen = dataseglen;
+    // round data segment size up to next power of 2 for masking data accesses
+    QVM_NEXT_POW_2(dataseglen);
+    qvm->dataseglen = dataseglen;
+
+    // allow stack to use any extra space from rounding up
+    qvm->stacksize = QVM_PROGRAMSTACK_SIZE + (dataseglen - orig_dataseglen) + QVM_EXTRA_PROGRAMSTACK_SIZE;
+
+    // the code image is read-only after loading, so with QVM_LOAD_SHARE_CODE it lives in a named shared memory object
+    // keyed by a hash of the file and load options. the first process to load a given QVM decodes and publishes it,
+    // the rest just map it
+    uint8_t* image = NULL;
+    uint64_t sharehash = 0;
+    if (flags & QVM_LOAD_SHARE_CODE) {
+        sharehash = qvm_share_hash(filemem, filesize, flags);
+#ifdef _WIN32
+        snprintf(sharename, sizeof(sharename), "Local\\sof2gt_qvm_%016llx", (unsigned long long)sharehash);
+#else
+        snprintf(sharename, sizeof(sharename), "/sof2gt_qvm_%016llx", (unsigned long long)sharehash);
+#endif
+        image = qvm_share_attach(qvm, sharename, sharehash);
+        if (image)
+            qvm_log(qvm, QMM_LOG_INFO, "qvm_load(): Using shared code image %s\n", sharename);
+    }
+
+    if (!image) {
+        if (!qvm_decode(qvm, &header, filemem, flags, &code, &origindex, &codemap))
+            goto fail;
+        if (flags & QVM_LOAD_SHARE_CODE) {
+            image = qvm_share_create(qvm, sharename);
+            sharecreated = image != NULL;
+            if (!image)
+                qvm_log(qvm, QMM_LOG_WARNING, "qvm_load(): Unable to create shared code image %s, using private memory\n", sharename);
+        }
+    }
+
+    // allocate vm memory
+    // | CODE | CODEMAP | ORIGINDEX | DATA | CONTEXT | <- program stack starts at the end of DATA and grows down
+    // program stack is for arguments and local variables. the code image (CODE, CODEMAP and ORIGINDEX) is left out
+    // if it is in shared memory
+    size_t dataoffset = image ? 0 : (qvm_codeimage_size(qvm) + 63) & ~(size_t)63;
+    // execution context goes after the data segment, aligned for its pointer member
+    size_t contextoffset = (dataoffset + qvm->dataseglen + 15) & ~(size_t)15;
+    qvm->memorysize = contextoffset + sizeof(qvm_context_t);
+    qvm->memory = (uint8_t*)qvm->allocator->alloc(qvm->memorysize, qvm->allocator->ctx);
+    if (!qvm->memory) {
+        qvm_log(qvm, QMM_LOG_ERROR, "qvm_load(): Unable to allocate %d bytes of VM memory\n", qvm->memorysize);
+        goto fail;
+    }
+
+    // zero out memory
+    memset(qvm->memory, 0, qvm->memorysize);
+
+    // copy instructions and maps to the code image (unless an existing shared image was mapped)
+    if (!image)
+        image = qvm->memory;
+    if (code) {
+        qvm_write_codeimage(qvm, image, code, origindex, codemap);
+        if (sharecreated) {
+            qvm_share_publish(qvm, sharehash);
+            qvm_log(qvm, QMM_LOG_INFO, "qvm_load(): Created shared code image %s\n", sharename);
+        }
+    }
+    qvm_set_codeimage(qvm, image);
+
+    // set segment pointers
+    qvm->datasegment = qvm->memory + dataoffset;
+    qvm->context = (qvm_context_t*)(qvm->memory + contextoffset);
+    // opstack starts empty. the memory block is zeroed, so the 2 sentinel slots past the end stay 0
+    qvm->context->stack = qvm->context->opstack + QVM_OPSTACK_SIZE;
+    qvm->stackptr = (int*)(qvm->datasegment + qvm->dataseglen);
+
     // copy data segment (including literals) to VM
     memcpy(qvm->datasegment, filemem + header.dataoffset, header.datalen + header.litlen);
+    qvm->header = header;
+
+    free(code);
+    free(origindex);
+    free(codemap);
 
     // a winner is us
     return 1;
 
 fail:
     // :(
+    free(code);
+    free(origindex);
+    free(codemap);
+#ifndef _WIN32
+    // don't leave an unfinished image behind for other processes to wait on
+    if (sharecreated)
+        shm_unlink(sharename);
+#endif
     qvm_unload(qvm);
     return 0;
 }
 
 
-static qvm_t qvm_empty;
 void qvm_unload(qvm_t* qvm) {
     if (!qvm)
         return;
     if (qvm->memory)
         qvm->allocator->free(qvm->memory, qvm->memorysize, qvm->allocator->ctx);
-    *qvm = qvm_empty;
+    qvm_share_close(qvm);
+
+    // the owner's context stays for the next qvm_load
+    void* userdata = qvm->userdata;
+    qvm_log_t log = qvm->log;
+    memset(qvm, 0, sizeof(*qvm));
+    qvm->userdata = userdata;
+    qvm->log = log;
 }
 
 
-int qvm_exec(qvm_t* qvm, int argc, int* argv) {
+int qvm_override(qvm_t* qvm, int addr, qvm_nativefunc_t func) {
+    if (!qvm || !qvm->memory || addr < 0 || (size_t)addr >= qvm->instructioncount)
+        return 0;
+
+    int index = qvm->codemap[addr];
+    qvmop_t* enter = &qvm->codesegment[index];
+
+    // already overridden: replace native function or restore QVM_OP_ENTER
+    if (enter->op == QVM_OP_NATIVE) {
+        qvm_native_t* native = &qvm->natives[enter->param];
+        if (func) {
+            native->func = func;
+            return 1;
+        }
+        enter->op = QVM_OP_ENTER;
+        enter->param = native->enterparam;
+        native->func = NULL;
+        return 1;
+    }
+    if (!func)
+        return 0;
+
+    if (qvm->sharedimage) {
+        qvm_log(qvm, QMM_LOG_ERROR, "qvm_override(%d): Code segment is shared with other processes (QVM_LOAD_SHARE_CODE)\n", addr);
+        return 0;
+    }
+    if (enter->op != QVM_OP_ENTER || qvm->origindex[index] != addr) {
+        qvm_log(qvm, QMM_LOG_ERROR, "qvm_override(%d): Address is not the start of a function\n", addr);
+        return 0;
+    }
+
+    // the function's body runs up to the next function. its original instructions must not appear anywhere else
+    // in the code segment, or it was inlined and those copies would still run the VM code
+    size_t end = (size_t)index + 1;
+    while (end < qvm->codecount && qvm->codesegment[end].op != QVM_OP_ENTER && qvm->codesegment[end].op != QVM_OP_NATIVE)
+        end++;
+    int origend = end < qvm->codecount ? qvm->origindex[end] : (int)qvm->instructioncount;
+    for (size_t i = 0; i < qvm->codecount; i++) {
+        if ((i < (size_t)index || i >= end) && qvm->origindex[i] > addr && qvm->origindex[i] < origend) {
+            qvm_log(qvm, QMM_LOG_ERROR, "qvm_override(%d): Function was inlined at %d (QVM_LOAD_INLINE)\n", addr, qvm->origindex[i]);
+            return 0;
+        }
+    }
+
+    for (int slot = 0; slot < QVM_MAX_NATIVES; slot++) {
+        qvm_native_t* native = &qvm->natives[slot];
+        if (native->func)
+            continue;
+        native->func = func;
+        native->addr = addr;
+        native->enterparam = enter->param;
+        enter->op = QVM_OP_NATIVE;
+        enter->param = slot;
+        return 1;
+    }
+
+    qvm_log(qvm, QMM_LOG_ERROR, "qvm_override(%d): Too many native overrides (max is %d)\n", addr, QVM_MAX_NATIVES);
+    return 0;
+}
+
+
+// monotonic clock in microseconds, for qvm_begin/qvm_resume time limits
+static uint64_t qvm_now_us(void) {
+#ifdef _WIN32
+    LARGE_INTEGER count, freq;
+    QueryPerformanceCounter(&count);
+    QueryPerformanceFrequency(&freq);
+    return (uint64_t)(count.QuadPart / freq.QuadPart * 1000000 + count.QuadPart % freq.QuadPart * 1000000 / freq.QuadPart);
+#else
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000 + (uint64_t)ts.tv_nsec / 1000;
+#endif
+}
+
+
+// run the VM from a code segment index (the QVM_OP_ENTER of a function) with a new stack frame holding the arguments,
+// or continue the paused run (entry < 0). runs with a budget (maxinstructions/maxusec, 0 for no limit) pause when it
+// runs out and set *status to QVM_RUN_YIELDED. runs without a budget (both 0) behave like they always have
+static int qvm_run(qvm_t* qvm, int entry, int argc, int* argv, uint64_t maxinstructions, uint64_t maxusec, qvmstatus_t* status) {
+    *status = QVM_RUN_ERROR;
     if (!qvm || !qvm->memory)
         return 0;
 
-    // cmd that vmMain was called with
-    int vmMain_cmd = argv[0];
+    qvm_context_t* context = qvm->context;
+    qvm_paused_t* paused = &context->paused;
+    int resuming = entry < 0;
+
+    // the argument count comes from callers (and plugins), check it before it is used to build the entry frame
+    if (!resuming && (argc < 0 || argc > QVM_MAX_ARGS)) {
+        qvm_log(qvm, QMM_LOG_ERROR, "qvm_exec(): Invalid argument count %d, max is %d\n", argc, QVM_MAX_ARGS);
+        return 0;
+    }
+
+    // cmd that vmMain was called with (or first argument to the function, for logging)
+    int vmMain_cmd = resuming ? paused->cmd : (argv && argc > 0) ? argv[0] : 0;
 
     // instruction pointer
-    qvmop_t* opptr = qvm->codesegment;
+    qvmop_t* opptr = qvm->codesegment + (resuming ? paused->instr : entry);
 
     // set up bitmasks for safety
-    // code mask
-    size_t codemask = qvm->codeseglen - 1;
+    // code mask (code segment index)
+    size_t codemask = qvm->codeseglen / sizeof(qvmop_t) - 1;
+    // codemap mask (original instruction index)
+    size_t mapmask = qvm->codemapsize - 1;
     // data mask - disable if verify_data is off by using a mask with all bits 1
     size_t datamask = qvm->verify_data ? qvm->dataseglen - 1 : 0xFFFFFFFF;
 
     // local "register" copy of stack pointer. this is purely for locality/speed.
     // it gets synced to qvm object before syscalls and restored after syscalls.
     // it also gets synced back to qvm object after execution completes
-    int* programstack = qvm->stackptr;
+    int* programstack = resuming ? paused->programstack : qvm->stackptr;
+    int* entryprogramstack = resuming ? paused->entryprogramstack : programstack;
 
     // size of new stack frame, need to store RII, framesize, and vmMain args
-    int framesize = (argc + 2) * sizeof(argv[0]);
-    // create new stack frame
-    QVM_STACKFRAME(framesize);
-    // set up new stack frame
-    programstack[0] = -1;           // sentinel return instruction index (RII)
-    programstack[1] = framesize;    // store the frame size like we store param in QVM_OP_ENTER
-    // copy qvm_exec arguments onto program stack starting at programstack[2]
-    if (argv && argc > 0)
-        memcpy(&programstack[2], argv, argc * sizeof(argv[0]));
+    int framesize = resuming ? paused->framesize : (argc + 2) * sizeof(argv[0]);
+    if (!resuming) {
+        // make sure the new frame fits in the program stack before writing it
+        if ((uint8_t*)programstack - framesize < qvm->datasegment + qvm->dataseglen - qvm->stacksize ||
+            (uint8_t*)programstack > qvm->datasegment + qvm->dataseglen) {
+            intptr_t stackusage = qvm->datasegment + qvm->dataseglen - (uint8_t*)programstack;
+            qvm_log(qvm, QMM_LOG_ERROR, "qvm_exec(%d): Not enough program stack for a call with %d arguments. Program stack size is currently %d, max is %d.\n", vmMain_cmd, argc, stackusage, qvm->stacksize);
+            return 0;
+        }
+        // create new stack frame
+        QVM_STACKFRAME(framesize);
+        // set up new stack frame
+        programstack[0] = -1;           // sentinel return instruction index (RII)
+        programstack[1] = framesize;    // store the frame size like we store param in QVM_OP_ENTER
+        // copy qvm_exec arguments onto program stack starting at programstack[2]
+        if (argv && argc > 0)
+            memcpy(&programstack[2], argv, argc * sizeof(argv[0]));
+    }
 
     /* programstack frame example: a "|" separates stack cells, while a "||" separates stack frames
      *
@@ -264,12 +805,15 @@ int qvm_exec(qvm_t* qvm, int argc, int* argv) {
      * QVM_OP_LOCAL.
      */
 
-     // opstack for math/comparison/temp/etc operations (instead of using registers)
-     // +2 for some extra space to "harmlessly" read 2 values (like QVM_OP_BLOCK_COPY) if opstack is empty (like at start)
-    int opstack[QVM_OPSTACK_SIZE + 2];
-    memset(opstack, 0, sizeof(opstack));
-    // opstack pointer (starts at end of block, grows down)
-    int* stack = opstack + QVM_OPSTACK_SIZE;
+    // opstack is shared by all calls into this VM. a nested call (from a syscall) continues below the values
+    // of the call that made the syscall, and restores the opstack pointer when it returns
+    int* opstack = context->opstack;
+    // local "register" copy of opstack pointer, synced to the context before syscalls
+    int* stack = resuming ? paused->stack : context->stack;
+    int* entrystack = resuming ? paused->entrystack : stack;
+    context->depth++;
+    if (resuming)
+        paused->active = 0;
 
     // current op
     qvmopcode_t op;
@@ -277,24 +821,46 @@ int qvm_exec(qvm_t* qvm, int argc, int* argv) {
     int param;
     // current instruction index
     int instr_index;
+    // instructions executed by this call (nested calls count their own)
+    uint64_t instructions = 0;
+
+    // instruction count at which to check the budget (never, without one), and when the time limit runs out
+    uint64_t checkat = UINT64_MAX;
+    uint64_t deadline = 0;
+    if (maxusec) {
+        deadline = qvm_now_us() + maxusec;
+        checkat = QVM_SLICE_CHECK_INSTRUCTIONS;
+    }
+    if (maxinstructions && maxinstructions < checkat)
+        checkat = maxinstructions;
 
     // main instruction loop
     do {
         // store instruction index
         instr_index = (int)(opptr - qvm->codesegment);
 
+        // pause between instructions once the budget runs out
+        if (instructions >= checkat) {
+            if ((maxinstructions && instructions >= maxinstructions) || (deadline && qvm_now_us() >= deadline))
+                goto yield;
+            checkat = instructions + QVM_SLICE_CHECK_INSTRUCTIONS;
+            if (maxinstructions && maxinstructions < checkat)
+                checkat = maxinstructions;
+        }
+        ++instructions;
+
         // verify program stack pointer is in stack within bss segment (+1 to allow starting at 1 past the end of block)
         if ((uint8_t*)programstack < qvm->datasegment + qvm->dataseglen - qvm->stacksize ||
             (uint8_t*)programstack > qvm->datasegment + qvm->dataseglen) {
             intptr_t stackusage = qvm->datasegment + qvm->dataseglen - (uint8_t*)programstack;
-            log_c(QMM_LOG_ERROR, "SOF2GT_QMM", "qvm_exec(%d): Runtime error at %d: program stack overflow! Program stack size is currently %d, max is %d.\n", vmMain_cmd, instr_index, stackusage, qvm->stacksize);
+            qvm_log(qvm, QMM_LOG_ERROR, "qvm_exec(%d): Runtime error at %d: program stack overflow! Program stack size is currently %d, max is %d.\n", vmMain_cmd, qvm->origindex[instr_index], stackusage, qvm->stacksize);
             goto fail;
         }
         // verify op stack pointer is in op stack
         // using > to allow starting at 1 past the end of block
         if (stack <= opstack || stack > opstack + QVM_OPSTACK_SIZE) {
             intptr_t stackusage = opstack + QVM_OPSTACK_SIZE - stack;
-            log_c(QMM_LOG_ERROR, "SOF2GT_QMM", "qvm_exec(%d): Runtime error at %d: opstack overflow! Opstack size is currently %d, max is %d.\n", vmMain_cmd, instr_index, stackusage, QVM_OPSTACK_SIZE);
+            qvm_log(qvm, QMM_LOG_ERROR, "qvm_exec(%d): Runtime error at %d: opstack overflow! Opstack size is currently %d, max is %d.\n", vmMain_cmd, qvm->origindex[instr_index], stackusage, QVM_OPSTACK_SIZE);
             goto fail;
         }
 
@@ -314,7 +880,7 @@ int qvm_exec(qvm_t* qvm, int argc, int* argv) {
         default:
             // anything else
             // todo: dump stacks/memory?
-            log_c(QMM_LOG_FATAL, "SOF2GT_QMM", "qvm_exec(%d): Runtime error at %d: unhandled opcode %d\n", vmMain_cmd, instr_index, op);
+            qvm_log(qvm, QMM_LOG_FATAL, "qvm_exec(%d): Runtime error at %d: unhandled opcode %d\n", vmMain_cmd, qvm->origindex[instr_index], op);
             goto fail;
 
         case QVM_OP_NOP:
@@ -341,7 +907,7 @@ int qvm_exec(qvm_t* qvm, int argc, int* argv) {
             // verify the value saved in programstack[1] matches param, then remove stack frame (size=param).
             // then, grab RII from top of previous stack frame and then jump to it
             if (programstack[1] != param) {
-                log_c(QMM_LOG_FATAL, "SOF2GT_QMM", "qvm_exec(%d): Runtime error at %d: QVM_OP_LEAVE param (%d) does not match QVM_OP_ENTER param (%d)\n", vmMain_cmd, instr_index, param, programstack[1]);
+                qvm_log(qvm, QMM_LOG_FATAL, "qvm_exec(%d): Runtime error at %d: QVM_OP_LEAVE param (%d) does not match QVM_OP_ENTER param (%d)\n", vmMain_cmd, qvm->origindex[instr_index], param, programstack[1]);
                 goto fail;
             }
             // clean up stack frame
@@ -361,12 +927,20 @@ int qvm_exec(qvm_t* qvm, int argc, int* argv) {
 
             // negative address means an engine trap
             if (jump_to < 0) {
-                // store local stack pointer in qvm object for re-entrancy
+                // store local stack pointers in qvm object for re-entrancy
                 qvm->stackptr = programstack;
+                context->stack = stack;
+                qvm->trapinstr = instr_index;
 
                 // pass call to game-specific syscall handler which will adjust pointer arguments
                 // and then call the normal QMM syscall entry point so it can be routed to plugins
-                int ret = qvm->vmsyscall(qvm->datasegment, -jump_to - 1, &programstack[2]);
+                int ret = qvm->vmsyscall(qvm, qvm->datasegment, -jump_to - 1, &programstack[2]);
+
+                // a nested call that hit a run-time error unloaded the QVM, nothing here points at valid memory now
+                if (!qvm->memory) {
+                    *status = QVM_RUN_ERROR;
+                    return 0;
+                }
 
                 // stack pointer in qvm object may have changed
                 programstack = qvm->stackptr;
@@ -380,8 +954,8 @@ int qvm_exec(qvm_t* qvm, int argc, int* argv) {
             // place RII in top slot of program stack
             programstack[0] = (int)(opptr - qvm->codesegment);
 
-            // jump to VM function at address
-            QVM_JUMP(jump_to);
+            // jump to VM function at address (original instruction index)
+            QVM_JUMP_ORIG(jump_to);
             break;
         }
 
@@ -410,11 +984,48 @@ int qvm_exec(qvm_t* qvm, int argc, int* argv) {
             // branching
 
         case QVM_OP_JUMP:
-            // jump to address in stack[0]
-            QVM_JUMP(stack[0]);
+            // jump to address in stack[0] (original instruction index)
+            QVM_JUMP_ORIG(stack[0]);
             QVM_POP();
             break;
 
+        case QVM_OP_JUMPD:
+            // jump to code segment index in param (generated by qvm_optimize)
+            QVM_JUMP(param);
+            break;
+
+        case QVM_OP_NATIVE: {
+            // call a native function in place of a VM function (see qvm_override). this is where the function's
+            // QVM_OP_ENTER was, so the arguments and RII are in the caller's stack frame
+            qvm_nativefunc_t func = qvm->natives[param & (QVM_MAX_NATIVES - 1)].func;
+            if (!func) {
+                qvm_log(qvm, QMM_LOG_FATAL, "qvm_exec(%d): Runtime error at %d: no native function in slot %d\n", vmMain_cmd, qvm->origindex[instr_index], param);
+                goto fail;
+            }
+
+            // store local stack pointers in qvm object for re-entrancy, like a syscall
+            qvm->stackptr = programstack;
+            context->stack = stack;
+
+            int ret = func(qvm->datasegment, &programstack[2]);
+
+            // the native function may have made a nested call that unloaded the QVM, like a syscall
+            if (!qvm->memory) {
+                *status = QVM_RUN_ERROR;
+                return 0;
+            }
+
+            programstack = qvm->stackptr;
+            QVM_PUSH(ret);
+
+            // return to caller like QVM_OP_LEAVE
+            if (programstack[0] < 0)
+                opptr = NULL;
+            else
+                QVM_JUMP(programstack[0]);
+            break;
+        }
+
         case QVM_OP_EQ:
             // if stack[1] == stack[0], goto address in param
             QVM_JUMP_SIF(== );
@@ -548,29 +1159,32 @@ int qvm_exec(qvm_t* qvm, int argc, int* argv) {
             QVM_POP();
             break;
 
-        case QVM_OP_BLOCK_COPY: {
-            // copy mem from address in stack[0] to address in stack[1] for 'param' number of bytes
-            int srci = (stack[0] & datamask);
-            int dsti = (stack[1] & datamask);
-
+        case QVM_OP_BLOCK_COPY:
+            // copy mem from address in stack[0] to address in stack[1] for 'param' number of bytes.
+            // src/dst ranges are clamped to the data segment
+            qvm_mem_copy(qvm->datasegment, qvm->dataseglen, stack[1], stack[0], param);
             QVM_POPN(2);
+            break;
 
-            // skip if src/dst are the same
-            if (srci == dsti)
-                break;
-
-            // make sure the src and dst ranges don't go out of memory bounds
-            int count = param;
-            count = ((srci + count) & datamask) - srci;
-            count = ((dsti + count) & datamask) - dsti;
+        case QVM_OP_BLOCK_COPY12:
+            // QVM_OP_BLOCK_COPY with param 12
+            QVM_BLOCK_COPY_N(12);
+            break;
 
-            uint8_t* src = qvm->datasegment + srci;
-            uint8_t* dst = qvm->datasegment + dsti;
+        case QVM_OP_BLOCK_COPY16:
+            // QVM_OP_BLOCK_COPY with param 16
+            QVM_BLOCK_COPY_N(16);
+            break;
 
-            memcpy(dst, src, count);
+        case QVM_OP_BLOCK_COPY32:
+            // QVM_OP_BLOCK_COPY with param 32
+            QVM_BLOCK_COPY_N(32);
+            break;
 
+        case QVM_OP_BLOCK_COPY64:
+            // QVM_OP_BLOCK_COPY with param 64
+            QVM_BLOCK_COPY_N(64);
             break;
-        }
 
                               // sign extensions
 
@@ -606,7 +1220,7 @@ int qvm_exec(qvm_t* qvm, int argc, int* argv) {
         case QVM_OP_DIVI:
             // division
             if (stack[0] == 0) {
-                log_c(QMM_LOG_FATAL, "SOF2GT_QMM", "qvm_exec(%d): Runtime error at %d: %s division by 0!\n", vmMain_cmd, instr_index, opcodename[op]);
+                qvm_log(qvm, QMM_LOG_FATAL, "qvm_exec(%d): Runtime error at %d: %s division by 0!\n", vmMain_cmd, qvm->origindex[instr_index], opcodename[op]);
                 goto fail;
             }
             QVM_SOP(/= );
@@ -615,7 +1229,7 @@ int qvm_exec(qvm_t* qvm, int argc, int* argv) {
         case QVM_OP_DIVU:
             // unsigned division
             if (stack[0] == 0) {
-                log_c(QMM_LOG_FATAL, "SOF2GT_QMM", "qvm_exec(%d): Runtime error at %d: %s division by 0!\n", vmMain_cmd, instr_index, opcodename[op]);
+                qvm_log(qvm, QMM_LOG_FATAL, "qvm_exec(%d): Runtime error at %d: %s division by 0!\n", vmMain_cmd, qvm->origindex[instr_index], opcodename[op]);
                 goto fail;
             }
             QVM_UOP(/= );
@@ -624,7 +1238,7 @@ int qvm_exec(qvm_t* qvm, int argc, int* argv) {
         case QVM_OP_MODI:
             // modulus
             if (stack[0] == 0) {
-                log_c(QMM_LOG_FATAL, "SOF2GT_QMM", "qvm_exec(%d): Runtime error at %d: %s division by 0!\n", vmMain_cmd, instr_index, opcodename[op]);
+                qvm_log(qvm, QMM_LOG_FATAL, "qvm_exec(%d): Runtime error at %d: %s division by 0!\n", vmMain_cmd, qvm->origindex[instr_index], opcodename[op]);
                 goto fail;
             }
             QVM_SOP(%= );
@@ -633,7 +1247,7 @@ int qvm_exec(qvm_t* qvm, int argc, int* argv) {
         case QVM_OP_MODU:
             // unsigned modulus
             if (stack[0] == 0) {
-                log_c(QMM_LOG_FATAL, "SOF2GT_QMM", "qvm_exec(%d): Runtime error at %d: %s division by 0!\n", vmMain_cmd, instr_index, opcodename[op]);
+                qvm_log(qvm, QMM_LOG_FATAL, "qvm_exec(%d): Runtime error at %d: %s division by 0!\n", vmMain_cmd, qvm->origindex[instr_index], opcodename[op]);
                 goto fail;
             }
             QVM_UOP(%= );
@@ -703,7 +1317,7 @@ int qvm_exec(qvm_t* qvm, int argc, int* argv) {
             // float division
             // float 0s are all 0 bits but with either sign bit
             if (stack[0] == 0 || stack[0] == 0x80000000) {
-                log_c(QMM_LOG_FATAL, "SOF2GT_QMM", "qvm_exec(%d): Runtime error at %d: %s division by 0!\n", vmMain_cmd, instr_index, opcodename[op]);
+                qvm_log(qvm, QMM_LOG_FATAL, "qvm_exec(%d): Runtime error at %d: %s division by 0!\n", vmMain_cmd, qvm->origindex[instr_index], opcodename[op]);
                 goto fail;
             }
             QVM_FOP(/= );
@@ -730,7 +1344,7 @@ int qvm_exec(qvm_t* qvm, int argc, int* argv) {
 
     // compare stored frame size like in QVM_OP_LEAVE
     if (programstack[1] != framesize) {
-        log_c(QMM_LOG_FATAL, "SOF2GT_QMM", "qvm_exec(%d): Runtime error after execution: stack frame size (%d) does not match entry stack frame size (%d)\n", vmMain_cmd, programstack[1], framesize);
+        qvm_log(qvm, QMM_LOG_FATAL, "qvm_exec(%d): Runtime error after execution: stack frame size (%d) does not match entry stack frame size (%d)\n", vmMain_cmd, programstack[1], framesize);
         goto fail;
     }
 
@@ -741,7 +1355,37 @@ int qvm_exec(qvm_t* qvm, int argc, int* argv) {
     qvm->stackptr = programstack;
 
     // return value is stored on the top of the stack (pushed just before QVM_OP_LEAVE)
-    return stack[0];
+    int ret = stack[0];
+
+    // give the opstack back to the caller
+    context->stack = entrystack;
+    context->depth--;
+
+    qvm->instructions += instructions;
+
+    *status = QVM_RUN_DONE;
+    return ret;
+
+yield:
+    // keep everything where it is and remember where to continue. the stack pointers in the qvm object and context
+    // are left below this run's frames and opstack values, so other calls can be made while it is paused
+    paused->active = 1;
+    paused->instr = instr_index;
+    paused->programstack = programstack;
+    paused->stack = stack;
+    paused->entryprogramstack = entryprogramstack;
+    paused->entrystack = entrystack;
+    paused->framesize = framesize;
+    paused->cmd = vmMain_cmd;
+
+    qvm->stackptr = programstack;
+    context->stack = stack;
+    context->depth--;
+
+    qvm->instructions += instructions;
+
+    *status = QVM_RUN_YIELDED;
+    return 0;
 
 fail:
     qvm_unload(qvm);
@@ -749,6 +1393,102 @@ fail:
 }
 
 
+// code segment index of the function at an address (original instruction index), or -1 if it isn't one
+static int qvm_entry(qvm_t* qvm, const char* caller, int addr) {
+    if (addr < 0 || (size_t)addr >= qvm->instructioncount) {
+        qvm_log(qvm, QMM_LOG_ERROR, "%s(%d): Address is outside the code segment\n", caller, addr);
+        return -1;
+    }
+    int entry = qvm->codemap[addr];
+    qvmopcode_t op = qvm->codesegment[entry].op;
+    if ((op != QVM_OP_ENTER && op != QVM_OP_NATIVE) || qvm->origindex[entry] != addr) {
+        qvm_log(qvm, QMM_LOG_ERROR, "%s(%d): Address is not the start of a function\n", caller, addr);
+        return -1;
+    }
+    return entry;
+}
+
+
+int qvm_exec(qvm_t* qvm, int argc, int* argv) {
+    qvmstatus_t status;
+    // vmMain is always the first function
+    return qvm_run(qvm, 0, argc, argv, 0, 0, &status);
+}
+
+
+int qvm_call(qvm_t* qvm, int addr, int argc, int* argv) {
+    if (!qvm || !qvm->memory)
+        return 0;
+
+    int entry = qvm_entry(qvm, "qvm_call", addr);
+    if (entry < 0)
+        return 0;
+
+    qvmstatus_t status;
+    return qvm_run(qvm, entry, argc, argv, 0, 0, &status);
+}
+
+
+int qvm_begin(qvm_t* qvm, int addr, int argc, int* argv, uint64_t maxinstructions, uint64_t maxusec, int* ret) {
+    if (!qvm || !qvm->memory)
+        return QVM_RUN_ERROR;
+
+    // a run started inside another call would pause with that call's frames above its own
+    if (qvm->context->depth) {
+        qvm_log(qvm, QMM_LOG_ERROR, "qvm_begin(%d): Can't be called from inside another call into the VM\n", addr);
+        return QVM_RUN_ERROR;
+    }
+    if (qvm->context->paused.active) {
+        qvm_log(qvm, QMM_LOG_ERROR, "qvm_begin(%d): Another run is already paused\n", addr);
+        return QVM_RUN_ERROR;
+    }
+
+    // vmMain is always the first function
+    int entry = addr < 0 ? 0 : qvm_entry(qvm, "qvm_begin", addr);
+    if (entry < 0)
+        return QVM_RUN_ERROR;
+
+    qvmstatus_t status;
+    int result = qvm_run(qvm, entry, argc, argv, maxinstructions, maxusec, &status);
+    if (status == QVM_RUN_DONE && ret)
+        *ret = result;
+    return status;
+}
+
+
+int qvm_resume(qvm_t* qvm, uint64_t maxinstructions, uint64_t maxusec, int* ret) {
+    if (!qvm || !qvm->memory)
+        return QVM_RUN_ERROR;
+
+    if (!qvm->context->paused.active) {
+        qvm_log(qvm, QMM_LOG_ERROR, "qvm_resume(): No run is paused\n");
+        return QVM_RUN_ERROR;
+    }
+    // a nested call may have left its own frames below the paused run's
+    if (qvm->context->depth) {
+        qvm_log(qvm, QMM_LOG_ERROR, "qvm_resume(): Can't be called from inside another call into the VM\n");
+        return QVM_RUN_ERROR;
+    }
+
+    qvmstatus_t status;
+    int result = qvm_run(qvm, -1, 0, NULL, maxinstructions, maxusec, &status);
+    if (status == QVM_RUN_DONE && ret)
+        *ret = result;
+    return status;
+}
+
+
+void qvm_cancel(qvm_t* qvm) {
+    if (!qvm || !qvm->memory || !qvm->context->paused.active || qvm->context->depth)
+        return;
+
+    // drop the run's stack frames and opstack values
+    qvm->stackptr = qvm->context->paused.entryprogramstack;
+    qvm->context->stack = qvm->context->paused.entrystack;
+    qvm->context->paused.active = 0;
+}
+
+
 // return a string name for the VM opcode
 const char* opcodename[] = {
     "QVM_OP_UNDEF",
@@ -810,7 +1550,13 @@ const char* opcodename[] = {
     "QVM_OP_DIVF",
     "QVM_OP_MULF",
     "QVM_OP_CVIF",
-    "QVM_OP_CVFI"
+    "QVM_OP_CVFI",
+    "QVM_OP_JUMPD",
+    "QVM_OP_BLOCK_COPY12",
+    "QVM_OP_BLOCK_COPY16",
+    "QVM_OP_BLOCK_COPY32",
+    "QVM_OP_BLOCK_COPY64",
+    "QVM_OP_NATIVE"
 };
 
 
@@ -827,3 +1573,70 @@ static void qvm_free_default(void* ptr, ptrdiff_t size, void* ctx) {
 
 
 qvm_alloc_t qvm_allocator_default = { qvm_alloc_default, qvm_free_default, NULL };
+
+
+// touch every page of a block so it is faulted in now, rather than during the first frames
+static void qvm_prefault(void* ptr, size_t size) {
+    for (size_t i = 0; i < size; i += QVM_PAGE_SIZE)
+        ((volatile uint8_t*)ptr)[i] = 0;
+}
+
+
+static void* qvm_alloc_mmap(ptrdiff_t size, void* ctx) {
+    (void)ctx;
+#ifdef _WIN32
+    // committed, zeroed and page aligned
+    void* ptr = VirtualAlloc(NULL, (SIZE_T)size, MEM_COMMIT | MEM_RESERVE, PAGE_READWRITE);
+    if (ptr)
+        qvm_prefault(ptr, (size_t)size);
+    return ptr;
+#else
+    size_t len = ((size_t)size + QVM_PAGE_SIZE - 1) & ~(size_t)(QVM_PAGE_SIZE - 1);
+
+    // small blocks can't use huge pages, so just map and fault them in
+    if (len < QVM_HUGEPAGE_SIZE) {
+        int flags = MAP_PRIVATE | MAP_ANONYMOUS;
+#ifdef MAP_POPULATE
+        flags |= MAP_POPULATE;
+#endif
+        void* ptr = mmap(NULL, len, PROT_READ | PROT_WRITE, flags, -1, 0);
+        return ptr == MAP_FAILED ? NULL : ptr;
+    }
+
+    // map extra so the block can start on a huge page boundary, then unmap the unused head and tail
+    size_t total = len + QVM_HUGEPAGE_SIZE;
+    uint8_t* raw = (uint8_t*)mmap(NULL, total, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (raw == MAP_FAILED)
+        return NULL;
+    uint8_t* ptr = (uint8_t*)(((uintptr_t)raw + QVM_HUGEPAGE_SIZE - 1) & ~(uintptr_t)(QVM_HUGEPAGE_SIZE - 1));
+    if (ptr > raw)
+        munmap(raw, ptr - raw);
+    if (raw + total > ptr + len)
+        munmap(ptr + len, raw + total - (ptr + len));
+
+    // ask for transparent huge pages before faulting anything in (MAP_POPULATE would fault in small pages first)
+#ifdef MADV_HUGEPAGE
+    madvise(ptr, len, MADV_HUGEPAGE);
+#endif
+#ifdef MADV_POPULATE_WRITE
+    if (madvise(ptr, len, MADV_POPULATE_WRITE) != 0)
+#endif
+        qvm_prefault(ptr, len);
+
+    return ptr;
+#endif
+}
+
+
+static void qvm_free_mmap(void* ptr, ptrdiff_t size, void* ctx) {
+    (void)ctx;
+#ifdef _WIN32
+    (void)size;
+    VirtualFree(ptr, 0, MEM_RELEASE);
+#else
+    munmap(ptr, (size_t)size);
+#endif
+}
+
+
+qvm_alloc_t qvm_allocator_mmap = { qvm_alloc_mmap, qvm_free_mmap, NULL };
@@ -0,0 +1,350 @@
+/*
+SoF2GT_QMM - Hook gametype dlls/qvms for Soldier of Fortune 2
+Copyright 2025-2026
+https://github.com/thecybermind/sof2gt_qmm/
+3-clause BSD license: https://opensource.org/license/bsd-3-clause
+
+Created By:
+    Kevin Masterson < k.m.masterson@gmail.com >
+
+*/
+
+#define QMM_LOGGING
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "qvm.h"
+#include "qvm_builder.h"
+
+#ifdef QMM_LOGGING
+void log_c(int severity, const char* tag, const char* fmt, ...);
+enum { QMM_LOG_TRACE, QMM_LOG_DEBUG, QMM_LOG_INFO, QMM_LOG_NOTICE, QMM_LOG_WARNING, QMM_LOG_ERROR, QMM_LOG_FATAL };
+#else
+#define log_c(...) /* */
+#endif
+
+
+// grow an array so it can hold at least 'count' elements of 'size' bytes
+static int qvm_builder_grow(qvm_builder_t* builder, void** array, size_t* cap, size_t count, size_t size) {
+    if (count <= *cap)
+        return 1;
+
+    size_t newcap = *cap ? *cap : 64;
+    while (newcap < count)
+        newcap *= 2;
+    void* newarray = realloc(*array, newcap * size);
+    if (!newarray) {
+        log_c(QMM_LOG_ERROR, "SOF2GT_QMM", "qvm_builder: Unable to allocate %d bytes\n", (int)(newcap * size));
+        builder->error = 1;
+        return 0;
+    }
+    *array = newarray;
+    *cap = newcap;
+    return 1;
+}
+
+
+// size of the param of an opcode in a .qvm file (same as qvm_load)
+static int qvm_builder_paramsize(qvmopcode_t op) {
+    switch (op) {
+    case QVM_OP_EQ:
+    case QVM_OP_NE:
+    case QVM_OP_LTI:
+    case QVM_OP_LEI:
+    case QVM_OP_GTI:
+    case QVM_OP_GEI:
+    case QVM_OP_LTU:
+    case QVM_OP_LEU:
+    case QVM_OP_GTU:
+    case QVM_OP_GEU:
+    case QVM_OP_EQF:
+    case QVM_OP_NEF:
+    case QVM_OP_LTF:
+    case QVM_OP_LEF:
+    case QVM_OP_GTF:
+    case QVM_OP_GEF:
+    case QVM_OP_ENTER:
+    case QVM_OP_LEAVE:
+    case QVM_OP_CONST:
+    case QVM_OP_LOCAL:
+    case QVM_OP_BLOCK_COPY:
+        return 4;
+    case QVM_OP_ARG:
+        return 1;
+    default:
+        return 0;
+    }
+}
+
+
+// add a fixup to be resolved by qvm_builder_finish
+static void qvm_builder_fixup(qvm_builder_t* builder, int symbol, int addend, qvmsegment_t segment, int at) {
+    if (symbol < 0 || (size_t)symbol >= builder->symbolcount) {
+        log_c(QMM_LOG_ERROR, "SOF2GT_QMM", "qvm_builder: Invalid symbol %d\n", symbol);
+        builder->error = 1;
+        return;
+    }
+    if (!qvm_builder_grow(builder, (void**)&builder->fixups, &builder->fixupcap, builder->fixupcount + 1, sizeof(qvm_fixup_t)))
+        return;
+
+    qvm_fixup_t* fixup = &builder->fixups[builder->fixupcount++];
+    fixup->symbol = symbol;
+    fixup->addend = addend;
+    fixup->segment = segment;
+    fixup->at = at;
+}
+
+
+void qvm_builder_init(qvm_builder_t* builder) {
+    memset(builder, 0, sizeof(*builder));
+}
+
+
+void qvm_builder_free(qvm_builder_t* builder) {
+    free(builder->code);
+    free(builder->data);
+    free(builder->lit);
+    free(builder->symbols);
+    free(builder->fixups);
+    memset(builder, 0, sizeof(*builder));
+}
+
+
+int qvm_builder_symbol(qvm_builder_t* builder, const char* name, qvmsegment_t segment) {
+    if (!qvm_builder_grow(builder, (void**)&builder->symbols, &builder->symbolcap, builder->symbolcount + 1, sizeof(qvm_symbol_t)))
+        return -1;
+
+    qvm_symbol_t* symbol = &builder->symbols[builder->symbolcount];
+    memset(symbol, 0, sizeof(*symbol));
+    if (name)
+        snprintf(symbol->name, sizeof(symbol->name), "%s", name);
+    symbol->segment = segment;
+    symbol->offset = -1;
+    symbol->address = -1;
+    return (int)builder->symbolcount++;
+}
+
+
+void qvm_builder_place(qvm_builder_t* builder, int symbol) {
+    if (symbol < 0 || (size_t)symbol >= builder->symbolcount) {
+        builder->error = 1;
+        return;
+    }
+
+    qvm_symbol_t* sym = &builder->symbols[symbol];
+    switch (sym->segment) {
+    case QVM_SEG_CODE:
+        sym->offset = (int)builder->codecount;
+        break;
+    case QVM_SEG_DATA:
+        sym->offset = (int)builder->datalen;
+        break;
+    case QVM_SEG_LIT:
+        sym->offset = (int)builder->litlen;
+        break;
+    case QVM_SEG_BSS:
+        sym->offset = (int)builder->bsslen;
+        break;
+    }
+}
+
+
+int qvm_builder_label(qvm_builder_t* builder, const char* name) {
+    int symbol = qvm_builder_symbol(builder, name, QVM_SEG_CODE);
+    if (symbol >= 0)
+        qvm_builder_place(builder, symbol);
+    return symbol;
+}
+
+
+int qvm_builder_op(qvm_builder_t* builder, qvmopcode_t op, int param) {
+    if (op < 0 || op >= QVM_OP_NUM_OPS) {
+        log_c(QMM_LOG_ERROR, "SOF2GT_QMM", "qvm_builder_op(): Invalid opcode %d at %d\n", op, (int)builder->codecount);
+        builder->error = 1;
+        return -1;
+    }
+    if (op == QVM_OP_ARG && (param < 0 || param > 255)) {
+        log_c(QMM_LOG_ERROR, "SOF2GT_QMM", "qvm_builder_op(): QVM_OP_ARG param %d out of range at %d\n", param, (int)builder->codecount);
+        builder->error = 1;
+        return -1;
+    }
+    if (!qvm_builder_grow(builder, (void**)&builder->code, &builder->codecap, builder->codecount + 1, sizeof(qvmop_t)))
+        return -1;
+
+    qvmop_t* instr = &builder->code[builder->codecount];
+    instr->op = op;
+    instr->param = qvm_builder_paramsize(op) ? param : 0;
+    return (int)builder->codecount++;
+}
+
+
+int qvm_builder_op_symbol(qvm_builder_t* builder, qvmopcode_t op, int symbol, int addend) {
+    if (qvm_builder_paramsize(op) != 4) {
+        log_c(QMM_LOG_ERROR, "SOF2GT_QMM", "qvm_builder_op_symbol(): Opcode %d has no 4-byte param at %d\n", op, (int)builder->codecount);
+        builder->error = 1;
+        return -1;
+    }
+
+    int index = qvm_builder_op(builder, op, 0);
+    if (index >= 0)
+        qvm_builder_fixup(builder, symbol, addend, QVM_SEG_CODE, index);
+    return index;
+}
+
+
+int qvm_builder_data(qvm_builder_t* builder, const char* name, const int* words, size_t count) {
+    int symbol = qvm_builder_symbol(builder, name, QVM_SEG_DATA);
+    if (symbol < 0)
+        return -1;
+    qvm_builder_place(builder, symbol);
+
+    size_t len = count * sizeof(int);
+    if (!qvm_builder_grow(builder, (void**)&builder->data, &builder->datacap, builder->datalen + len, 1))
+        return -1;
+    if (words)
+        memcpy(builder->data + builder->datalen, words, len);
+    else
+        memset(builder->data + builder->datalen, 0, len);
+    builder->datalen += len;
+    return symbol;
+}
+
+
+void qvm_builder_data_symbol(qvm_builder_t* builder, int symbol, int addend) {
+    int at = (int)builder->datalen;
+    if (qvm_builder_data(builder, NULL, NULL, 1) >= 0)
+        qvm_builder_fixup(builder, symbol, addend, QVM_SEG_DATA, at);
+}
+
+
+int qvm_builder_lit(qvm_builder_t* builder, const char* name, const void* bytes, size_t len) {
+    int symbol = qvm_builder_symbol(builder, name, QVM_SEG_LIT);
+    if (symbol < 0)
+        return -1;
+    qvm_builder_place(builder, symbol);
+
+    size_t padded = (len + 3) & ~(size_t)3;
+    if (!qvm_builder_grow(builder, (void**)&builder->lit, &builder->litcap, builder->litlen + padded, 1))
+        return -1;
+    memcpy(builder->lit + builder->litlen, bytes, len);
+    memset(builder->lit + builder->litlen + len, 0, padded - len);
+    builder->litlen += padded;
+    return symbol;
+}
+
+
+int qvm_builder_bss(qvm_builder_t* builder, const char* name, size_t len) {
+    int symbol = qvm_builder_symbol(builder, name, QVM_SEG_BSS);
+    if (symbol < 0)
+        return -1;
+    qvm_builder_place(builder, symbol);
+    builder->bsslen += (len + 3) & ~(size_t)3;
+    return symbol;
+}
+
+
+uint8_t* qvm_builder_finish(qvm_builder_t* builder, size_t* size) {
+    if (builder->error || !builder->codecount) {
+        log_c(QMM_LOG_ERROR, "SOF2GT_QMM", "qvm_builder_finish(): Nothing to build, or an earlier error occurred\n");
+        return NULL;
+    }
+
+    // resolve symbol addresses: data, then lit, then bss
+    for (size_t i = 0; i < builder->symbolcount; i++) {
+        qvm_symbol_t* symbol = &builder->symbols[i];
+        if (symbol->offset < 0) {
+            log_c(QMM_LOG_ERROR, "SOF2GT_QMM", "qvm_builder_finish(): Symbol %d (\"%s\") was never placed\n", (int)i, symbol->name);
+            return NULL;
+        }
+        switch (symbol->segment) {
+        case QVM_SEG_CODE:
+        case QVM_SEG_DATA:
+            symbol->address = symbol->offset;
+            break;
+        case QVM_SEG_LIT:
+            symbol->address = (int)builder->datalen + symbol->offset;
+            break;
+        case QVM_SEG_BSS:
+            symbol->address = (int)(builder->datalen + builder->litlen) + symbol->offset;
+            break;
+        }
+    }
+
+    // apply fixups
+    for (size_t i = 0; i < builder->fixupcount; i++) {
+        qvm_fixup_t* fixup = &builder->fixups[i];
+        int value = builder->symbols[fixup->symbol].address + fixup->addend;
+        if (fixup->segment == QVM_SEG_CODE)
+            builder->code[fixup->at].param = value;
+        else
+            memcpy(builder->data + fixup->at, &value, sizeof(value));
+    }
+
+    // encode instructions
+    size_t codelen = 0;
+    for (size_t i = 0; i < builder->codecount; i++)
+        codelen += 1 + qvm_builder_paramsize(builder->code[i].op);
+    size_t codepadded = (codelen + 3) & ~(size_t)3;
+
+    qvmheader_t header;
+    header.magic = QVM_MAGIC;
+    header.instructioncount = (uint32_t)builder->codecount;
+    header.codeoffset = sizeof(header);
+    header.codelen = (uint32_t)codelen;
+    header.dataoffset = (uint32_t)(sizeof(header) + codepadded);
+    header.datalen = (uint32_t)builder->datalen;
+    header.litlen = (uint32_t)builder->litlen;
+    header.bsslen = (uint32_t)(builder->bsslen + QVM_PROGRAMSTACK_SIZE);
+
+    *size = header.dataoffset + builder->datalen + builder->litlen;
+    uint8_t* image = (uint8_t*)calloc(*size, 1);
+    if (!image) {
+        log_c(QMM_LOG_ERROR, "SOF2GT_QMM", "qvm_builder_finish(): Unable to allocate %d bytes\n", (int)*size);
+        return NULL;
+    }
+
+    memcpy(image, &header, sizeof(header));
+    uint8_t* out = image + header.codeoffset;
+    for (size_t i = 0; i < builder->codecount; i++) {
+        qvmop_t* instr = &builder->code[i];
+        *out++ = (uint8_t)instr->op;
+        int paramsize = qvm_builder_paramsize(instr->op);
+        if (paramsize == 4) {
+            memcpy(out, &instr->param, sizeof(int));
+            out += 4;
+        }
+        else if (paramsize == 1) {
+            *out++ = (uint8_t)instr->param;
+        }
+    }
+    if (builder->datalen)
+        memcpy(image + header.dataoffset, builder->data, builder->datalen);
+    if (builder->litlen)
+        memcpy(image + header.dataoffset + builder->datalen, builder->lit, builder->litlen);
+
+    return image;
+}
+
+
+char* qvm_builder_map(qvm_builder_t* builder, size_t* len) {
+    // "<segment> <8 hex digits> <name>\n"
+    size_t cap = 1;
+    for (size_t i = 0; i < builder->symbolcount; i++)
+        cap += 12 + strlen(builder->symbols[i].name) + 1;
+
+    char* text = (char*)malloc(cap);
+    if (!text)
+        return NULL;
+
+    *len = 0;
+    for (size_t i = 0; i < builder->symbolcount; i++) {
+        qvm_symbol_t* symbol = &builder->symbols[i];
+        if (!symbol->name[0] || symbol->address < 0)
+            continue;
+        *len += (size_t)snprintf(text + *len, cap - *len, "%d %8x %s\n", (int)symbol->segment, (unsigned int)symbol->address, symbol->name);
+    }
+    text[*len] = '\0';
+    return text;
+}
@@ -0,0 +1,826 @@
+/*
+SoF2GT_QMM - Hook gametype dlls/qvms for Soldier of Fortune 2
+Copyright 2025-2026
+https://github.com/thecybermind/sof2gt_qmm/
+3-clause BSD license: https://opensource.org/license/bsd-3-clause
+
+Created By:
+    Kevin Masterson < k.m.masterson@gmail.com >
+
+*/
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include "qvm.h"
+
+/* Load-time bytecode optimization (QVM_LOAD_OPTIMIZE)
+ *
+ * Each function (a QVM_OP_ENTER up to the next QVM_OP_ENTER) is analyzed on its own. The opstack depth before
+ * every instruction is computed by following fall-through and direct branches from the function entry. Anything
+ * not reached that way can only be entered by an indirect QVM_OP_JUMP, whose targets come from constants in the
+ * code or data segments (switch tables), so those are seeded with an empty opstack, which is how lcc emits them.
+ * If the depths don't agree, the function is left alone.
+ *
+ * An instruction that can be entered other than by falling through from the previous instruction is a "barrier".
+ * Within the runs between barriers, the opstack is simulated to find which instruction produced each operand.
+ * That lets us:
+ *   - fold arithmetic and conversions on QVM_OP_CONST operands into a single QVM_OP_CONST
+ *   - fold branches on constants into QVM_OP_JUMPD (always) or nothing (never)
+ *   - turn "QVM_OP_CONST x; QVM_OP_JUMP" into QVM_OP_JUMPD, and remove jumps to the next instruction
+ *   - remove values pushed only to be popped (QVM_OP_PUSH/QVM_OP_CONST/QVM_OP_LOCAL followed by QVM_OP_POP)
+ *   - remove stores to locals that are never loaded, if no local address escapes the function
+ *   - remove code which is not reachable
+ *
+ * With QVM_LOAD_INLINE, small leaf functions are first spliced into their callers (see s_inline). The copies are
+ * extra instructions which don't correspond to an original instruction index, so only the "home" instructions
+ * (the ones from the .qvm file) can be the target of indirect jumps and calls.
+ *
+ * Home instructions are only ever removed (never moved), and an instruction removed from the start of a sequence
+ * has no effect, so the index of a removed instruction can be mapped to the next remaining instruction. The
+ * resulting codemap (original index -> new index) is used for indirect jumps and calls, since those use
+ * addresses stored in VM memory, and origindex (new index -> original index) is kept for error reporting.
+ */
+
+// working copy of an instruction
+typedef struct qvmir_s {
+    int op;
+    int param;          // for branches and QVM_OP_JUMPD, the target as an index into the ir array
+    int orig;           // original instruction index (of the callee instruction for inlined copies)
+    int home;           // this is the instruction from the .qvm file at index 'orig' (not an inlined copy)
+    int dead;           // removed by optimization
+} qvmir_t;
+
+// optimizer state
+typedef struct qvmopt_s {
+    qvmir_t* ir;
+    int count;
+    int origcount;      // number of original instructions
+    int* homeof;        // original instruction index -> ir index
+    char* candidate;    // original instruction index appears as a constant in code or data (possible indirect target)
+    int* depth;         // opstack depth before each instruction, -1 if unreachable
+    char* barrier;      // instruction can be entered other than by falling through
+    int* arg0;          // producer of the top operand of each instruction (-1 if unknown)
+    int* arg1;          // producer of the second operand of each instruction (-1 if unknown)
+    int* consumer;      // instruction which pops the value pushed by each instruction (-1 if unknown)
+    int* slot;          // which operand of the consumer (0 = top)
+    int* worklist;
+    int* stack;
+    char* touched;      // changed during the current sweep
+} qvmopt_t;
+
+
+// number of opstack values popped and pushed by an opcode
+static void s_stackeffect(int op, int* pops, int* pushes) {
+    *pops = 0;
+    *pushes = 0;
+    switch (op) {
+    case QVM_OP_PUSH: case QVM_OP_CONST: case QVM_OP_LOCAL:
+        *pushes = 1;
+        break;
+    case QVM_OP_POP: case QVM_OP_JUMP: case QVM_OP_ARG:
+        *pops = 1;
+        break;
+    case QVM_OP_CALL: case QVM_OP_LOAD1: case QVM_OP_LOAD2: case QVM_OP_LOAD4:
+    case QVM_OP_SEX8: case QVM_OP_SEX16: case QVM_OP_NEGI: case QVM_OP_BCOM:
+    case QVM_OP_NEGF: case QVM_OP_CVIF: case QVM_OP_CVFI:
+        *pops = 1;
+        *pushes = 1;
+        break;
+    case QVM_OP_EQ: case QVM_OP_NE: case QVM_OP_LTI: case QVM_OP_LEI: case QVM_OP_GTI: case QVM_OP_GEI:
+    case QVM_OP_LTU: case QVM_OP_LEU: case QVM_OP_GTU: case QVM_OP_GEU:
+    case QVM_OP_EQF: case QVM_OP_NEF: case QVM_OP_LTF: case QVM_OP_LEF: case QVM_OP_GTF: case QVM_OP_GEF:
+    case QVM_OP_STORE1: case QVM_OP_STORE2: case QVM_OP_STORE4: case QVM_OP_BLOCK_COPY:
+        *pops = 2;
+        break;
+    case QVM_OP_ADD: case QVM_OP_SUB: case QVM_OP_DIVI: case QVM_OP_DIVU: case QVM_OP_MODI: case QVM_OP_MODU:
+    case QVM_OP_MULI: case QVM_OP_MULU: case QVM_OP_BAND: case QVM_OP_BOR: case QVM_OP_BXOR:
+    case QVM_OP_LSH: case QVM_OP_RSHI: case QVM_OP_RSHU:
+    case QVM_OP_ADDF: case QVM_OP_SUBF: case QVM_OP_DIVF: case QVM_OP_MULF:
+        *pops = 2;
+        *pushes = 1;
+        break;
+    default:
+        break;
+    }
+}
+
+
+static int s_isbranch(int op) {
+    return op >= QVM_OP_EQ && op <= QVM_OP_GEF;
+}
+
+
+// can execution continue to the next instruction
+static int s_fallsthrough(int op) {
+    return op != QVM_OP_JUMP && op != QVM_OP_JUMPD && op != QVM_OP_LEAVE && op != QVM_OP_UNDEF;
+}
+
+
+// first live instruction at or after i (end if none)
+static int s_live(const qvmopt_t* o, int i, int end) {
+    while (i < end && o->ir[i].dead)
+        i++;
+    return i;
+}
+
+
+// reinterpret opstack values
+static float s_f(int i) { float f; memcpy(&f, &i, sizeof(f)); return f; }
+static int s_i(float f) { int i; memcpy(&i, &f, sizeof(i)); return i; }
+
+
+// propagate opstack depth from instruction 'from' with depth 'd'. returns 0 on inconsistent depths
+static int s_propagate(qvmopt_t* o, int start, int end, int from, int d) {
+    int count = 0;
+
+    if (o->depth[from] >= 0)
+        return o->depth[from] == d;
+    o->depth[from] = d;
+    o->worklist[count++] = from;
+
+    while (count) {
+        int i = o->worklist[--count];
+        int pops, pushes;
+        int op = o->ir[i].op;
+
+        s_stackeffect(op, &pops, &pushes);
+        if (o->depth[i] < pops || op == QVM_OP_UNDEF)
+            return 0;
+        int nd = o->depth[i] - pops + pushes;
+        if (nd > QVM_OPSTACK_SIZE)
+            return 0;
+
+        int succ[2];
+        int nsucc = 0;
+        if (s_fallsthrough(op)) {
+            int next = s_live(o, i + 1, end);
+            if (next < end)
+                succ[nsucc++] = next;
+        }
+        if (s_isbranch(op) || op == QVM_OP_JUMPD) {
+            if (o->ir[i].param < start || o->ir[i].param >= end)
+                return 0;
+            int t = s_live(o, o->ir[i].param, end);
+            if (t >= end)
+                return 0;
+            succ[nsucc++] = t;
+        }
+
+        for (int s = 0; s < nsucc; s++) {
+            int t = succ[s];
+            if (o->depth[t] < 0) {
+                o->depth[t] = nd;
+                o->worklist[count++] = t;
+            }
+            else if (o->depth[t] != nd) {
+                return 0;
+            }
+        }
+    }
+
+    return 1;
+}
+
+
+// compute opstack depths, barriers and operand producers for a function. returns 0 if it can't be analyzed
+static int s_analyze(qvmopt_t* o, int start, int end) {
+    for (int i = start; i < end; i++) {
+        o->depth[i] = -1;
+        o->barrier[i] = 0;
+        o->arg0[i] = o->arg1[i] = -1;
+        o->consumer[i] = o->slot[i] = -1;
+    }
+
+    if (!s_propagate(o, start, end, start, 0))
+        return 0;
+    // anything left can only be entered by an indirect jump
+    for (int i = start; i < end; i++) {
+        if (!o->ir[i].dead && o->depth[i] < 0 && o->ir[i].home && o->candidate[o->ir[i].orig] && !s_propagate(o, start, end, i, 0))
+            return 0;
+    }
+
+    o->barrier[start] = 1;
+    for (int i = start; i < end; i++) {
+        if (o->ir[i].dead || o->depth[i] < 0)
+            continue;
+        if (o->ir[i].home && o->candidate[o->ir[i].orig] && o->depth[i] == 0)
+            o->barrier[i] = 1;
+        if (s_isbranch(o->ir[i].op) || o->ir[i].op == QVM_OP_JUMPD)
+            o->barrier[s_live(o, o->ir[i].param, end)] = 1;
+    }
+
+    // simulate the opstack between barriers to find operand producers and consumers
+    int sp = 0;
+    int reset = 1;
+    for (int i = start; i < end; i++) {
+        if (o->ir[i].dead || o->depth[i] < 0)
+            continue;
+        if (reset || o->barrier[i]) {
+            sp = o->depth[i];
+            for (int k = 0; k < sp; k++)
+                o->stack[k] = -1;
+        }
+        reset = !s_fallsthrough(o->ir[i].op);
+
+        int pops, pushes;
+        s_stackeffect(o->ir[i].op, &pops, &pushes);
+        if (pops >= 1)
+            o->arg0[i] = o->stack[sp - 1];
+        if (pops >= 2)
+            o->arg1[i] = o->stack[sp - 2];
+        for (int k = 0; k < pops; k++) {
+            int p = o->stack[--sp];
+            if (p >= 0) {
+                o->consumer[p] = i;
+                o->slot[p] = k;
+            }
+        }
+        for (int k = 0; k < pushes; k++)
+            o->stack[sp++] = i;
+    }
+
+    return 1;
+}
+
+
+// fold a binary operation on constants. returns 0 if it can't be folded
+static int s_fold_binary(int op, int a, int b, int* r) {
+    switch (op) {
+    case QVM_OP_ADD:  *r = (int)((unsigned int)a + (unsigned int)b); return 1;
+    case QVM_OP_SUB:  *r = (int)((unsigned int)a - (unsigned int)b); return 1;
+    case QVM_OP_MULI: *r = (int)((unsigned int)a * (unsigned int)b); return 1;
+    case QVM_OP_MULU: *r = (int)((unsigned int)a * (unsigned int)b); return 1;
+    case QVM_OP_DIVI: if (!b || (a == (int)0x80000000 && b == -1)) return 0; *r = a / b; return 1;
+    case QVM_OP_MODI: if (!b || (a == (int)0x80000000 && b == -1)) return 0; *r = a % b; return 1;
+    case QVM_OP_DIVU: if (!b) return 0; *r = (int)((unsigned int)a / (unsigned int)b); return 1;
+    case QVM_OP_MODU: if (!b) return 0; *r = (int)((unsigned int)a % (unsigned int)b); return 1;
+    case QVM_OP_BAND: *r = a & b; return 1;
+    case QVM_OP_BOR:  *r = a | b; return 1;
+    case QVM_OP_BXOR: *r = a ^ b; return 1;
+    // shift counts outside 0-31 are left to the interpreter
+    case QVM_OP_LSH:  if (b < 0 || b > 31) return 0; *r = (int)((unsigned int)a << b); return 1;
+    case QVM_OP_RSHI: if (b < 0 || b > 31) return 0; *r = a >> b; return 1;
+    case QVM_OP_RSHU: if (b < 0 || b > 31) return 0; *r = (int)((unsigned int)a >> b); return 1;
+    case QVM_OP_ADDF: *r = s_i(s_f(a) + s_f(b)); return 1;
+    case QVM_OP_SUBF: *r = s_i(s_f(a) - s_f(b)); return 1;
+    case QVM_OP_MULF: *r = s_i(s_f(a) * s_f(b)); return 1;
+    case QVM_OP_DIVF: if (b == 0 || b == (int)0x80000000) return 0; *r = s_i(s_f(a) / s_f(b)); return 1;
+    default: return 0;
+    }
+}
+
+
+// fold a unary operation on a constant. returns 0 if it can't be folded
+static int s_fold_unary(int op, int a, int* r) {
+    switch (op) {
+    case QVM_OP_NEGI:  *r = (int)(0u - (unsigned int)a); return 1;
+    case QVM_OP_BCOM:  *r = ~a; return 1;
+    case QVM_OP_SEX8:  *r = (a & 0x80) ? (int)((unsigned int)a | 0xFFFFFF00) : a; return 1;
+    case QVM_OP_SEX16: *r = (a & 0x8000) ? (int)((unsigned int)a | 0xFFFF0000) : a; return 1;
+    case QVM_OP_NEGF:  *r = s_i(-s_f(a)); return 1;
+    case QVM_OP_CVIF:  *r = s_i((float)a); return 1;
+    // float->int conversion of out-of-range values is left to the interpreter
+    case QVM_OP_CVFI:  if (!(s_f(a) > -2147483648.0f && s_f(a) < 2147483648.0f)) return 0; *r = (int)s_f(a); return 1;
+    default: return 0;
+    }
+}
+
+
+// evaluate a branch on constants
+static int s_fold_branch(int op, int a, int b) {
+    unsigned int ua = (unsigned int)a, ub = (unsigned int)b;
+    float fa = s_f(a), fb = s_f(b);
+    switch (op) {
+    case QVM_OP_EQ:  return a == b;
+    case QVM_OP_NE:  return a != b;
+    case QVM_OP_LTI: return a < b;
+    case QVM_OP_LEI: return a <= b;
+    case QVM_OP_GTI: return a > b;
+    case QVM_OP_GEI: return a >= b;
+    case QVM_OP_LTU: return ua < ub;
+    case QVM_OP_LEU: return ua <= ub;
+    case QVM_OP_GTU: return ua > ub;
+    case QVM_OP_GEU: return ua >= ub;
+    case QVM_OP_EQF: return fa == fb;
+    case QVM_OP_NEF: return fa != fb;
+    case QVM_OP_LTF: return fa < fb;
+    case QVM_OP_LEF: return fa <= fb;
+    case QVM_OP_GTF: return fa > fb;
+    case QVM_OP_GEF: return fa >= fb;
+    default: return 0;
+    }
+}
+
+
+// is node p a constant which can be removed or rewritten in this sweep
+static int s_isconst(const qvmopt_t* o, int p) {
+    return p >= 0 && !o->touched[p] && o->ir[p].op == QVM_OP_CONST;
+}
+
+
+static void s_kill(qvmopt_t* o, int i) {
+    o->ir[i].dead = 1;
+    o->touched[i] = 1;
+}
+
+
+// one pass of peephole-style folding over a function. returns number of changes
+static int s_sweep(qvmopt_t* o, int start, int end) {
+    int changes = 0;
+
+    for (int i = start; i < end; i++)
+        o->touched[i] = 0;
+
+    for (int i = start; i < end; i++) {
+        qvmir_t* ir = &o->ir[i];
+        if (ir->dead || o->touched[i])
+            continue;
+
+        // unreachable
+        if (o->depth[i] < 0) {
+            s_kill(o, i);
+            changes++;
+            continue;
+        }
+
+        int p0 = o->arg0[i], p1 = o->arg1[i];
+        int r;
+        int pops, pushes;
+        s_stackeffect(ir->op, &pops, &pushes);
+
+        if (pops == 2 && pushes == 1) {
+            // constant arithmetic: CONST a; CONST b; op -> CONST r
+            if (s_isconst(o, p0) && s_isconst(o, p1) && s_fold_binary(ir->op, o->ir[p1].param, o->ir[p0].param, &r)) {
+                o->ir[p1].param = r;
+                o->touched[p1] = 1;
+                s_kill(o, p0);
+                s_kill(o, i);
+                changes++;
+            }
+        }
+        else if (pops == 1 && pushes == 1) {
+            // constant conversion/negation: CONST a; op -> CONST r (CALL and LOADx don't fold)
+            if (s_isconst(o, p0) && s_fold_unary(ir->op, o->ir[p0].param, &r)) {
+                o->ir[p0].param = r;
+                o->touched[p0] = 1;
+                s_kill(o, i);
+                changes++;
+            }
+        }
+        else if (s_isbranch(ir->op)) {
+            // branch on constants: always -> JUMPD, never -> removed
+            if (s_isconst(o, p0) && s_isconst(o, p1)) {
+                if (s_fold_branch(ir->op, o->ir[p1].param, o->ir[p0].param)) {
+                    ir->op = QVM_OP_JUMPD;
+                    o->touched[i] = 1;
+                }
+                else {
+                    s_kill(o, i);
+                }
+                s_kill(o, p0);
+                s_kill(o, p1);
+                changes++;
+            }
+        }
+        else if (ir->op == QVM_OP_JUMP) {
+            // CONST x; JUMP -> JUMPD x (if x is an instruction in this function with a matching opstack depth)
+            if (s_isconst(o, p0)) {
+                int t = o->ir[p0].param;
+                t = (t >= 0 && t < o->origcount) ? o->homeof[t] : -1;
+                if (t >= start && t < end) {
+                    int lt = s_live(o, t, end);
+                    if (lt < end && o->depth[lt] == o->depth[i] - 1) {
+                        ir->op = QVM_OP_JUMPD;
+                        ir->param = t;
+                        o->touched[i] = 1;
+                        s_kill(o, p0);
+                        changes++;
+                    }
+                }
+            }
+        }
+        else if (ir->op == QVM_OP_JUMPD) {
+            // jump to the next instruction
+            if (s_live(o, i + 1, end) == s_live(o, ir->param, end)) {
+                s_kill(o, i);
+                changes++;
+            }
+        }
+        else if (ir->op == QVM_OP_POP) {
+            // value pushed just to be popped
+            if (p0 >= 0 && !o->touched[p0] &&
+                (o->ir[p0].op == QVM_OP_CONST || o->ir[p0].op == QVM_OP_LOCAL || o->ir[p0].op == QVM_OP_PUSH)) {
+                s_kill(o, p0);
+                s_kill(o, i);
+                changes++;
+            }
+        }
+    }
+
+    return changes;
+}
+
+
+static int s_loadstoresize(int op) {
+    switch (op) {
+    case QVM_OP_LOAD1: case QVM_OP_STORE1: return 1;
+    case QVM_OP_LOAD2: case QVM_OP_STORE2: return 2;
+    case QVM_OP_LOAD4: case QVM_OP_STORE4: return 4;
+    default: return 0;
+    }
+}
+
+
+// remove stores to locals which are never loaded. returns number of changes
+static int s_deadstores(qvmopt_t* o, int start, int end) {
+    int framesize = o->ir[start].param;
+    int argend = 8;
+    int changes = 0;
+
+    // every QVM_OP_LOCAL must be used directly as a load/store address, otherwise a local's address escapes
+    for (int i = start; i < end; i++) {
+        qvmir_t* ir = &o->ir[i];
+        if (ir->dead || o->depth[i] < 0)
+            continue;
+        if (ir->op == QVM_OP_ARG && ir->param + 4 > argend)
+            argend = ir->param + 4;
+        if (ir->op != QVM_OP_LOCAL)
+            continue;
+        int c = o->consumer[i];
+        if (c < 0)
+            return 0;
+        int cop = o->ir[c].op;
+        if (!((cop == QVM_OP_LOAD1 || cop == QVM_OP_LOAD2 || cop == QVM_OP_LOAD4) && o->slot[i] == 0) &&
+            !((cop == QVM_OP_STORE1 || cop == QVM_OP_STORE2 || cop == QVM_OP_STORE4) && o->slot[i] == 1))
+            return 0;
+    }
+
+    for (int i = start; i < end; i++) {
+        qvmir_t* ir = &o->ir[i];
+        if (ir->dead || o->depth[i] < 0 || ir->op != QVM_OP_LOCAL)
+            continue;
+        int c = o->consumer[i];
+        int size = s_loadstoresize(o->ir[c].op);
+        int offset = ir->param;
+        if (o->ir[c].op < QVM_OP_STORE1 || o->ir[c].op > QVM_OP_STORE4)
+            continue;
+        // only the function's own locals (not outgoing call args, and not the caller's frame)
+        if (offset < argend || offset + size > framesize)
+            continue;
+
+        int loaded = 0;
+        for (int k = start; k < end && !loaded; k++) {
+            qvmir_t* l = &o->ir[k];
+            if (l->dead || o->depth[k] < 0 || l->op != QVM_OP_LOCAL)
+                continue;
+            int lc = o->consumer[k];
+            int lsize = s_loadstoresize(o->ir[lc].op);
+            if (o->ir[lc].op >= QVM_OP_LOAD1 && o->ir[lc].op <= QVM_OP_LOAD4 &&
+                l->param < offset + size && offset < l->param + lsize)
+                loaded = 1;
+        }
+        if (loaded)
+            continue;
+
+        // LOCAL x; <value>; STOREx -> <value>; POP
+        ir->dead = 1;
+        o->ir[c].op = QVM_OP_POP;
+        o->ir[c].param = 0;
+        changes++;
+    }
+
+    return changes;
+}
+
+
+static void s_optimize_function(qvmopt_t* o, int start, int end) {
+    // bound the number of sweeps, each one is linear in the function size
+    for (int sweep = 0; sweep < 64; sweep++) {
+        if (!s_analyze(o, start, end))
+            return;
+        if (s_sweep(o, start, end))
+            continue;
+        if (!s_deadstores(o, start, end))
+            return;
+    }
+}
+
+
+// can function [start, end) be spliced into its callers
+static int s_inlineable(const qvmopt_t* o, int start, int end) {
+    int framesize = o->ir[start].param;
+
+    if (end - start - 1 > QVM_INLINE_MAX_INSTRUCTIONS || framesize < 8 || framesize > QVM_INLINE_MAX_FRAMESIZE || (framesize & 3))
+        return 0;
+    if (o->ir[end - 1].op != QVM_OP_LEAVE)
+        return 0;
+
+    for (int i = start + 1; i < end; i++) {
+        const qvmir_t* ir = &o->ir[i];
+        switch (ir->op) {
+        // leaf functions only. an indirect jump would land in the original function, not the copy
+        case QVM_OP_UNDEF: case QVM_OP_ENTER: case QVM_OP_CALL: case QVM_OP_ARG: case QVM_OP_JUMP:
+            return 0;
+        case QVM_OP_LEAVE:
+            if (ir->param != framesize)
+                return 0;
+            break;
+        case QVM_OP_LOCAL:
+            // the callee's RII/frame size slots, and the caller's, don't exist once inlined
+            if (ir->param < 8 || (ir->param >= framesize && ir->param < framesize + 8))
+                return 0;
+            break;
+        default:
+            if (s_isbranch(ir->op) && (ir->param <= start || ir->param >= end))
+                return 0;
+            break;
+        }
+    }
+
+    return 1;
+}
+
+
+/* Splice small leaf functions into their callers at "QVM_OP_CONST func; QVM_OP_CALL"
+ *
+ * A caller's frame grows by K bytes (the largest frame of any function inlined into it). The header and outgoing
+ * call args stay at the start of the frame, so non-inlined callees still find their args at programstack+8:
+ *
+ *   original: | RII | size | call args   | locals     || caller's args...
+ *   inlined:  | RII | size | call args   | callee (K) | locals     || caller's args...
+ *
+ * The caller's own QVM_OP_LOCAL offsets past the call args move up by K. In the copied callee body, local
+ * offsets are placed in the K area, and args (which were in the caller's call args area, just above the callee
+ * frame) become offsets into the call args area directly. The QVM_OP_ENTER, the final QVM_OP_LEAVE and the
+ * QVM_OP_CONST/QVM_OP_CALL pair are removed, and any earlier QVM_OP_LEAVE jumps to the end of the copy.
+ *
+ * Returns 0 on allocation failure.
+ */
+static int s_inline(qvmopt_t* o) {
+    int n = o->count;
+    int ret = 0;
+    int added = 0;
+    int pos = 0;
+    qvmir_t* ir = NULL;
+    int* funcend = (int*)calloc(n, sizeof(int));    // end of the function starting at each QVM_OP_ENTER
+    char* inlineable = (char*)calloc(n, 1);
+    char* target = (char*)calloc(n, 1);             // direct branch target
+    char* site = (char*)calloc(n, 1);               // QVM_OP_CONST of an inlined call
+    int* grow = (int*)calloc(n, sizeof(int));       // K for each caller
+    int* argend = (int*)calloc(n, sizeof(int));     // end of call args area for each caller
+    int* oldtonew = (int*)malloc(n * sizeof(int));
+    if (!funcend || !inlineable || !target || !site || !grow || !argend || !oldtonew)
+        goto done;
+
+    for (int start = 0; start < n; ) {
+        int end = start + 1;
+        while (end < n && o->ir[end].op != QVM_OP_ENTER)
+            end++;
+        funcend[start] = end;
+        if (o->ir[start].op == QVM_OP_ENTER)
+            inlineable[start] = (char)s_inlineable(o, start, end);
+        start = end;
+    }
+    for (int i = 0; i < n; i++) {
+        if (s_isbranch(o->ir[i].op) && o->ir[i].param >= 0 && o->ir[i].param < n)
+            target[o->ir[i].param] = 1;
+    }
+
+    // find call sites
+    for (int start = 0; start < n; start = funcend[start]) {
+        int end = funcend[start];
+        int k = 0;
+        int a = 8;
+        if (o->ir[start].op != QVM_OP_ENTER)
+            continue;
+        for (int i = start; i < end; i++) {
+            if (o->ir[i].op == QVM_OP_ARG && o->ir[i].param + 4 > a)
+                a = o->ir[i].param + 4;
+        }
+        if (a > o->ir[start].param)
+            continue;
+
+        for (int i = start + 1; i + 1 < end; i++) {
+            int f = o->ir[i].param;
+            if (o->ir[i].op != QVM_OP_CONST || o->ir[i + 1].op != QVM_OP_CALL || target[i + 1] ||
+                f < 0 || f >= n || !inlineable[f] || f == start)
+                continue;
+            // don't more than double the code size
+            int len = funcend[f] - f - 1;
+            if (added + len > n)
+                continue;
+            added += len;
+            site[i] = 1;
+            if (o->ir[f].param > k)
+                k = o->ir[f].param;
+        }
+        grow[start] = k;
+        argend[start] = a;
+    }
+    if (!added) {
+        ret = 1;
+        goto done;
+    }
+
+    // new index of each home instruction
+    for (int i = 0; i < n; i++) {
+        oldtonew[i] = pos++;
+        if (site[i]) {
+            oldtonew[++i] = pos++;
+            pos += funcend[o->ir[i - 1].param] - o->ir[i - 1].param - 1;
+        }
+    }
+
+    ir = (qvmir_t*)malloc((n + added) * sizeof(qvmir_t));
+    if (!ir)
+        goto done;
+
+    pos = 0;
+    for (int i = 0, caller = 0; i < n; i++) {
+        qvmir_t* src = &o->ir[i];
+        qvmir_t* dst = &ir[pos++];
+        int k, a;
+
+        if (src->op == QVM_OP_ENTER)
+            caller = i;
+        k = grow[caller];
+        a = argend[caller];
+
+        *dst = *src;
+        dst->home = 1;
+        if (s_isbranch(src->op) && src->param >= 0 && src->param < n)
+            dst->param = oldtonew[src->param];
+        else if (src->op == QVM_OP_ENTER || src->op == QVM_OP_LEAVE)
+            dst->param += k;
+        else if (src->op == QVM_OP_LOCAL && src->param >= a)
+            dst->param += k;
+
+        if (!site[i])
+            continue;
+
+        // QVM_OP_CONST and QVM_OP_CALL are removed, so anything that jumps to them lands on the copy
+        int f = src->param;
+        int framesize = o->ir[f].param;
+        int base = pos + 1;
+        int len = funcend[f] - f - 1;
+        dst->dead = 1;
+        ir[pos] = o->ir[++i];
+        ir[pos].home = 1;
+        ir[pos].dead = 1;
+        pos++;
+
+        for (int j = f + 1; j < funcend[f]; j++) {
+            qvmir_t* copy = &ir[pos++];
+            *copy = o->ir[j];
+            copy->home = 0;
+            if (s_isbranch(copy->op)) {
+                copy->param = base + (copy->param - f - 1);
+            }
+            else if (copy->op == QVM_OP_LOCAL) {
+                copy->param = copy->param < framesize ? a + copy->param : copy->param - framesize;
+            }
+            else if (copy->op == QVM_OP_LEAVE) {
+                if (j == funcend[f] - 1) {
+                    copy->dead = 1;
+                }
+                else {
+                    copy->op = QVM_OP_JUMPD;
+                    copy->param = base + len;
+                }
+            }
+        }
+    }
+
+    free(o->ir);
+    o->ir = ir;
+    o->count = n + added;
+    for (int i = 0; i < o->count; i++) {
+        if (o->ir[i].home)
+            o->homeof[o->ir[i].orig] = i;
+    }
+    ret = 1;
+
+done:
+    free(funcend);
+    free(inlineable);
+    free(target);
+    free(site);
+    free(grow);
+    free(argend);
+    free(oldtonew);
+    return ret;
+}
+
+
+size_t qvm_optimize(qvmop_t** code, int** origindex, int* codemap, size_t instructioncount, const uint8_t* data, size_t datalen, int flags) {
+    qvmopt_t o;
+    size_t newcount = 0;
+    int n = (int)instructioncount;
+    qvmop_t* newcode = NULL;
+    int* neworigindex = NULL;
+    int* newindex = NULL;
+
+    memset(&o, 0, sizeof(o));
+    o.count = n;
+    o.origcount = n;
+    o.ir = (qvmir_t*)malloc(n * sizeof(qvmir_t));
+    o.homeof = (int*)malloc(n * sizeof(int));
+    o.candidate = (char*)calloc(n, 1);
+    if (!o.ir || !o.homeof || !o.candidate)
+        goto done;
+
+    for (int i = 0; i < n; i++) {
+        o.ir[i].op = (*code)[i].op;
+        o.ir[i].param = (*code)[i].param;
+        o.ir[i].orig = (*origindex)[i];
+        o.ir[i].home = 1;
+        o.ir[i].dead = 0;
+        o.homeof[i] = i;
+        if (o.ir[i].op == QVM_OP_CONST && o.ir[i].param >= 0 && o.ir[i].param < n)
+            o.candidate[o.ir[i].param] = 1;
+    }
+    for (size_t a = 0; a + 4 <= datalen; a += 4) {
+        int v;
+        memcpy(&v, data + a, sizeof(v));
+        if (v >= 0 && v < n)
+            o.candidate[v] = 1;
+    }
+
+    if ((flags & QVM_LOAD_INLINE) && !s_inline(&o))
+        goto done;
+
+    // everything past here works on the (possibly larger) inlined code
+    n = o.count;
+    o.depth = (int*)malloc(n * sizeof(int));
+    o.barrier = (char*)malloc(n);
+    o.arg0 = (int*)malloc(n * sizeof(int));
+    o.arg1 = (int*)malloc(n * sizeof(int));
+    o.consumer = (int*)malloc(n * sizeof(int));
+    o.slot = (int*)malloc(n * sizeof(int));
+    o.worklist = (int*)malloc(n * sizeof(int));
+    o.stack = (int*)malloc((QVM_OPSTACK_SIZE + 1) * sizeof(int));
+    o.touched = (char*)malloc(n);
+    newcode = (qvmop_t*)malloc(n * sizeof(qvmop_t));
+    neworigindex = (int*)malloc(n * sizeof(int));
+    newindex = (int*)malloc((n + 1) * sizeof(int));
+    if (!o.depth || !o.barrier || !o.arg0 || !o.arg1 || !o.consumer || !o.slot ||
+        !o.worklist || !o.stack || !o.touched || !newcode || !neworigindex || !newindex)
+        goto done;
+
+    for (int start = 0; start < n; ) {
+        int end = start + 1;
+        while (end < n && o.ir[end].op != QVM_OP_ENTER)
+            end++;
+        if (o.ir[start].op == QVM_OP_ENTER)
+            s_optimize_function(&o, start, end);
+        start = end;
+    }
+
+    // assign new indices. a removed instruction gets the index of the next remaining one
+    for (int i = 0, next = 0; i <= n; i++) {
+        newindex[i] = next;
+        if (i < n && !o.ir[i].dead)
+            next++;
+    }
+
+    for (int i = 0; i < n; i++) {
+        if (o.ir[i].dead)
+            continue;
+        qvmop_t* op = &newcode[newcount];
+        op->op = (qvmopcode_t)o.ir[i].op;
+        op->param = o.ir[i].param;
+        if (s_isbranch(op->op) || op->op == QVM_OP_JUMPD)
+            op->param = newindex[o.ir[i].param];
+        neworigindex[newcount] = o.ir[i].orig;
+        newcount++;
+    }
+    for (int i = 0; i < o.origcount; i++)
+        codemap[i] = newindex[o.homeof[i]];
+
+    free(*code);
+    free(*origindex);
+    *code = newcode;
+    *origindex = neworigindex;
+    newcode = NULL;
+    neworigindex = NULL;
+
+done:
+    free(o.ir);
+    free(o.homeof);
+    free(o.candidate);
+    free(o.depth);
+    free(o.barrier);
+    free(o.arg0);
+    free(o.arg1);
+    free(o.consumer);
+    free(o.slot);
+    free(o.worklist);
+    free(o.stack);
+    free(o.touched);
+    free(newcode);
+    free(neworigindex);
+    free(newindex);
+
+    return newcount;
+}
@@ -0,0 +1,357 @@
+/*
+SoF2GT_QMM - Hook gametype dlls/qvms for Soldier of Fortune 2
+Copyright 2025-2026
+https://github.com/thecybermind/sof2gt_qmm/
+3-clause BSD license: https://opensource.org/license/bsd-3-clause
+
+Created By:
+    Kevin Masterson < k.m.masterson@gmail.com >
+
+*/
+
+#include <stdint.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "qvm.h"
+#include "qvm_shadow.h"
+
+
+// grow an array so it can hold at least 'count' elements of 'size' bytes
+static int qvm_shadow_grow(void** array, size_t* cap, size_t count, size_t size) {
+    if (count <= *cap)
+        return 1;
+
+    size_t newcap = *cap ? *cap : 64;
+    while (newcap < count)
+        newcap *= 2;
+    void* newarray = realloc(*array, newcap * size);
+    if (!newarray)
+        return 0;
+    *array = newarray;
+    *cap = newcap;
+    return 1;
+}
+
+
+// start of the program stack (both copies have the same data segment layout)
+static size_t qvm_shadow_stackbase(qvm_shadow_t* sh) {
+    return sh->reference->dataseglen - sh->reference->stacksize;
+}
+
+
+// is a value an address in the program stack (these differ between the copies when functions were inlined)
+static int qvm_shadow_in_stack(qvm_shadow_t* sh, int value) {
+    return value >= (int)qvm_shadow_stackbase(sh) && value < (int)sh->reference->dataseglen;
+}
+
+
+// arguments used by a syscall
+static int qvm_shadow_numargs(qvm_shadow_t* sh, int cmd) {
+    int numargs = sh->numargs ? sh->numargs(cmd) : 0;
+    if (numargs < 0)
+        return 0;
+    return numargs > QVM_SHADOW_MAX_ARGS ? QVM_SHADOW_MAX_ARGS : numargs;
+}
+
+
+// FNV-1a digest of the data outside the program stack
+static uint64_t qvm_shadow_digest(qvm_shadow_t* sh, const uint8_t* membase) {
+    uint64_t hash = 14695981039346656037ULL;
+    size_t len = qvm_shadow_stackbase(sh);
+    for (size_t i = 0; i < len; i++) {
+        hash ^= membase[i];
+        hash *= 1099511628211ULL;
+    }
+    return hash;
+}
+
+
+// "function+offset (instruction)" for an original instruction index
+static const char* qvm_shadow_location(qvm_shadow_t* sh, int instr, char* buf, size_t len) {
+    int start = 0;
+    const char* func = sh->function ? sh->function(instr, &start) : NULL;
+    if (func)
+        snprintf(buf, len, "%s+%d (instruction %d)", func, instr - start, instr);
+    else
+        snprintf(buf, len, "instruction %d", instr);
+    return buf;
+}
+
+
+// "symbol+offset (address)" for a data segment address
+static const char* qvm_shadow_address(qvm_shadow_t* sh, int address, char* buf, size_t len) {
+    int offset = 0;
+    const char* name = sh->data ? sh->data(address, &offset) : NULL;
+    if (name)
+        snprintf(buf, len, "%s+%d (0x%x)", name, offset, address);
+    else
+        snprintf(buf, len, "0x%x", address);
+    return buf;
+}
+
+
+// first address outside the program stack where the two copies differ (-1 if none)
+static int qvm_shadow_first_difference(qvm_shadow_t* sh) {
+    size_t len = qvm_shadow_stackbase(sh);
+    for (size_t i = 0; i < len; i++) {
+        if (sh->reference->datasegment[i] != sh->shadow.datasegment[i])
+            return (int)i;
+    }
+    return -1;
+}
+
+
+// note the first divergence of the current call
+static void qvm_shadow_diverge(qvm_shadow_t* sh, const char* fmt, ...) {
+    if (sh->divergence[0])
+        return;
+    va_list argptr;
+    va_start(argptr, fmt);
+    vsnprintf(sh->divergence, sizeof(sh->divergence), fmt, argptr);
+    va_end(argptr);
+}
+
+
+// store the data segment bytes changed by a syscall. writes into the program stack are only kept if they are in
+// live stack frames (above the caller's stack pointer), the rest is left over from nested calls
+static int qvm_shadow_record_writes(qvm_shadow_t* sh, const uint8_t* membase, qvm_shadow_record_t* rec) {
+    rec->firstwrite = sh->numwrites;
+    size_t len = sh->reference->dataseglen;
+    size_t i = 0;
+    while (i < len) {
+        if (membase[i] == sh->before[i]) {
+            i++;
+            continue;
+        }
+        size_t start = i;
+        while (i < len && membase[i] != sh->before[i])
+            i++;
+        if (start >= qvm_shadow_stackbase(sh) && (int)start < rec->stackptr)
+            continue;
+        if (!qvm_shadow_grow((void**)&sh->writes, &sh->writecap, sh->numwrites + 1, sizeof(qvm_shadow_write_t)) ||
+            !qvm_shadow_grow((void**)&sh->bytes, &sh->bytecap, sh->numbytes + (i - start), 1))
+            return 0;
+        qvm_shadow_write_t* write = &sh->writes[sh->numwrites++];
+        write->offset = (int)start;
+        write->len = (int)(i - start);
+        write->bytes = sh->numbytes;
+        memcpy(sh->bytes + sh->numbytes, membase + start, i - start);
+        sh->numbytes += i - start;
+    }
+    rec->numwrites = sh->numwrites - rec->firstwrite;
+    return 1;
+}
+
+
+// replay the writes of a recorded syscall into the shadow. writes into the program stack are moved by the difference
+// between the stack pointer arguments of the two copies
+static void qvm_shadow_replay_writes(qvm_shadow_t* sh, const qvm_shadow_record_t* rec, const int* args) {
+    int numargs = qvm_shadow_numargs(sh, rec->cmd);
+    for (size_t w = rec->firstwrite; w < rec->firstwrite + rec->numwrites; w++) {
+        const qvm_shadow_write_t* write = &sh->writes[w];
+        int offset = write->offset;
+        if (qvm_shadow_in_stack(sh, offset)) {
+            int arg = -1;
+            for (int i = 0; i < numargs; i++) {
+                if (qvm_shadow_in_stack(sh, rec->args[i]) && rec->args[i] <= offset && (arg < 0 || rec->args[i] > rec->args[arg]))
+                    arg = i;
+            }
+            if (arg < 0)
+                continue;
+            offset = offset - rec->args[arg] + args[arg];
+        }
+        if (offset < 0 || (size_t)offset + write->len > sh->shadow.dataseglen)
+            continue;
+        memcpy(sh->shadow.datasegment + offset, sh->bytes + write->bytes, write->len);
+    }
+}
+
+
+// syscall handler for the shadow copy: replay the recorded syscalls
+static int qvm_shadow_replay_syscall(qvm_t* qvm, uint8_t* membase, int cmd, int* args) {
+    qvm_shadow_t* sh = (qvm_shadow_t*)qvm->userdata;
+    int instr = qvm->origindex[qvm->trapinstr];
+    char loc1[256], loc2[256];
+
+    if (!sh->divergence[0]) {
+        if (sh->replay >= sh->numrecords) {
+            qvm_shadow_diverge(sh, "shadow made an extra syscall %d (cmd %d) at %s", (int)sh->replay, cmd, qvm_shadow_location(sh, instr, loc2, sizeof(loc2)));
+        }
+        else {
+            const qvm_shadow_record_t* rec = &sh->records[sh->replay];
+            if (rec->cmd != cmd) {
+                qvm_shadow_diverge(sh, "syscall %d is cmd %d at %s, shadow made cmd %d at %s", (int)sh->replay, rec->cmd, qvm_shadow_location(sh, rec->instr, loc1, sizeof(loc1)), cmd, qvm_shadow_location(sh, instr, loc2, sizeof(loc2)));
+            }
+            else if (rec->digest != qvm_shadow_digest(sh, membase)) {
+                qvm_shadow_diverge(sh, "data differs before syscall %d (cmd %d) at %s, shadow at %s", (int)sh->replay, cmd, qvm_shadow_location(sh, rec->instr, loc1, sizeof(loc1)), qvm_shadow_location(sh, instr, loc2, sizeof(loc2)));
+            }
+            else {
+                for (int i = 0; i < qvm_shadow_numargs(sh, cmd); i++) {
+                    if (!qvm_shadow_in_stack(sh, rec->args[i]) && rec->args[i] != args[i]) {
+                        qvm_shadow_diverge(sh, "syscall %d (cmd %d) at %s has argument %d = %d, shadow at %s has %d", (int)sh->replay, cmd, qvm_shadow_location(sh, rec->instr, loc1, sizeof(loc1)), i, rec->args[i], qvm_shadow_location(sh, instr, loc2, sizeof(loc2)), args[i]);
+                        break;
+                    }
+                }
+            }
+        }
+    }
+
+    // once the calls no longer line up, the shadow just runs to the end of the call
+    if (sh->divergence[0] || sh->replay >= sh->numrecords)
+        return 0;
+
+    const qvm_shadow_record_t* rec = &sh->records[sh->replay++];
+    sh->syscalls++;
+    qvm_shadow_replay_writes(sh, rec, args);
+    return rec->ret;
+}
+
+
+int qvm_shadow_load(qvm_shadow_t* sh, qvm_t* reference, const uint8_t* filemem, size_t filesize, vmsyscall_t syscall, int flags, qvm_alloc_t* allocator) {
+    qvm_shadow_unload(sh);
+
+    // the reference passes syscalls on even if there is no shadow copy
+    sh->syscall = syscall;
+    reference->userdata = sh;
+    sh->shadow.userdata = sh;
+    if (!qvm_load(&sh->shadow, filemem, filesize, qvm_shadow_replay_syscall, flags, allocator))
+        return 0;
+    if (sh->shadow.dataseglen != reference->dataseglen || sh->shadow.stacksize != reference->stacksize) {
+        qvm_unload(&sh->shadow);
+        return 0;
+    }
+
+    sh->before = (uint8_t*)malloc(reference->dataseglen);
+    if (!sh->before) {
+        qvm_unload(&sh->shadow);
+        return 0;
+    }
+    sh->reference = reference;
+    // start both copies from the same state
+    memcpy(sh->shadow.datasegment, reference->datasegment, qvm_shadow_stackbase(sh));
+    return 1;
+}
+
+
+void qvm_shadow_unload(qvm_shadow_t* sh) {
+    qvm_unload(&sh->shadow);
+    sh->reference = NULL;
+    free(sh->records);
+    free(sh->writes);
+    free(sh->bytes);
+    free(sh->before);
+    sh->records = NULL;
+    sh->writes = NULL;
+    sh->bytes = NULL;
+    sh->before = NULL;
+    sh->numrecords = sh->recordcap = 0;
+    sh->numwrites = sh->writecap = 0;
+    sh->numbytes = sh->bytecap = 0;
+    sh->recording = 0;
+    sh->insyscall = 0;
+}
+
+
+int qvm_shadow_loaded(qvm_shadow_t* sh) {
+    return sh->reference && sh->shadow.memory;
+}
+
+
+int qvm_shadow_syscall(qvm_t* qvm, uint8_t* membase, int cmd, int* args) {
+    qvm_shadow_t* sh = (qvm_shadow_t*)qvm->userdata;
+
+    // syscalls from nested calls into the reference (during one of its syscalls) are part of the outer syscall
+    if (!sh->recording || sh->insyscall)
+        return sh->syscall(qvm, membase, cmd, args);
+
+    qvm_shadow_record_t rec;
+    memset(&rec, 0, sizeof(rec));
+    rec.cmd = cmd;
+    rec.instr = qvm->origindex[qvm->trapinstr];
+    rec.stackptr = (int)((uint8_t*)(args - 2) - membase);
+    for (int i = 0; i < qvm_shadow_numargs(sh, cmd); i++)
+        rec.args[i] = args[i];
+    rec.digest = qvm_shadow_digest(sh, membase);
+    memcpy(sh->before, membase, sh->reference->dataseglen);
+
+    sh->insyscall = 1;
+    rec.ret = sh->syscall(qvm, membase, cmd, args);
+    sh->insyscall = 0;
+
+    // a nested call may have hit a run-time error and unloaded the reference. if the syscall can't be recorded, the
+    // call isn't compared
+    if (!sh->reference->memory || !qvm_shadow_record_writes(sh, membase, &rec) ||
+        !qvm_shadow_grow((void**)&sh->records, &sh->recordcap, sh->numrecords + 1, sizeof(qvm_shadow_record_t))) {
+        sh->recording = 0;
+        return rec.ret;
+    }
+
+    sh->records[sh->numrecords++] = rec;
+    return rec.ret;
+}
+
+
+int qvm_shadow_exec(qvm_shadow_t* sh, int addr, int argc, int* argv, int* diverged) {
+    if (diverged)
+        *diverged = 0;
+
+    // nested calls (from a syscall during a shadowed call) only run on the reference, their changes to the data
+    // segment are recorded as part of the syscall
+    if (sh->recording || sh->insyscall || !qvm_shadow_loaded(sh)) {
+        if (!sh->reference)
+            return 0;
+        return addr < 0 ? qvm_exec(sh->reference, argc, argv) : qvm_call(sh->reference, addr, argc, argv);
+    }
+
+    sh->numrecords = 0;
+    sh->numwrites = 0;
+    sh->numbytes = 0;
+    sh->replay = 0;
+    sh->divergence[0] = '\0';
+
+    // the reference's data may have been changed between calls by its owner (e.g. plugins writing QVM memory). the
+    // shadow compared equal after the last call, so mirror any such changes before running
+    size_t stackbase = qvm_shadow_stackbase(sh);
+    if (memcmp(sh->reference->datasegment, sh->shadow.datasegment, stackbase)) {
+        memcpy(sh->shadow.datasegment, sh->reference->datasegment, stackbase);
+        sh->mirrored++;
+    }
+
+    sh->recording = 1;
+    int ret = addr < 0 ? qvm_exec(sh->reference, argc, argv) : qvm_call(sh->reference, addr, argc, argv);
+    int complete = sh->recording;
+    sh->recording = 0;
+    if (!complete || !sh->reference->memory)
+        return ret;
+
+    int shadowret = addr < 0 ? qvm_exec(&sh->shadow, argc, argv) : qvm_call(&sh->shadow, addr, argc, argv);
+    sh->calls++;
+
+    char loc[256];
+    if (!sh->shadow.memory) {
+        qvm_shadow_diverge(sh, "shadow QVM had a run-time error, shadow execution stopped");
+    }
+    else {
+        if (sh->replay < sh->numrecords)
+            qvm_shadow_diverge(sh, "shadow made %d of %d syscalls, next is cmd %d at %s", (int)sh->replay, (int)sh->numrecords, sh->records[sh->replay].cmd, qvm_shadow_location(sh, sh->records[sh->replay].instr, loc, sizeof(loc)));
+        if (shadowret != ret)
+            qvm_shadow_diverge(sh, "returned %d, shadow returned %d", ret, shadowret);
+        int address = qvm_shadow_first_difference(sh);
+        if (address >= 0) {
+            qvm_shadow_diverge(sh, "data differs after the call at %s", qvm_shadow_address(sh, address, loc, sizeof(loc)));
+            // carry on from the reference's state so the next divergence isn't just this one again
+            memcpy(sh->shadow.datasegment, sh->reference->datasegment, stackbase);
+        }
+    }
+
+    if (sh->divergence[0]) {
+        sh->divergences++;
+        snprintf(sh->last, sizeof(sh->last), "%s(%d): %s", addr < 0 ? "vmMain" : "function", addr < 0 ? (argc > 0 && argv ? argv[0] : 0) : addr, sh->divergence);
+        if (diverged)
+            *diverged = 1;
+    }
+
+    return ret;
+}
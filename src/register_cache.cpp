@@ -0,0 +1,201 @@
+/*
+SoF2GT_QMM - Hook gametype dlls/qvms for Soldier of Fortune 2
+Copyright 2025-2026
+https://github.com/thecybermind/sof2gt_qmm/
+3-clause BSD license: https://opensource.org/license/bsd-3-clause
+
+Created By:
+	Kevin Masterson < k.m.masterson@gmail.com >
+
+*/
+
+#define _CRT_SECURE_NO_WARNINGS 1
+
+#include <qmmapi.h>
+
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <unordered_map>
+
+#include "game.h"
+#include "util.h"
+#include "register_cache.h"
+
+// a memoized registration
+struct register_entry_t {
+	intptr_t ret;
+	unsigned int restarts;	// s_restarts when this was registered or last validated
+};
+
+// keyed by cmd and the registration arguments (see s_key)
+static std::unordered_map<std::string, register_entry_t> s_entries;
+static unsigned int s_restarts = 0;
+static bool s_enabled = false;
+
+// registration/duplicate counts for each cached syscall
+struct register_stat_t {
+	intptr_t cmd;
+	const char* name;
+	unsigned long long registered;	// reached the engine
+	unsigned long long duplicates;	// served from the cache
+	unsigned long long stale;		// cached handle was no longer valid after a GT_RESTART
+};
+static register_stat_t s_stats[] = {
+	{ GT_REGISTERSOUND, "GT_REGISTERSOUND", 0, 0, 0 },
+	{ GT_REGISTEREFFECT, "GT_REGISTEREFFECT", 0, 0, 0 },
+	{ GT_REGISTERICON, "GT_REGISTERICON", 0, 0, 0 },
+	{ GT_REGISTERITEM, "GT_REGISTERITEM", 0, 0, 0 },
+	{ GT_REGISTERTRIGGER, "GT_REGISTERTRIGGER", 0, 0, 0 },
+};
+
+
+// get the stats slot of a registration syscall, or nullptr if it isn't one
+static register_stat_t* s_stat(intptr_t cmd) {
+	for (register_stat_t& stat : s_stats) {
+		if (stat.cmd == cmd)
+			return &stat;
+	}
+	return nullptr;
+}
+
+
+// build the key for a registration. returns false if this call can't be cached
+static bool s_key(intptr_t* args, std::string& key) {
+	key.assign((const char*)&args[0], sizeof(args[0]));
+
+	switch (args[0]) {
+	case GT_REGISTERSOUND:					// int  ( const char* filename );
+	case GT_REGISTEREFFECT:					// int	( const char* name );
+	case GT_REGISTERICON:					// int	( const char* icon );
+		if (!args[1])
+			return false;
+		key += (const char*)args[1];
+		return true;
+	case GT_REGISTERITEM:					// bool ( int itemid, const char* name, gtItemDef_t* def );
+	case GT_REGISTERTRIGGER:				// bool ( int trigid, const char* name, gtTriggerDef_t* def );
+		if (!args[2] || !args[3])
+			return false;
+		key.append((const char*)&args[1], sizeof(args[1]));
+		key.append((const char*)args[3], args[0] == GT_REGISTERITEM ? sizeof(gtItemDef_t) : sizeof(gtTriggerDef_t));
+		key += (const char*)args[2];
+		return true;
+	default:
+		return false;
+	}
+}
+
+
+// check that a handle from before a GT_RESTART still refers to the same name
+static bool s_validate(intptr_t* args, intptr_t ret) {
+	int base;
+	switch (args[0]) {
+	case GT_REGISTERSOUND:
+		base = CS_SOUNDS;
+		break;
+	case GT_REGISTEREFFECT:
+		base = CS_EFFECTS;
+		break;
+	case GT_REGISTERICON:
+		base = CS_ICONS;
+		break;
+	default:
+		// items and triggers live in the game module, register them again to be safe
+		return false;
+	}
+
+	char configstring[MAX_STRING_CHARS];
+	g_syscall(G_GET_CONFIGSTRING, base + (int)ret, configstring, sizeof(configstring));
+	return !strcmp(configstring, (const char*)args[1]);
+}
+
+
+// enable or disable the cache
+void register_cache_enable(bool enable) {
+	s_enabled = enable;
+	register_cache_clear();
+}
+
+
+// forget all handles
+void register_cache_clear() {
+	s_entries.clear();
+	s_restarts = 0;
+}
+
+
+// serve a registration syscall from the cache
+bool register_cache_lookup(intptr_t* args, intptr_t& ret) {
+	if (!s_enabled)
+		return false;
+
+	// handles need to be checked before they are used again
+	if (args[0] == GT_RESTART) {
+		s_restarts++;
+		return false;
+	}
+
+	register_stat_t* stat = s_stat(args[0]);
+	static std::string key;
+	if (!stat || !s_key(args, key))
+		return false;
+
+	auto it = s_entries.find(key);
+	if (it == s_entries.end())
+		return false;
+
+	register_entry_t& entry = it->second;
+	if (entry.restarts != s_restarts) {
+		if (!s_validate(args, entry.ret)) {
+			stat->stale++;
+			s_entries.erase(it);
+			return false;
+		}
+		entry.restarts = s_restarts;
+	}
+
+	stat->duplicates++;
+	ret = entry.ret;
+	return true;
+}
+
+
+// store the result of a registration syscall after it was made
+void register_cache_store(intptr_t* args, intptr_t ret) {
+	if (!s_enabled)
+		return;
+
+	register_stat_t* stat = s_stat(args[0]);
+	if (!stat)
+		return;
+	stat->registered++;
+
+	// 0 is an invalid handle (or failure for items/triggers), try again next time
+	static std::string key;
+	if (!ret || !s_key(args, key))
+		return;
+
+	s_entries[key] = { ret, s_restarts };
+}
+
+
+// registration/duplicate counts
+std::string register_cache_stats() {
+	std::string ret;
+	char line[160];
+	for (register_stat_t& stat : s_stats) {
+		snprintf(line, sizeof(line), "%s: %llu registered, %llu duplicates, %llu stale after restart\n", stat.name, stat.registered, stat.duplicates, stat.stale);
+		ret += line;
+	}
+	return ret;
+}
+
+
+// reset registration/duplicate counts
+void register_cache_reset_stats() {
+	for (register_stat_t& stat : s_stats) {
+		stat.registered = 0;
+		stat.duplicates = 0;
+		stat.stale = 0;
+	}
+}
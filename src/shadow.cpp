@@ -0,0 +1,114 @@
+/*
+SoF2GT_QMM - Hook gametype dlls/qvms for Soldier of Fortune 2
+Copyright 2025-2026
+https://github.com/thecybermind/sof2gt_qmm/
+3-clause BSD license: https://opensource.org/license/bsd-3-clause
+
+Created By:
+	Kevin Masterson < k.m.masterson@gmail.com >
+
+*/
+
+#define _CRT_SECURE_NO_WARNINGS 1
+
+#include <qmmapi.h>
+
+#include <string>
+
+#include "main.h"
+#include "game.h"
+#include "symbols.h"
+#include "qvm_shadow.h"
+#include "shadow.h"
+
+// only the first few divergences are logged, the rest are counted
+#define SHADOW_MAX_LOGGED	16
+
+static qvm_shadow_t s_shadow;
+
+
+// arguments used by each syscall, as converted by gt_qvm_syscall
+static int s_numargs(int cmd) {
+	switch (cmd) {
+	case GT_MILLISECONDS:
+		return 0;
+	case GT_SIN: case GT_COS: case GT_SQRT: case GT_FLOOR: case GT_CEIL: case GT_ACOS: case GT_ASIN:
+	case GT_RESETITEM: case GT_STARTGLOBALSOUND: case GT_RESTART:
+	case GT_PRINT: case GT_ERROR: case GT_CVAR_UPDATE: case GT_CVAR_VARIABLE_INTEGER_VALUE:
+	case GT_REGISTERSOUND: case GT_REGISTEREFFECT: case GT_REGISTERICON: case GT_USETARGETS:
+		return 1;
+	case GT_ATAN2: case GT_DOESCLIENTHAVEITEM: case GT_ADDTEAMSCORE: case GT_ADDCLIENTSCORE:
+	case GT_GIVECLIENTITEM: case GT_TAKECLIENTITEM: case GT_SETHUDICON:
+	case GT_TESTPRINTINT: case GT_TESTPRINTFLOAT:
+	case GT_TEXTMESSAGE: case GT_RADIOMESSAGE: case GT_GETCLIENTORIGIN: case GT_STARTSOUND:
+	case GT_CVAR_SET: case GT_PERPENDICULARVECTOR:
+		return 2;
+	case GT_MEMSET: case GT_MEMCPY: case GT_STRNCPY:
+	case GT_GETCLIENTNAME: case GT_GETCLIENTITEMS: case GT_GETTRIGGERTARGET: case GT_GETCLIENTLIST:
+	case GT_CVAR_VARIABLE_STRING_BUFFER:
+	case GT_REGISTERITEM: case GT_REGISTERTRIGGER: case GT_PLAYEFFECT: case GT_SPAWNITEM: case GT_MATRIXMULTIPLY:
+		return 3;
+	case GT_CVAR_REGISTER: case GT_ANGLEVECTORS:
+		return 4;
+	default:
+		return 0;
+	}
+}
+
+
+
+// name and first instruction of the function containing an instruction, from the .map file
+static const char* s_function(int instr, int* start) {
+	const char* func = symbols_function(instr);
+	if (func)
+		*start = symbols_find(func);
+	return func;
+}
+
+
+// load the shadow copy of a QVM
+bool shadow_load(qvm_t* reference, const uint8_t* filemem, size_t filesize, vmsyscall_t syscall, int flags, qvm_alloc_t* allocator) {
+	s_shadow.numargs = s_numargs;
+	s_shadow.function = s_function;
+	s_shadow.data = symbols_data;
+	return qvm_shadow_load(&s_shadow, reference, filemem, filesize, syscall, flags, allocator);
+}
+
+
+// unload the shadow copy
+void shadow_unload() {
+	qvm_shadow_unload(&s_shadow);
+}
+
+
+// is a shadow copy loaded
+bool shadow_loaded() {
+	return qvm_shadow_loaded(&s_shadow);
+}
+
+
+// syscall handler for the reference QVM: records syscalls made while shadowing, then passes them on
+int shadow_syscall(qvm_t* qvm, uint8_t* membase, int cmd, int* args) {
+	return qvm_shadow_syscall(qvm, membase, cmd, args);
+}
+
+
+// call vmMain or a function in the reference QVM, then in the shadow copy, and compare them
+int shadow_exec(int addr, int argc, int* argv) {
+	int diverged = 0;
+	int ret = qvm_shadow_exec(&s_shadow, addr, argc, argv, &diverged);
+	if (diverged && s_shadow.divergences <= SHADOW_MAX_LOGGED)
+		QMM_WRITEQMMLOG(PLID, QMM_VARARGS(PLID, "shadow: %s\n", s_shadow.last), QMMLOG_WARNING);
+	return ret;
+}
+
+
+// calls, syscalls and divergences so far, and the last divergence
+std::string shadow_report() {
+	std::string report = QMM_VARARGS(PLID, "[SOF2GT] Shadow execution: %s, %llu calls, %llu syscalls replayed, %llu divergences, %llu calls after outside changes to QVM memory\n",
+		shadow_loaded() ? "running" : "not running", (unsigned long long)s_shadow.calls, (unsigned long long)s_shadow.syscalls,
+		(unsigned long long)s_shadow.divergences, (unsigned long long)s_shadow.mirrored);
+	if (s_shadow.last[0])
+		report += std::string("[SOF2GT] Last divergence: ") + s_shadow.last + "\n";
+	return report;
+}
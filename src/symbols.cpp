@@ -0,0 +1,146 @@
+/*
+SoF2GT_QMM - Hook gametype dlls/qvms for Soldier of Fortune 2
+Copyright 2025-2026
+https://github.com/thecybermind/sof2gt_qmm/
+3-clause BSD license: https://opensource.org/license/bsd-3-clause
+
+Created By:
+	Kevin Masterson < k.m.masterson@gmail.com >
+
+*/
+
+#include <cstdio>
+#include <cstdlib>
+#include <algorithm>
+#include <map>
+#include <string>
+#include <unordered_map>
+
+#include "symbols.h"
+
+struct symbol_t {
+	int segment;
+	int address;
+};
+static std::unordered_map<std::string, symbol_t> s_symbols;
+// code symbols by instruction index, for symbols_function
+static std::map<int, std::string> s_functions;
+// data/lit/bss symbols by address, for symbols_data
+static std::map<int, std::string> s_data;
+
+
+// read the "<segment> <hex address> <name>" lines of a .map file
+static void s_parse(const char* text, size_t len, std::unordered_map<std::string, symbol_t>& symbols) {
+	const char* end = text + len;
+	while (text < end) {
+		const char* eol = std::find(text, end, '\n');
+		std::string line(text, eol);
+		text = eol < end ? eol + 1 : end;
+
+		int segment;
+		unsigned int address;
+		char name[256];
+		if (sscanf(line.c_str(), "%d %x %255s", &segment, &address, name) != 3)
+			continue;
+		symbols[name] = { segment, (int)address };
+	}
+}
+
+
+// replace the symbol table with the contents of a .map file
+size_t symbols_parse(const char* text, size_t len) {
+	symbols_clear();
+
+	s_parse(text, len, s_symbols);
+	for (auto& entry : s_symbols) {
+		if (entry.second.segment == SYMBOL_SEG_CODE)
+			s_functions[entry.second.address] = entry.first;
+		else
+			s_data[entry.second.address] = entry.first;
+	}
+
+	return s_symbols.size();
+}
+
+
+// number of symbols in the table
+size_t symbols_count() {
+	return s_symbols.size();
+}
+
+
+// "function 'name'" or "global 'name'"
+static std::string s_describe(const std::string& name, const symbol_t& symbol) {
+	return (symbol.segment == SYMBOL_SEG_CODE ? "function '" : "global '") + name + "'";
+}
+
+
+// compare the symbols in the table with those in another .map file
+std::string symbols_diff(const char* text, size_t len) {
+	if (s_symbols.empty())
+		return "";
+
+	std::unordered_map<std::string, symbol_t> other;
+	s_parse(text, len, other);
+
+	for (auto& entry : s_symbols) {
+		auto it = other.find(entry.first);
+		if (it == other.end())
+			return s_describe(entry.first, entry.second) + " was removed";
+		if (it->second.segment != entry.second.segment || it->second.address != entry.second.address)
+			return s_describe(entry.first, entry.second) + " moved";
+	}
+	for (auto& entry : other) {
+		if (!s_symbols.count(entry.first))
+			return s_describe(entry.first, entry.second) + " was added";
+	}
+
+	return "";
+}
+
+
+// clear the symbol table
+void symbols_clear() {
+	s_symbols.clear();
+	s_functions.clear();
+	s_data.clear();
+}
+
+
+// look up a symbol
+int symbols_find(const char* name, int* segment) {
+	auto it = s_symbols.find(name);
+	if (it == s_symbols.end())
+		return -1;
+	if (segment)
+		*segment = it->second.segment;
+	return it->second.address;
+}
+
+
+// find the name of the code symbol containing an instruction index
+const char* symbols_function(int instruction) {
+	auto it = s_functions.upper_bound(instruction);
+	if (it == s_functions.begin())
+		return nullptr;
+	return (--it)->second.c_str();
+}
+
+
+// address of the first data/lit/bss symbol after a data segment address
+int symbols_data_next(int address) {
+	auto it = s_data.upper_bound(address);
+	return it == s_data.end() ? -1 : it->first;
+}
+
+
+// find the name of the data symbol at or before a data segment address
+const char* symbols_data(int address, int* offset) {
+	auto it = s_data.upper_bound(address);
+	if (it == s_data.begin())
+		return nullptr;
+	--it;
+	if (offset)
+		*offset = address - it->first;
+	return it->second.c_str();
+}
@@ -0,0 +1,257 @@
+/*
+SoF2GT_QMM - Hook gametype dlls/qvms for Soldier of Fortune 2
+Copyright 2025-2026
+https://github.com/thecybermind/sof2gt_qmm/
+3-clause BSD license: https://opensource.org/license/bsd-3-clause
+
+Created By:
+	Kevin Masterson < k.m.masterson@gmail.com >
+
+*/
+
+#define _CRT_SECURE_NO_WARNINGS 1
+
+#include <qmmapi.h>
+
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#include "game.h"
+#include "util.h"
+#include "syscall_cache.h"
+
+// a cached syscall result
+struct cache_entry_t {
+	intptr_t cmd;
+	intptr_t key[2];		// non-pointer arguments that select the result
+	std::string name;		// cvar name for GT_CVAR_VARIABLE_INTEGER_VALUE
+	intptr_t ret;
+	std::string data;		// contents of the output buffer
+};
+
+// entries are reused between invalidations so their buffers don't need to be reallocated
+static std::vector<cache_entry_t> s_entries;
+static size_t s_numentries = 0;
+static bool s_enabled = false;
+
+// hit/miss counts for each cached syscall
+struct cache_stat_t {
+	intptr_t cmd;
+	const char* name;
+	unsigned long long hits;
+	unsigned long long misses;
+};
+static cache_stat_t s_stats[] = {
+	{ GT_GETCLIENTLIST, "GT_GETCLIENTLIST", 0, 0 },
+	{ GT_GETCLIENTORIGIN, "GT_GETCLIENTORIGIN", 0, 0 },
+	{ GT_GETCLIENTNAME, "GT_GETCLIENTNAME", 0, 0 },
+	{ GT_DOESCLIENTHAVEITEM, "GT_DOESCLIENTHAVEITEM", 0, 0 },
+	{ GT_GETCLIENTITEMS, "GT_GETCLIENTITEMS", 0, 0 },
+	{ GT_CVAR_VARIABLE_INTEGER_VALUE, "GT_CVAR_VARIABLE_INTEGER_VALUE", 0, 0 },
+};
+
+
+// get the stats slot of a cacheable syscall, or nullptr if it can't be cached
+static cache_stat_t* s_stat(intptr_t cmd) {
+	for (cache_stat_t& stat : s_stats) {
+		if (stat.cmd == cmd)
+			return &stat;
+	}
+	return nullptr;
+}
+
+
+// check if a syscall doesn't change any state that a cached syscall reads
+static bool s_harmless(intptr_t cmd) {
+	switch (cmd) {
+	case GT_PRINT:
+	case GT_MILLISECONDS:
+	case GT_CVAR_UPDATE:
+	case GT_CVAR_VARIABLE_STRING_BUFFER:
+	case GT_MEMSET:
+	case GT_MEMCPY:
+	case GT_STRNCPY:
+	case GT_SIN:
+	case GT_COS:
+	case GT_ATAN2:
+	case GT_SQRT:
+	case GT_MATRIXMULTIPLY:
+	case GT_ANGLEVECTORS:
+	case GT_PERPENDICULARVECTOR:
+	case GT_FLOOR:
+	case GT_CEIL:
+	case GT_TESTPRINTINT:
+	case GT_TESTPRINTFLOAT:
+	case GT_ACOS:
+	case GT_ASIN:
+	case GT_TEXTMESSAGE:
+	case GT_RADIOMESSAGE:
+	case GT_STARTGLOBALSOUND:
+	case GT_STARTSOUND:
+	case GT_PLAYEFFECT:
+	case GT_SETHUDICON:
+	case GT_GETTRIGGERTARGET:
+		return true;
+	default:
+		return false;
+	}
+}
+
+
+// fill in the key of a cacheable syscall. returns false if this call can't be cached (e.g. null buffer)
+static bool s_key(intptr_t* args, cache_entry_t& entry) {
+	entry.cmd = args[0];
+	entry.key[0] = args[1];
+	entry.key[1] = 0;
+	entry.name.clear();
+
+	switch (args[0]) {
+	case GT_GETCLIENTLIST:					// int  ( team_t team, int* clients, int clientcount );
+	case GT_GETCLIENTNAME:					// void ( int clientid, const char* buffer, int buffersize );
+	case GT_GETCLIENTITEMS:					// void ( int clientid, int* buffer, int buffersize );
+		entry.key[1] = args[3];
+		return args[2] && args[3] > 0;
+	case GT_GETCLIENTORIGIN:				// void ( int clientid, vec3_t origin );
+		return args[2] != 0;
+	case GT_DOESCLIENTHAVEITEM:				// bool ( int clientid, int itemid );
+		entry.key[1] = args[2];
+		return true;
+	case GT_CVAR_VARIABLE_INTEGER_VALUE:	// ( const char *var_name );
+		if (!args[1])
+			return false;
+		entry.key[0] = 0;
+		entry.name = (const char*)args[1];
+		return true;
+	default:
+		return false;
+	}
+}
+
+
+// find a cached result with the same key
+static cache_entry_t* s_find(const cache_entry_t& key) {
+	for (size_t i = 0; i < s_numentries; i++) {
+		cache_entry_t& entry = s_entries[i];
+		if (entry.cmd == key.cmd && entry.key[0] == key.key[0] && entry.key[1] == key.key[1] && entry.name == key.name)
+			return &entry;
+	}
+	return nullptr;
+}
+
+
+// enable or disable the cache
+void syscall_cache_enable(bool enable) {
+	s_enabled = enable;
+	syscall_cache_invalidate();
+}
+
+
+// forget all cached results
+void syscall_cache_invalidate() {
+	s_numentries = 0;
+}
+
+
+// serve a syscall from the cache
+bool syscall_cache_lookup(intptr_t* args, intptr_t& ret) {
+	if (!s_enabled)
+		return false;
+
+	cache_stat_t* stat = s_stat(args[0]);
+	if (!stat) {
+		// a syscall that changes game state invalidates everything, including for anything it calls back into
+		if (!s_harmless(args[0]))
+			syscall_cache_invalidate();
+		return false;
+	}
+
+	static cache_entry_t key;
+	cache_entry_t* entry;
+	if (!s_key(args, key) || !(entry = s_find(key))) {
+		stat->misses++;
+		return false;
+	}
+	stat->hits++;
+
+	// copy the output buffer back
+	if (!entry->data.empty())
+		memcpy((void*)args[2], entry->data.data(), entry->data.size());
+	ret = entry->ret;
+	return true;
+}
+
+
+// store the result of a syscall after it was made
+void syscall_cache_store(intptr_t* args, intptr_t ret) {
+	if (!s_enabled)
+		return;
+
+	if (!s_stat(args[0])) {
+		if (!s_harmless(args[0]))
+			syscall_cache_invalidate();
+		return;
+	}
+
+	if (s_numentries == s_entries.size())
+		s_entries.emplace_back();
+	cache_entry_t& entry = s_entries[s_numentries];
+	if (!s_key(args, entry) || s_find(entry))
+		return;
+
+	entry.ret = ret;
+	entry.data.clear();
+	switch (args[0]) {
+	case GT_GETCLIENTLIST: {
+		// 'ret' clients were written
+		intptr_t count = ret < 0 ? 0 : (ret > args[3] ? args[3] : ret);
+		entry.data.assign((const char*)args[2], (size_t)count * sizeof(int));
+		break;
+	}
+	case GT_GETCLIENTNAME:
+		entry.data.assign((const char*)args[2], strnlen((const char*)args[2], (size_t)args[3]));
+		if (entry.data.size() < (size_t)args[3])
+			entry.data.push_back('\0');
+		break;
+	case GT_GETCLIENTITEMS: {
+		// list of item ids, terminated by 0
+		const int* items = (const int*)args[2];
+		intptr_t count = 0;
+		while (count < args[3] && items[count])
+			count++;
+		if (count < args[3])
+			count++;
+		entry.data.assign((const char*)args[2], (size_t)count * sizeof(int));
+		break;
+	}
+	case GT_GETCLIENTORIGIN:
+		entry.data.assign((const char*)args[2], 3 * sizeof(float));
+		break;
+	default:
+		break;
+	}
+	s_numentries++;
+}
+
+
+// hit/miss counts of each cached syscall
+std::string syscall_cache_stats() {
+	std::string ret;
+	char line[128];
+	for (cache_stat_t& stat : s_stats) {
+		unsigned long long total = stat.hits + stat.misses;
+		snprintf(line, sizeof(line), "%s: %llu hits, %llu misses (%.1f%% hit rate)\n", stat.name, stat.hits, stat.misses, total ? 100.0 * stat.hits / total : 0.0);
+		ret += line;
+	}
+	return ret;
+}
+
+
+// reset hit/miss counts
+void syscall_cache_reset_stats() {
+	for (cache_stat_t& stat : s_stats) {
+		stat.hits = 0;
+		stat.misses = 0;
+	}
+}
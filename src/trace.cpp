@@ -0,0 +1,132 @@
+/*
+SoF2GT_QMM - Hook gametype dlls/qvms for Soldier of Fortune 2
+Copyright 2025-2026
+https://github.com/thecybermind/sof2gt_qmm/
+3-clause BSD license: https://opensource.org/license/bsd-3-clause
+
+Created By:
+	Kevin Masterson < k.m.masterson@gmail.com >
+
+*/
+
+#define _CRT_SECURE_NO_WARNINGS 1
+
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "trace.h"
+
+// a completed span
+struct trace_event_t {
+	const char* name;
+	intptr_t arg;
+	uint64_t begin;
+	uint64_t end;
+};
+
+// ring buffer of one thread's spans
+struct trace_buffer_t {
+	std::vector<trace_event_t> events;
+	size_t next;		// slot for the next event
+	bool wrapped;		// every slot has been used (oldest event is at 'next')
+	int tid;
+	unsigned int session;	// s_session when the buffer was last cleared
+};
+
+std::atomic<bool> g_trace_enabled{ false };
+
+// all thread buffers (threads that exit leave theirs here, it's small and they may have recorded something)
+static std::vector<std::unique_ptr<trace_buffer_t>> s_buffers;
+static std::mutex s_mutex;
+static size_t s_capacity = 0;
+static unsigned int s_session = 0;
+static uint64_t s_start = 0;
+
+static thread_local trace_buffer_t* s_buffer = nullptr;
+
+
+// current time in ns (never 0)
+uint64_t trace_now() {
+	return (uint64_t)std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count() + 1;
+}
+
+
+// record a span that started at 'begin'
+void trace_record(const char* name, intptr_t arg, uint64_t begin) {
+	uint64_t end = trace_now();
+
+	trace_buffer_t* buffer = s_buffer;
+	if (!buffer || buffer->session != s_session) {
+		std::lock_guard<std::mutex> lock(s_mutex);
+		if (!g_trace_enabled.load(std::memory_order_relaxed))
+			return;
+		if (!buffer) {
+			s_buffers.emplace_back(new trace_buffer_t());
+			buffer = s_buffer = s_buffers.back().get();
+			buffer->tid = (int)s_buffers.size();
+		}
+		buffer->events.assign(s_capacity, trace_event_t());
+		buffer->next = 0;
+		buffer->wrapped = false;
+		buffer->session = s_session;
+	}
+
+	buffer->events[buffer->next] = { name, arg, begin, end };
+	if (++buffer->next == buffer->events.size()) {
+		buffer->next = 0;
+		buffer->wrapped = true;
+	}
+}
+
+
+// start tracing, keeping the last 'events' spans per thread
+void trace_start(size_t events) {
+	std::lock_guard<std::mutex> lock(s_mutex);
+	s_capacity = events ? events : 1;
+	// buffers are cleared by their own thread on the next event
+	s_session++;
+	s_start = trace_now();
+	g_trace_enabled = true;
+}
+
+
+// stop tracing and return recorded spans as Chrome trace event JSON
+std::string trace_stop() {
+	std::lock_guard<std::mutex> lock(s_mutex);
+	g_trace_enabled = false;
+
+	std::string json = "{\"displayTimeUnit\":\"ns\",\"traceEvents\":[\n";
+	char line[256];
+	bool first = true;
+	for (auto& buffer : s_buffers) {
+		if (buffer->session != s_session)
+			continue;
+		size_t count = buffer->wrapped ? buffer->events.size() : buffer->next;
+		size_t start = buffer->wrapped ? buffer->next : 0;
+		for (size_t i = 0; i < count; i++) {
+			const trace_event_t& event = buffer->events[(start + i) % buffer->events.size()];
+			// spans that started before tracing was turned on are cut off at the start
+			uint64_t begin = event.begin > s_start ? event.begin - s_start : 0;
+			uint64_t end = event.end > s_start ? event.end - s_start : 0;
+			snprintf(line, sizeof(line), "%s{\"name\":\"%s\",\"cat\":\"sof2gt\",\"ph\":\"X\",\"pid\":1,\"tid\":%d,\"ts\":%.3f,\"dur\":%.3f,\"args\":{\"cmd\":%lld}}",
+				first ? "" : ",\n", event.name, buffer->tid, begin / 1000.0, (end - begin) / 1000.0, (long long)event.arg);
+			json += line;
+			first = false;
+		}
+		// free the memory
+		buffer->events.clear();
+		buffer->events.shrink_to_fit();
+		buffer->next = 0;
+		buffer->wrapped = false;
+	}
+	json += "\n]}\n";
+
+	// buffers from this session are stale now, any late event will see that tracing is off
+	s_session++;
+	return json;
+}
@@ -12,8 +12,10 @@ Created By:
 #define _CRT_SECURE_NO_WARNINGS 1
 #include "version.h"
 #include <qmmapi.h>
+#include <cstdio>
 #include <cstring>
 #include <string>
+#include <vector>
 #include "game.h"
 #include "util.h"
 
@@ -31,7 +33,7 @@ extern "C" void log_c(int severity, const char* tag, const char* fmt, ...) {
     (void)tag;
 
     va_list	argptr;
-    static char buf[1024];
+    char buf[1024];
 
     va_start(argptr, fmt);
     vsnprintf(buf, sizeof(buf), fmt, argptr);
@@ -39,3 +41,35 @@ extern "C" void log_c(int severity, const char* tag, const char* fmt, ...) {
 
     QMM_WRITEQMMLOG(PLID, buf, severity);
 }
+
+
+// write held back messages to the QMM log (must be called from the game thread)
+void log_c_flush(std::vector<log_msg_t>& capture) {
+    for (log_msg_t& msg : capture)
+        QMM_WRITEQMMLOG(PLID, msg.text.c_str(), msg.severity);
+    capture.clear();
+}
+
+
+// available physical memory in MiB (0 if unknown)
+size_t available_memory_mb() {
+#ifdef _WIN32
+    MEMORYSTATUSEX status;
+    status.dwLength = sizeof(status);
+    if (!GlobalMemoryStatusEx(&status))
+        return 0;
+    return (size_t)(status.ullAvailPhys / (1024 * 1024));
+#else
+    FILE* f = fopen("/proc/meminfo", "r");
+    if (!f)
+        return 0;
+    char line[128];
+    unsigned long long kb = 0;
+    while (fgets(line, sizeof(line), f)) {
+        if (sscanf(line, "MemAvailable: %llu kB", &kb) == 1)
+            break;
+    }
+    fclose(f);
+    return (size_t)(kb / 1024);
+#endif
+}
@@ -0,0 +1,459 @@
+/*
+SoF2GT_QMM - Hook gametype dlls/qvms for Soldier of Fortune 2
+Copyright 2025-2026
+https://github.com/thecybermind/sof2gt_qmm/
+3-clause BSD license: https://opensource.org/license/bsd-3-clause
+
+Created By:
+    Kevin Masterson < k.m.masterson@gmail.com >
+
+*/
+
+/* qvm2c - translate a gametype .qvm into C++ source for a native gametype module
+ *
+ * usage: qvm2c <gt_xxx.qvm> <gt_xxx.cpp>
+ *
+ * The QVM is decoded with qvm_load (the same decoder used by the plugin), then each QVM function (an
+ * QVM_OP_ENTER up to the next QVM_OP_ENTER) becomes one C++ function. The opstack depth at every
+ * instruction is computed statically, so opstack slots become local variables the compiler can keep in
+ * registers. Direct branches become gotos, constant calls become direct calls, and indirect jumps/calls
+ * go through a switch.
+ *
+ * The generated module keeps the VM sandbox: all loads/stores are masked into a private data segment,
+ * the program stack is bounds-checked on function entry, and syscalls are marshaled exactly like
+ * SOF2GT_qvm_syscall (through gt_syscall.h) to the function given to dllEntry, which is SOF2GT_syscall
+ * when loaded by sof2gt_qmm. Build the output as a gametype DLL (see "make native") and place it at
+ * base/mp/qmm_gt_<type>x86.dll so s_load_dll picks it up before the .qvm.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdarg.h>
+#include "qvm.h"
+
+// qvm.c logs through log_c (normally provided by util.cpp)
+void log_c(int severity, const char* tag, const char* fmt, ...) {
+    (void)severity; (void)tag;
+    va_list argptr;
+    va_start(argptr, fmt);
+    vfprintf(stderr, fmt, argptr);
+    va_end(argptr);
+}
+
+
+// qvm_load requires a syscall handler, but the VM is never executed here
+static int s_nosyscall(qvm_t* qvm, uint8_t* membase, int cmd, int* args) {
+    (void)qvm; (void)membase; (void)cmd; (void)args;
+    return 0;
+}
+
+
+static void s_fatal(const char* fmt, ...) {
+    va_list argptr;
+    va_start(argptr, fmt);
+    fprintf(stderr, "qvm2c: ");
+    vfprintf(stderr, fmt, argptr);
+    va_end(argptr);
+    exit(1);
+}
+
+
+// number of opstack values popped and pushed by each opcode
+static void s_stackeffect(qvmopcode_t op, int* pops, int* pushes) {
+    *pops = 0;
+    *pushes = 0;
+    switch (op) {
+    case QVM_OP_PUSH: case QVM_OP_CONST: case QVM_OP_LOCAL:
+        *pushes = 1;
+        break;
+    case QVM_OP_POP: case QVM_OP_JUMP: case QVM_OP_ARG:
+        *pops = 1;
+        break;
+    case QVM_OP_CALL: case QVM_OP_LOAD1: case QVM_OP_LOAD2: case QVM_OP_LOAD4:
+    case QVM_OP_SEX8: case QVM_OP_SEX16: case QVM_OP_NEGI: case QVM_OP_BCOM:
+    case QVM_OP_NEGF: case QVM_OP_CVIF: case QVM_OP_CVFI:
+        *pops = 1;
+        *pushes = 1;
+        break;
+    case QVM_OP_EQ: case QVM_OP_NE: case QVM_OP_LTI: case QVM_OP_LEI: case QVM_OP_GTI: case QVM_OP_GEI:
+    case QVM_OP_LTU: case QVM_OP_LEU: case QVM_OP_GTU: case QVM_OP_GEU:
+    case QVM_OP_EQF: case QVM_OP_NEF: case QVM_OP_LTF: case QVM_OP_LEF: case QVM_OP_GTF: case QVM_OP_GEF:
+    case QVM_OP_STORE1: case QVM_OP_STORE2: case QVM_OP_STORE4: case QVM_OP_BLOCK_COPY:
+    case QVM_OP_BLOCK_COPY12: case QVM_OP_BLOCK_COPY16: case QVM_OP_BLOCK_COPY32: case QVM_OP_BLOCK_COPY64:
+        *pops = 2;
+        break;
+    case QVM_OP_ADD: case QVM_OP_SUB: case QVM_OP_DIVI: case QVM_OP_DIVU: case QVM_OP_MODI: case QVM_OP_MODU:
+    case QVM_OP_MULI: case QVM_OP_MULU: case QVM_OP_BAND: case QVM_OP_BOR: case QVM_OP_BXOR:
+    case QVM_OP_LSH: case QVM_OP_RSHI: case QVM_OP_RSHU:
+    case QVM_OP_ADDF: case QVM_OP_SUBF: case QVM_OP_DIVF: case QVM_OP_MULF:
+        *pops = 2;
+        *pushes = 1;
+        break;
+    default:
+        break;
+    }
+}
+
+
+static int s_isbranch(qvmopcode_t op) {
+    return op >= QVM_OP_EQ && op <= QVM_OP_GEF;
+}
+
+
+// format an int so INT_MIN is still a valid C++ literal
+static const char* s_int(int i) {
+    static char buf[4][32];
+    static int n = 0;
+    n = (n + 1) % 4;
+    if (i == (int)0x80000000)
+        snprintf(buf[n], sizeof(buf[n]), "(int)0x80000000u");
+    else
+        snprintf(buf[n], sizeof(buf[n]), "%d", i);
+    return buf[n];
+}
+
+
+// translation state
+static qvmop_t* code;
+static int numops;
+static int* depth;          // opstack depth before each instruction (-1 = unreachable)
+static char* isfunc;        // instruction is a function entry (QVM_OP_ENTER)
+static char* iscandidate;   // instruction index appears as a constant in code or data (possible indirect target)
+static char* needlabel;     // instruction needs a label in generated code
+static int* worklist;
+
+
+// propagate opstack depth through a function starting from instruction 'from' at depth 'd'
+static int s_propagate(int start, int end, int from, int d) {
+    int maxdepth = 0;
+    int count = 0;
+
+    if (depth[from] >= 0) {
+        if (depth[from] != d)
+            s_fatal("inconsistent opstack depth at instruction %d (%d vs %d)\n", from, depth[from], d);
+        return 0;
+    }
+    depth[from] = d;
+    worklist[count++] = from;
+
+    while (count) {
+        int i = worklist[--count];
+        int pops, pushes;
+        qvmopcode_t op = code[i].op;
+
+        s_stackeffect(op, &pops, &pushes);
+        if (depth[i] < pops)
+            s_fatal("opstack underflow at instruction %d (%s)\n", i, opcodename[op]);
+        int nd = depth[i] - pops + pushes;
+        if (nd > maxdepth)
+            maxdepth = nd;
+
+        int succ[2];
+        int nsucc = 0;
+        if (op != QVM_OP_JUMP && op != QVM_OP_LEAVE && op != QVM_OP_UNDEF && i + 1 < end)
+            succ[nsucc++] = i + 1;
+        if (s_isbranch(op)) {
+            if (code[i].param < start || code[i].param >= end)
+                s_fatal("branch at instruction %d leaves its function (target %d)\n", i, code[i].param);
+            succ[nsucc++] = code[i].param;
+            needlabel[code[i].param] = 1;
+        }
+        // "CONST x; JUMP" is a direct goto
+        if (op == QVM_OP_JUMP && i > start && code[i - 1].op == QVM_OP_CONST && !needlabel[i] &&
+            code[i - 1].param >= start && code[i - 1].param < end) {
+            succ[nsucc++] = code[i - 1].param;
+            needlabel[code[i - 1].param] = 1;
+        }
+
+        for (int s = 0; s < nsucc; s++) {
+            int t = succ[s];
+            if (depth[t] < 0) {
+                depth[t] = nd;
+                worklist[count++] = t;
+            }
+            else if (depth[t] != nd) {
+                s_fatal("inconsistent opstack depth at instruction %d (%d vs %d)\n", t, depth[t], nd);
+            }
+        }
+    }
+
+    return maxdepth;
+}
+
+
+static void s_emit_function(FILE* f, int start, int end) {
+    int maxdepth = s_propagate(start, end, start, 0);
+    int hasdispatch = 0;
+
+    // anything not reached yet can only be entered through an indirect jump, which lcc only emits
+    // for switch tables with an empty opstack
+    for (int i = start; i < end; i++) {
+        if (depth[i] < 0 && iscandidate[i]) {
+            int d = s_propagate(start, end, i, 0);
+            if (d > maxdepth)
+                maxdepth = d;
+        }
+    }
+
+    for (int i = start; i < end; i++) {
+        if (code[i].op == QVM_OP_JUMP && depth[i] >= 0 && !(i > start && code[i - 1].op == QVM_OP_CONST &&
+            code[i - 1].param >= start && code[i - 1].param < end && !needlabel[i]))
+            hasdispatch = 1;
+    }
+
+    fprintf(f, "// function at instruction %d\n", start);
+    fprintf(f, "static int qf_%d() {\n", start);
+    fprintf(f, "\tuint8_t* ps = qn_enter(%d, %s);\n", start, s_int(code[start].param));
+    fprintf(f, "\tint s[%d];\n", maxdepth + 1);
+    if (hasdispatch)
+        fprintf(f, "\tint target;\n");
+
+    for (int i = start + 1; i < end; i++) {
+        int d = depth[i];
+        int p = code[i].param;
+        if (d < 0)
+            continue;
+
+        if (needlabel[i] || (hasdispatch && iscandidate[i] && d == 0))
+            fprintf(f, "L%d:\t", i);
+        else
+            fprintf(f, "\t");
+
+        switch (code[i].op) {
+        case QVM_OP_UNDEF:
+        case QVM_OP_ENTER:
+        default:
+            fprintf(f, "qn_error(%d, \"unhandled opcode %d\");\n", i, code[i].op);
+            break;
+        case QVM_OP_NOP:
+        case QVM_OP_BREAK:
+            fprintf(f, ";\n");
+            break;
+        case QVM_OP_LEAVE:
+            if (d > 0)
+                fprintf(f, "qn_leave(%d, ps, %s); return s[%d];\n", i, s_int(p), d - 1);
+            else
+                fprintf(f, "qn_leave(%d, ps, %s); return 0;\n", i, s_int(p));
+            break;
+        case QVM_OP_CALL: {
+            int known = code[i - 1].op == QVM_OP_CONST && !needlabel[i];
+            int c = code[i - 1].param;
+            if (known && c < 0)
+                fprintf(f, "s[%d] = qn_trap(ps, %d);\n", d - 1, c);
+            else if (known && c < numops && isfunc[c])
+                fprintf(f, "qn_arg(ps, 0, %d); qn_stackptr = ps; s[%d] = qf_%d();\n", i + 1, d - 1, c);
+            else
+                fprintf(f, "if (s[%d] < 0) s[%d] = qn_trap(ps, s[%d]); else { qn_arg(ps, 0, %d); qn_stackptr = ps; s[%d] = qn_call(s[%d]); }\n", d - 1, d - 1, d - 1, i + 1, d - 1, d - 1);
+            break;
+        }
+        case QVM_OP_PUSH:
+            fprintf(f, "s[%d] = 0;\n", d);
+            break;
+        case QVM_OP_POP:
+            fprintf(f, ";\n");
+            break;
+        case QVM_OP_CONST:
+            fprintf(f, "s[%d] = %s;\n", d, s_int(p));
+            break;
+        case QVM_OP_LOCAL:
+            fprintf(f, "s[%d] = qn_local(ps, %s);\n", d, s_int(p));
+            break;
+        case QVM_OP_JUMP:
+            if (i > start && code[i - 1].op == QVM_OP_CONST && !needlabel[i] &&
+                code[i - 1].param >= start && code[i - 1].param < end) {
+                fprintf(f, "goto L%d;\n", code[i - 1].param);
+            }
+            else {
+                if (d != 1)
+                    s_fatal("indirect jump with non-empty opstack at instruction %d\n", i);
+                fprintf(f, "target = s[0]; goto dispatch;\n");
+            }
+            break;
+        case QVM_OP_EQ:  fprintf(f, "if (s[%d] == s[%d]) goto L%d;\n", d - 2, d - 1, p); break;
+        case QVM_OP_NE:  fprintf(f, "if (s[%d] != s[%d]) goto L%d;\n", d - 2, d - 1, p); break;
+        case QVM_OP_LTI: fprintf(f, "if (s[%d] < s[%d]) goto L%d;\n", d - 2, d - 1, p); break;
+        case QVM_OP_LEI: fprintf(f, "if (s[%d] <= s[%d]) goto L%d;\n", d - 2, d - 1, p); break;
+        case QVM_OP_GTI: fprintf(f, "if (s[%d] > s[%d]) goto L%d;\n", d - 2, d - 1, p); break;
+        case QVM_OP_GEI: fprintf(f, "if (s[%d] >= s[%d]) goto L%d;\n", d - 2, d - 1, p); break;
+        case QVM_OP_LTU: fprintf(f, "if ((unsigned)s[%d] < (unsigned)s[%d]) goto L%d;\n", d - 2, d - 1, p); break;
+        case QVM_OP_LEU: fprintf(f, "if ((unsigned)s[%d] <= (unsigned)s[%d]) goto L%d;\n", d - 2, d - 1, p); break;
+        case QVM_OP_GTU: fprintf(f, "if ((unsigned)s[%d] > (unsigned)s[%d]) goto L%d;\n", d - 2, d - 1, p); break;
+        case QVM_OP_GEU: fprintf(f, "if ((unsigned)s[%d] >= (unsigned)s[%d]) goto L%d;\n", d - 2, d - 1, p); break;
+        case QVM_OP_EQF: fprintf(f, "if (qn_f(s[%d]) == qn_f(s[%d])) goto L%d;\n", d - 2, d - 1, p); break;
+        case QVM_OP_NEF: fprintf(f, "if (qn_f(s[%d]) != qn_f(s[%d])) goto L%d;\n", d - 2, d - 1, p); break;
+        case QVM_OP_LTF: fprintf(f, "if (qn_f(s[%d]) < qn_f(s[%d])) goto L%d;\n", d - 2, d - 1, p); break;
+        case QVM_OP_LEF: fprintf(f, "if (qn_f(s[%d]) <= qn_f(s[%d])) goto L%d;\n", d - 2, d - 1, p); break;
+        case QVM_OP_GTF: fprintf(f, "if (qn_f(s[%d]) > qn_f(s[%d])) goto L%d;\n", d - 2, d - 1, p); break;
+        case QVM_OP_GEF: fprintf(f, "if (qn_f(s[%d]) >= qn_f(s[%d])) goto L%d;\n", d - 2, d - 1, p); break;
+        case QVM_OP_LOAD1: fprintf(f, "s[%d] = qn_load1(s[%d]);\n", d - 1, d - 1); break;
+        case QVM_OP_LOAD2: fprintf(f, "s[%d] = qn_load2(s[%d]);\n", d - 1, d - 1); break;
+        case QVM_OP_LOAD4: fprintf(f, "s[%d] = qn_load4(s[%d]);\n", d - 1, d - 1); break;
+        case QVM_OP_STORE1: fprintf(f, "qn_store1(s[%d], s[%d]);\n", d - 2, d - 1); break;
+        case QVM_OP_STORE2: fprintf(f, "qn_store2(s[%d], s[%d]);\n", d - 2, d - 1); break;
+        case QVM_OP_STORE4: fprintf(f, "qn_store4(s[%d], s[%d]);\n", d - 2, d - 1); break;
+        case QVM_OP_ARG: fprintf(f, "qn_arg(ps, %d, s[%d]);\n", p, d - 1); break;
+        // the fixed size copies selected by qvm_load keep their size in param
+        case QVM_OP_BLOCK_COPY: case QVM_OP_BLOCK_COPY12: case QVM_OP_BLOCK_COPY16:
+        case QVM_OP_BLOCK_COPY32: case QVM_OP_BLOCK_COPY64: fprintf(f, "qn_blockcopy(s[%d], s[%d], %s);\n", d - 2, d - 1, s_int(p)); break;
+        case QVM_OP_SEX8: fprintf(f, "if (s[%d] & 0x80) s[%d] |= (int)0xFFFFFF00u;\n", d - 1, d - 1); break;
+        case QVM_OP_SEX16: fprintf(f, "if (s[%d] & 0x8000) s[%d] |= (int)0xFFFF0000u;\n", d - 1, d - 1); break;
+        case QVM_OP_NEGI: fprintf(f, "s[%d] = (int)(0u - (unsigned)s[%d]);\n", d - 1, d - 1); break;
+        case QVM_OP_ADD: fprintf(f, "s[%d] = (int)((unsigned)s[%d] + (unsigned)s[%d]);\n", d - 2, d - 2, d - 1); break;
+        case QVM_OP_SUB: fprintf(f, "s[%d] = (int)((unsigned)s[%d] - (unsigned)s[%d]);\n", d - 2, d - 2, d - 1); break;
+        case QVM_OP_DIVI:
+        case QVM_OP_DIVU:
+        case QVM_OP_MODI:
+        case QVM_OP_MODU: {
+            const char* o = (code[i].op == QVM_OP_DIVI || code[i].op == QVM_OP_DIVU) ? "/" : "%";
+            const char* cast = (code[i].op == QVM_OP_DIVU || code[i].op == QVM_OP_MODU) ? "(unsigned)" : "";
+            fprintf(f, "if (!s[%d]) qn_error(%d, \"%s division by 0!\"); s[%d] = (int)(%ss[%d] %s %ss[%d]);\n",
+                d - 1, i, opcodename[code[i].op], d - 2, cast, d - 2, o, cast, d - 1);
+            break;
+        }
+        case QVM_OP_MULI:
+        case QVM_OP_MULU: fprintf(f, "s[%d] = (int)((unsigned)s[%d] * (unsigned)s[%d]);\n", d - 2, d - 2, d - 1); break;
+        case QVM_OP_BAND: fprintf(f, "s[%d] &= s[%d];\n", d - 2, d - 1); break;
+        case QVM_OP_BOR: fprintf(f, "s[%d] |= s[%d];\n", d - 2, d - 1); break;
+        case QVM_OP_BXOR: fprintf(f, "s[%d] ^= s[%d];\n", d - 2, d - 1); break;
+        case QVM_OP_BCOM: fprintf(f, "s[%d] = ~s[%d];\n", d - 1, d - 1); break;
+        case QVM_OP_LSH: fprintf(f, "s[%d] = (int)((unsigned)s[%d] << (s[%d] & 31));\n", d - 2, d - 2, d - 1); break;
+        case QVM_OP_RSHI: fprintf(f, "s[%d] = s[%d] >> (s[%d] & 31);\n", d - 2, d - 2, d - 1); break;
+        case QVM_OP_RSHU: fprintf(f, "s[%d] = (int)((unsigned)s[%d] >> (s[%d] & 31));\n", d - 2, d - 2, d - 1); break;
+        case QVM_OP_NEGF: fprintf(f, "s[%d] = qn_i(-qn_f(s[%d]));\n", d - 1, d - 1); break;
+        case QVM_OP_ADDF: fprintf(f, "s[%d] = qn_i(qn_f(s[%d]) + qn_f(s[%d]));\n", d - 2, d - 2, d - 1); break;
+        case QVM_OP_SUBF: fprintf(f, "s[%d] = qn_i(qn_f(s[%d]) - qn_f(s[%d]));\n", d - 2, d - 2, d - 1); break;
+        case QVM_OP_DIVF:
+            fprintf(f, "if (s[%d] == 0 || s[%d] == (int)0x80000000u) qn_error(%d, \"QVM_OP_DIVF division by 0!\"); s[%d] = qn_i(qn_f(s[%d]) / qn_f(s[%d]));\n",
+                d - 1, d - 1, i, d - 2, d - 2, d - 1);
+            break;
+        case QVM_OP_MULF: fprintf(f, "s[%d] = qn_i(qn_f(s[%d]) * qn_f(s[%d]));\n", d - 2, d - 2, d - 1); break;
+        case QVM_OP_CVIF: fprintf(f, "s[%d] = qn_i((float)s[%d]);\n", d - 1, d - 1); break;
+        case QVM_OP_CVFI: fprintf(f, "s[%d] = (int)qn_f(s[%d]);\n", d - 1, d - 1); break;
+        }
+    }
+
+    // falling off the end of a function (or reaching unreachable padding)
+    fprintf(f, "\tqn_error(%d, \"execution ran past the end of the function\");\n", end - 1);
+    fprintf(f, "\treturn 0;\n");
+
+    if (hasdispatch) {
+        fprintf(f, "dispatch:\n\tswitch (target) {\n");
+        for (int i = start + 1; i < end; i++) {
+            if (iscandidate[i] && depth[i] == 0)
+                fprintf(f, "\tcase %d: goto L%d;\n", i, i);
+        }
+        fprintf(f, "\tdefault: qn_error(%d, \"invalid jump target %%d\", target); return 0;\n\t}\n", start);
+    }
+    fprintf(f, "}\n\n\n");
+}
+
+
+int main(int argc, char* argv[]) {
+    if (argc != 3) {
+        fprintf(stderr, "usage: qvm2c <gt_xxx.qvm> <gt_xxx.cpp>\n");
+        return 1;
+    }
+
+    FILE* in = fopen(argv[1], "rb");
+    if (!in)
+        s_fatal("could not open %s\n", argv[1]);
+    fseek(in, 0, SEEK_END);
+    long filesize = ftell(in);
+    fseek(in, 0, SEEK_SET);
+    if (filesize <= 0)
+        s_fatal("could not read %s\n", argv[1]);
+    uint8_t* filemem = (uint8_t*)malloc(filesize);
+    if (fread(filemem, 1, filesize, in) != (size_t)filesize)
+        s_fatal("could not read %s\n", argv[1]);
+    fclose(in);
+
+    qvm_t qvm;
+    memset(&qvm, 0, sizeof(qvm));
+    if (!qvm_load(&qvm, filemem, filesize, s_nosyscall, QVM_LOAD_VERIFY_DATA, NULL))
+        s_fatal("could not load %s\n", argv[1]);
+
+    qvmheader_t header;
+    memcpy(&header, filemem, sizeof(header));
+
+    code = qvm.codesegment;
+    numops = (int)qvm.instructioncount;
+    depth = (int*)malloc(numops * sizeof(int));
+    worklist = (int*)malloc(numops * sizeof(int));
+    isfunc = (char*)calloc(numops, 1);
+    iscandidate = (char*)calloc(numops, 1);
+    needlabel = (char*)calloc(numops, 1);
+    for (int i = 0; i < numops; i++)
+        depth[i] = -1;
+
+    if (!numops || code[0].op != QVM_OP_ENTER)
+        s_fatal("instruction 0 is not QVM_OP_ENTER\n");
+
+    // find functions and possible indirect jump/call targets
+    for (int i = 0; i < numops; i++) {
+        if (code[i].op == QVM_OP_ENTER)
+            isfunc[i] = 1;
+        if (code[i].op == QVM_OP_CONST && code[i].param >= 0 && code[i].param < numops)
+            iscandidate[code[i].param] = 1;
+    }
+    for (uint32_t a = 0; a + 4 <= header.datalen + header.litlen; a += 4) {
+        int v;
+        memcpy(&v, qvm.datasegment + a, sizeof(v));
+        if (v >= 0 && v < numops)
+            iscandidate[v] = 1;
+    }
+
+    FILE* f = fopen(argv[2], "w");
+    if (!f)
+        s_fatal("could not open %s for writing\n", argv[2]);
+
+    const char* name = strrchr(argv[1], '/');
+    name = name ? name + 1 : argv[1];
+    fprintf(f, "// generated by qvm2c from %s - do not edit\n", name);
+    fprintf(f, "// %d instructions, data segment %d bytes, program stack %d bytes\n\n", numops, (int)qvm.dataseglen, (int)qvm.stacksize);
+    fprintf(f, "#define QVM_NATIVE_DATASEGLEN %d\n", (int)qvm.dataseglen);
+    fprintf(f, "#define QVM_NATIVE_STACKSIZE %d\n", (int)qvm.stacksize);
+    fprintf(f, "#define QVM_NATIVE_DATAINITLEN %d\n", (int)(header.datalen + header.litlen));
+    fprintf(f, "#include \"qvm_native.h\"\n\n");
+
+    // initialized data (data + lit segments)
+    fprintf(f, "static const uint8_t qn_datainit[] = {");
+    for (uint32_t a = 0; a < header.datalen + header.litlen; a++)
+        fprintf(f, "%s%d,", (a % 32) ? "" : "\n\t", qvm.datasegment[a]);
+    fprintf(f, "\n\t0\n};\n\n");
+
+    for (int i = 0; i < numops; i++) {
+        if (isfunc[i])
+            fprintf(f, "static int qf_%d();\n", i);
+    }
+    fprintf(f, "\n\n");
+
+    for (int start = 0; start < numops; ) {
+        int end = start + 1;
+        while (end < numops && !isfunc[end])
+            end++;
+        s_emit_function(f, start, end);
+        start = end;
+    }
+
+    // indirect calls
+    fprintf(f, "static int qn_call(int addr) {\n\tswitch (addr) {\n");
+    for (int i = 0; i < numops; i++) {
+        if (isfunc[i])
+            fprintf(f, "\tcase %d: return qf_%d();\n", i, i);
+    }
+    fprintf(f, "\tdefault: qn_error(addr, \"call to invalid function address\"); return 0;\n\t}\n}\n\n\n");
+
+    // exports
+    fprintf(f, "C_DLLEXPORT void dllEntry(eng_syscall_t syscall) {\n\tqn_init(syscall, qn_datainit);\n}\n\n\n");
+    fprintf(f, "C_DLLEXPORT intptr_t vmMain(intptr_t cmd, intptr_t arg0, intptr_t arg1, intptr_t arg2, intptr_t arg3, intptr_t arg4, intptr_t arg5, intptr_t arg6) {\n");
+    fprintf(f, "\tint args[] = { (int)cmd, (int)arg0, (int)arg1, (int)arg2, (int)arg3, (int)arg4, (int)arg5, (int)arg6 };\n");
+    fprintf(f, "\treturn qn_exec(qf_0, sizeof(args) / sizeof(args[0]), args);\n}\n");
+
+    fclose(f);
+    qvm_unload(&qvm);
+    free(filemem);
+
+    printf("qvm2c: translated %s (%d instructions) to %s\n", argv[1], numops, argv[2]);
+    return 0;
+}
@@ -0,0 +1,1032 @@
+/*
+SoF2GT_QMM - Hook gametype dlls/qvms for Soldier of Fortune 2
+Copyright 2025-2026
+https://github.com/thecybermind/sof2gt_qmm/
+3-clause BSD license: https://opensource.org/license/bsd-3-clause
+
+Created By:
+    Kevin Masterson < k.m.masterson@gmail.com >
+
+*/
+
+/* qvm_bench - synthetic QVM workloads for measuring the interpreter and optimizer
+ *
+ * usage: qvm_bench list
+ *        qvm_bench write <workload> <out.qvm> [size]
+ *        qvm_bench run [workload|all] [size] [iterations]
+ *        qvm_bench ops [iterations]
+ *        qvm_bench parallel [workload] [threads] [iterations]
+ *        qvm_bench slice [workload] [instructions] [iterations]
+ *        qvm_bench shadow [workload|all] [size] [iterations]
+ *
+ * Workloads are generated with the QVM builder (qvm_builder.h). Each one is a vmMain(iterations) loop around a
+ * body whose shape is set by 'size' (see s_workloads). "write" saves a workload as a .qvm (with a .map next to it)
+ * so it can be loaded like a gametype. "run" loads each workload with the plain interpreter (QVM_LOAD_VERIFY_DATA),
+ * with QVM_LOAD_OPTIMIZE and with QVM_LOAD_INLINE, and prints the time and VM instructions per iteration, and
+ * checks that all three return the same result. "ops" runs one small pattern per opcode (16 copies per loop
+ * iteration) and prints the time per pattern with the cost of the loop itself taken out. "parallel" loads one
+ * qvm_t per thread from the same image (all optimizations) and runs them at the same time, then checks every thread
+ * got the result a single instance gets. Each instance logs through its own qvm_t.log with its thread number.
+ * "slice" runs a workload with qvm_begin/qvm_resume, pausing every 'instructions' instructions and making a short
+ * vmMain(1) call while paused (like a server frame would), then checks the result against an uninterrupted run.
+ * "shadow" runs each workload on the plain interpreter with a shadow copy loaded with QVM_LOAD_OPTIMIZE, then with
+ * QVM_LOAD_INLINE (qvm_shadow.h), and prints how many calls and syscalls were compared and any divergence.
+ *
+ * Syscall 0 (QVM_OP_CALL of address -1) returns its first argument + 1, for the syscall-dense workload.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdarg.h>
+#include <time.h>
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <pthread.h>
+#endif
+#include "qvm.h"
+#include "qvm_builder.h"
+#include "qvm_shadow.h"
+
+// qvm.c logs through log_c (normally provided by util.cpp)
+void log_c(int severity, const char* tag, const char* fmt, ...) {
+    (void)tag;
+    // skip info messages like "Optimized x instructions into y"
+    if (severity <= 2)
+        return;
+    va_list argptr;
+    va_start(argptr, fmt);
+    vfprintf(stderr, fmt, argptr);
+    va_end(argptr);
+}
+
+
+static int s_syscall(qvm_t* qvm, uint8_t* membase, int cmd, int* args) {
+    (void)qvm; (void)membase;
+    return cmd == 0 ? args[0] + 1 : 0;
+}
+
+
+static uint64_t s_now_ns() {
+    struct timespec ts;
+    timespec_get(&ts, TIME_UTC);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + (uint64_t)ts.tv_nsec;
+}
+
+
+// shorthand for building code
+#define OP(o, p)        qvm_builder_op(b, QVM_OP_##o, (p))
+#define OPSYM(o, s)     qvm_builder_op_symbol(b, QVM_OP_##o, (s), 0)
+
+// vmMain frame: | RII | size | call args (8-15) | counter (16) | result (20) | workload locals (24+) |
+#define MAIN_COUNTER    16
+#define MAIN_RESULT     20
+#define MAIN_LOCALS     24
+
+// loop labels for s_main_begin/s_main_end
+typedef struct loop_s {
+    int top;
+    int done;
+    int framesize;
+} loop_t;
+
+
+// start vmMain(iterations) and its loop
+static loop_t s_main_begin(qvm_builder_t* b, int framesize) {
+    loop_t loop;
+    loop.framesize = framesize;
+    qvm_builder_label(b, "vmMain");
+    OP(ENTER, framesize);
+    OP(LOCAL, MAIN_COUNTER);
+    OP(CONST, 0);
+    OP(STORE4, 0);
+    OP(LOCAL, MAIN_RESULT);
+    OP(CONST, 0);
+    OP(STORE4, 0);
+    loop.done = qvm_builder_symbol(b, NULL, QVM_SEG_CODE);
+    loop.top = qvm_builder_label(b, NULL);
+    OP(LOCAL, MAIN_COUNTER);
+    OP(LOAD4, 0);
+    OP(LOCAL, framesize + 8);
+    OP(LOAD4, 0);
+    OPSYM(GEI, loop.done);
+    return loop;
+}
+
+
+// end the loop and return the result
+static void s_main_end(qvm_builder_t* b, loop_t loop) {
+    OP(LOCAL, MAIN_COUNTER);
+    OP(LOCAL, MAIN_COUNTER);
+    OP(LOAD4, 0);
+    OP(CONST, 1);
+    OP(ADD, 0);
+    OP(STORE4, 0);
+    OPSYM(CONST, loop.top);
+    OP(JUMP, 0);
+    qvm_builder_place(b, loop.done);
+    OP(LOCAL, MAIN_RESULT);
+    OP(LOAD4, 0);
+    OP(LEAVE, loop.framesize);
+}
+
+
+// "arith": 'size' copies of result = (result * 1664525 + counter) ^ (result >> 3)
+static void s_build_arith(qvm_builder_t* b, int size) {
+    loop_t loop = s_main_begin(b, MAIN_LOCALS);
+    for (int i = 0; i < size; i++) {
+        OP(LOCAL, MAIN_RESULT);
+        OP(LOCAL, MAIN_RESULT);
+        OP(LOAD4, 0);
+        OP(CONST, 1664525);
+        OP(MULI, 0);
+        OP(LOCAL, MAIN_COUNTER);
+        OP(LOAD4, 0);
+        OP(ADD, 0);
+        OP(LOCAL, MAIN_RESULT);
+        OP(LOAD4, 0);
+        OP(CONST, 3);
+        OP(RSHI, 0);
+        OP(BXOR, 0);
+        OP(STORE4, 0);
+    }
+    s_main_end(b, loop);
+}
+
+
+// "float": 'size' copies of x = x * 0.5 + counter, result = (int)x
+static void s_build_float(qvm_builder_t* b, int size) {
+    float half = 0.5f;
+    int halfbits;
+    memcpy(&halfbits, &half, sizeof(halfbits));
+
+    loop_t loop = s_main_begin(b, MAIN_LOCALS + 4);
+    OP(LOCAL, MAIN_LOCALS);
+    OP(CONST, 0);
+    OP(STORE4, 0);
+    for (int i = 0; i < size; i++) {
+        OP(LOCAL, MAIN_LOCALS);
+        OP(LOCAL, MAIN_LOCALS);
+        OP(LOAD4, 0);
+        OP(CONST, halfbits);
+        OP(MULF, 0);
+        OP(LOCAL, MAIN_COUNTER);
+        OP(LOAD4, 0);
+        OP(CVIF, 0);
+        OP(ADDF, 0);
+        OP(STORE4, 0);
+    }
+    OP(LOCAL, MAIN_RESULT);
+    OP(LOCAL, MAIN_LOCALS);
+    OP(LOAD4, 0);
+    OP(CVFI, 0);
+    OP(STORE4, 0);
+    s_main_end(b, loop);
+}
+
+
+// "calls": result += f0(counter), where f0..f(size-1) each call the next with their argument + 1
+static void s_build_calls(qvm_builder_t* b, int size) {
+    int* funcs = (int*)malloc((size + 1) * sizeof(int));
+    char name[32];
+    for (int i = 0; i <= size; i++) {
+        snprintf(name, sizeof(name), "f%d", i);
+        funcs[i] = qvm_builder_symbol(b, name, QVM_SEG_CODE);
+    }
+
+    loop_t loop = s_main_begin(b, MAIN_LOCALS);
+    OP(LOCAL, MAIN_RESULT);
+    OP(LOCAL, MAIN_RESULT);
+    OP(LOAD4, 0);
+    OP(LOCAL, MAIN_COUNTER);
+    OP(LOAD4, 0);
+    OP(ARG, 8);
+    OPSYM(CONST, funcs[0]);
+    OP(CALL, 0);
+    OP(ADD, 0);
+    OP(STORE4, 0);
+    s_main_end(b, loop);
+
+    // f(i)(x) = f(i+1)(x + 1), frame | RII | size | call arg |
+    for (int i = 0; i < size; i++) {
+        qvm_builder_place(b, funcs[i]);
+        OP(ENTER, 12);
+        OP(LOCAL, 20);
+        OP(LOAD4, 0);
+        OP(CONST, 1);
+        OP(ADD, 0);
+        OP(ARG, 8);
+        OPSYM(CONST, funcs[i + 1]);
+        OP(CALL, 0);
+        OP(LEAVE, 12);
+    }
+    // last one is a leaf: f(size)(x) = x
+    qvm_builder_place(b, funcs[size]);
+    OP(ENTER, 8);
+    OP(LOCAL, 16);
+    OP(LOAD4, 0);
+    OP(LEAVE, 8);
+
+    free(funcs);
+}
+
+
+// "blockcopy": 8 copies of 'size' bytes back and forth between two buffers
+static void s_build_blockcopy(qvm_builder_t* b, int size) {
+    int src = qvm_builder_data(b, "src", NULL, (size + 3) / 4);
+    int dst = qvm_builder_bss(b, "dst", size);
+
+    loop_t loop = s_main_begin(b, MAIN_LOCALS);
+    for (int i = 0; i < 8; i++) {
+        OPSYM(CONST, i & 1 ? src : dst);
+        OPSYM(CONST, i & 1 ? dst : src);
+        OP(BLOCK_COPY, size);
+    }
+    s_main_end(b, loop);
+}
+
+
+// "indirect": result = table[counter & (size-1)](result), through a table of 'size' (power of 2) functions that
+// each add a different constant
+static void s_build_indirect(qvm_builder_t* b, int size) {
+    int* funcs = (int*)malloc(size * sizeof(int));
+    char name[32];
+    for (int i = 0; i < size; i++) {
+        snprintf(name, sizeof(name), "t%d", i);
+        funcs[i] = qvm_builder_symbol(b, name, QVM_SEG_CODE);
+    }
+    int table = qvm_builder_symbol(b, "table", QVM_SEG_DATA);
+    qvm_builder_place(b, table);
+    for (int i = 0; i < size; i++)
+        qvm_builder_data_symbol(b, funcs[i], 0);
+
+    loop_t loop = s_main_begin(b, MAIN_LOCALS);
+    OP(LOCAL, MAIN_RESULT);
+    OP(LOCAL, MAIN_RESULT);
+    OP(LOAD4, 0);
+    OP(ARG, 8);
+    OPSYM(CONST, table);
+    OP(LOCAL, MAIN_COUNTER);
+    OP(LOAD4, 0);
+    OP(CONST, size - 1);
+    OP(BAND, 0);
+    OP(CONST, 2);
+    OP(LSH, 0);
+    OP(ADD, 0);
+    OP(LOAD4, 0);
+    OP(CALL, 0);
+    OP(STORE4, 0);
+    s_main_end(b, loop);
+
+    for (int i = 0; i < size; i++) {
+        qvm_builder_place(b, funcs[i]);
+        OP(ENTER, 8);
+        OP(LOCAL, 16);
+        OP(LOAD4, 0);
+        OP(CONST, i * 7 + 1);
+        OP(ADD, 0);
+        OP(LEAVE, 8);
+    }
+
+    free(funcs);
+}
+
+
+// "syscalls": 'size' copies of result = syscall0(result)
+static void s_build_syscalls(qvm_builder_t* b, int size) {
+    loop_t loop = s_main_begin(b, MAIN_LOCALS);
+    for (int i = 0; i < size; i++) {
+        OP(LOCAL, MAIN_RESULT);
+        OP(LOCAL, MAIN_RESULT);
+        OP(LOAD4, 0);
+        OP(ARG, 8);
+        OP(CONST, -1);
+        OP(CALL, 0);
+        OP(STORE4, 0);
+    }
+    s_main_end(b, loop);
+}
+
+
+typedef struct workload_s {
+    const char* name;
+    void (*build)(qvm_builder_t* b, int size);
+    int size;                       // default size
+    int iterations;                 // default iterations for "run"
+    const char* description;
+} workload_t;
+
+static workload_t s_workloads[] = {
+    { "arith",      s_build_arith,      8,  200000, "integer math on locals, 'size' statements per iteration" },
+    { "float",      s_build_float,      8,  200000, "float math on locals, 'size' statements per iteration" },
+    { "calls",      s_build_calls,      16, 50000,  "call chain 'size' functions deep per iteration" },
+    { "blockcopy",  s_build_blockcopy,  64, 200000, "8 BLOCK_COPYs of 'size' bytes per iteration" },
+    { "indirect",   s_build_indirect,   16, 500000, "call through a table of 'size' (power of 2) function pointers" },
+    { "syscalls",   s_build_syscalls,   8,  200000, "'size' syscalls per iteration" },
+};
+#define NUM_WORKLOADS (sizeof(s_workloads) / sizeof(s_workloads[0]))
+
+
+static const workload_t* s_find_workload(const char* name) {
+    for (size_t i = 0; i < NUM_WORKLOADS; i++) {
+        if (!strcmp(s_workloads[i].name, name))
+            return &s_workloads[i];
+    }
+    return NULL;
+}
+
+
+// allocators compared by "run --alloc" (otherwise qvm_load's default is used)
+static qvm_alloc_t* s_allocators[] = { &qvm_allocator_default, &qvm_allocator_mmap };
+static const char* s_allocnames[] = { "malloc", "mmap" };
+#define NUM_ALLOCATORS (sizeof(s_allocators) / sizeof(s_allocators[0]))
+static int s_compare_alloc = 0;
+
+
+// timing of one workload load
+typedef struct timing_s {
+    uint64_t load;          // qvm_load, in ns
+    uint64_t first;         // first vmMain(iterations) after loading, in ns
+    uint64_t best;          // fastest of several runs, in ns
+    uint64_t instructions;  // VM instructions per run
+    int result;
+} timing_t;
+
+
+// load a workload with the given flags and allocator, and time vmMain(iterations)
+static timing_t s_time(const uint8_t* image, size_t size, int flags, qvm_alloc_t* allocator, int iterations) {
+    timing_t t;
+    qvm_t qvm;
+    memset(&qvm, 0, sizeof(qvm));
+    uint64_t start = s_now_ns();
+    if (!qvm_load(&qvm, image, size, s_syscall, flags, allocator)) {
+        fprintf(stderr, "qvm_bench: qvm_load failed with flags %d\n", flags);
+        exit(1);
+    }
+    t.load = s_now_ns() - start;
+
+    t.best = UINT64_MAX;
+    for (int run = 0; run < 5; run++) {
+        uint64_t before = qvm.instructions;
+        start = s_now_ns();
+        t.result = qvm_exec(&qvm, 1, &iterations);
+        uint64_t elapsed = s_now_ns() - start;
+        t.instructions = qvm.instructions - before;
+        if (!run)
+            t.first = elapsed;
+        if (elapsed < t.best)
+            t.best = elapsed;
+    }
+
+    qvm_unload(&qvm);
+    return t;
+}
+
+
+static uint8_t* s_build(const workload_t* workload, int size, size_t* imagesize, char** map, size_t* maplen) {
+    qvm_builder_t b;
+    qvm_builder_init(&b);
+    workload->build(&b, size);
+    uint8_t* image = qvm_builder_finish(&b, imagesize);
+    if (image && map)
+        *map = qvm_builder_map(&b, maplen);
+    qvm_builder_free(&b);
+    if (!image) {
+        fprintf(stderr, "qvm_bench: Could not build workload '%s'\n", workload->name);
+        exit(1);
+    }
+    return image;
+}
+
+
+static const int s_flags[] = { QVM_LOAD_VERIFY_DATA, QVM_LOAD_VERIFY_DATA | QVM_LOAD_OPTIMIZE, QVM_LOAD_VERIFY_DATA | QVM_LOAD_OPTIMIZE | QVM_LOAD_INLINE };
+static const char* s_flagnames[] = { "interp", "optimize", "inline" };
+#define NUM_FLAGS (sizeof(s_flags) / sizeof(s_flags[0]))
+
+
+static void s_run(const workload_t* workload, int size, int iterations) {
+    if (size <= 0)
+        size = workload->size;
+    if (iterations <= 0)
+        iterations = workload->iterations;
+
+    size_t imagesize;
+    uint8_t* image = s_build(workload, size, &imagesize, NULL, NULL);
+
+    int result = 0;
+    for (size_t f = 0; f < NUM_FLAGS; f++) {
+        for (size_t a = 0; a < (s_compare_alloc ? NUM_ALLOCATORS : 1); a++) {
+            timing_t t = s_time(image, imagesize, s_flags[f], s_compare_alloc ? s_allocators[a] : NULL, iterations);
+            if (!f && !a)
+                result = t.result;
+            printf("%-10s %5d  %-8s  %10.2f ns/iter  %8.1f instr/iter  %6.2f ns/instr", workload->name, size, s_flagnames[f],
+                (double)t.best / iterations, (double)t.instructions / iterations, t.instructions ? (double)t.best / t.instructions : 0.0);
+            // allocator cost shows up in qvm_load and in the page faults of the first run
+            if (s_compare_alloc)
+                printf("  %-6s  load %8.1f us  first run %10.2f ns/iter", s_allocnames[a], t.load / 1000.0, (double)t.first / iterations);
+            printf("%s\n", t.result != result ? "  RESULT MISMATCH" : "");
+        }
+    }
+
+    free(image);
+}
+
+
+// per-opcode patterns. locals: | 24 int a | 28 int b | 32 float a | 36 float b | 40 64 bytes | 104 64 bytes |
+#define OPS_UNROLL      16
+#define OPS_FRAMESIZE   168
+
+typedef enum {
+    PAT_LOOP,               // nothing (cost of the loop itself)
+    PAT_BINARY,             // result = a OP b
+    PAT_BINARY_F,           // result = fa OP fb
+    PAT_UNARY,              // result = OP a
+    PAT_UNARY_F,            // result = OP fa
+    PAT_LOAD,               // result = OP(&a)
+    PAT_STORE,              // OP(&result, a)
+    PAT_BRANCH,             // if (a OP b) goto next
+    PAT_BRANCH_F,           // if (fa OP fb) goto next
+    PAT_CONST,              // CONST, POP
+    PAT_LOCAL,              // LOCAL, POP
+    PAT_PUSH,               // PUSH, POP
+    PAT_ARG,                // a -> ARG
+    PAT_JUMP,               // CONST next, JUMP
+    PAT_CALL,               // CONST leaf, CALL, POP
+    PAT_SYSCALL,            // CONST -1, CALL, POP
+    PAT_BLOCK_COPY,         // copy 'param' bytes between locals
+} pattern_t;
+
+typedef struct opbench_s {
+    const char* name;
+    pattern_t pattern;
+    qvmopcode_t op;
+    int param;
+} opbench_t;
+
+static opbench_t s_opbenches[] = {
+    { "(loop)",         PAT_LOOP,       QVM_OP_NOP,         0 },
+    { "CONST",          PAT_CONST,      QVM_OP_CONST,       0 },
+    { "LOCAL",          PAT_LOCAL,      QVM_OP_LOCAL,       0 },
+    { "PUSH",           PAT_PUSH,       QVM_OP_PUSH,        0 },
+    { "ARG",            PAT_ARG,        QVM_OP_ARG,         0 },
+    { "JUMP",           PAT_JUMP,       QVM_OP_JUMP,        0 },
+    { "CALL",           PAT_CALL,       QVM_OP_CALL,        0 },
+    { "CALL (syscall)", PAT_SYSCALL,    QVM_OP_CALL,        0 },
+    { "LOAD1",          PAT_LOAD,       QVM_OP_LOAD1,       0 },
+    { "LOAD2",          PAT_LOAD,       QVM_OP_LOAD2,       0 },
+    { "LOAD4",          PAT_LOAD,       QVM_OP_LOAD4,       0 },
+    { "STORE1",         PAT_STORE,      QVM_OP_STORE1,      0 },
+    { "STORE2",         PAT_STORE,      QVM_OP_STORE2,      0 },
+    { "STORE4",         PAT_STORE,      QVM_OP_STORE4,      0 },
+    { "EQ",             PAT_BRANCH,     QVM_OP_EQ,          0 },
+    { "NE",             PAT_BRANCH,     QVM_OP_NE,          0 },
+    { "LTI",            PAT_BRANCH,     QVM_OP_LTI,         0 },
+    { "LEI",            PAT_BRANCH,     QVM_OP_LEI,         0 },
+    { "GTI",            PAT_BRANCH,     QVM_OP_GTI,         0 },
+    { "GEI",            PAT_BRANCH,     QVM_OP_GEI,         0 },
+    { "LTU",            PAT_BRANCH,     QVM_OP_LTU,         0 },
+    { "LEU",            PAT_BRANCH,     QVM_OP_LEU,         0 },
+    { "GTU",            PAT_BRANCH,     QVM_OP_GTU,         0 },
+    { "GEU",            PAT_BRANCH,     QVM_OP_GEU,         0 },
+    { "EQF",            PAT_BRANCH_F,   QVM_OP_EQF,         0 },
+    { "NEF",            PAT_BRANCH_F,   QVM_OP_NEF,         0 },
+    { "LTF",            PAT_BRANCH_F,   QVM_OP_LTF,         0 },
+    { "LEF",            PAT_BRANCH_F,   QVM_OP_LEF,         0 },
+    { "GTF",            PAT_BRANCH_F,   QVM_OP_GTF,         0 },
+    { "GEF",            PAT_BRANCH_F,   QVM_OP_GEF,         0 },
+    { "SEX8",           PAT_UNARY,      QVM_OP_SEX8,        0 },
+    { "SEX16",          PAT_UNARY,      QVM_OP_SEX16,       0 },
+    { "NEGI",           PAT_UNARY,      QVM_OP_NEGI,        0 },
+    { "BCOM",           PAT_UNARY,      QVM_OP_BCOM,        0 },
+    { "CVIF",           PAT_UNARY,      QVM_OP_CVIF,        0 },
+    { "NEGF",           PAT_UNARY_F,    QVM_OP_NEGF,        0 },
+    { "CVFI",           PAT_UNARY_F,    QVM_OP_CVFI,        0 },
+    { "ADD",            PAT_BINARY,     QVM_OP_ADD,         0 },
+    { "SUB",            PAT_BINARY,     QVM_OP_SUB,         0 },
+    { "DIVI",           PAT_BINARY,     QVM_OP_DIVI,        0 },
+    { "DIVU",           PAT_BINARY,     QVM_OP_DIVU,        0 },
+    { "MODI",           PAT_BINARY,     QVM_OP_MODI,        0 },
+    { "MODU",           PAT_BINARY,     QVM_OP_MODU,        0 },
+    { "MULI",           PAT_BINARY,     QVM_OP_MULI,        0 },
+    { "MULU",           PAT_BINARY,     QVM_OP_MULU,        0 },
+    { "BAND",           PAT_BINARY,     QVM_OP_BAND,        0 },
+    { "BOR",            PAT_BINARY,     QVM_OP_BOR,         0 },
+    { "BXOR",           PAT_BINARY,     QVM_OP_BXOR,        0 },
+    { "LSH",            PAT_BINARY,     QVM_OP_LSH,         0 },
+    { "RSHI",           PAT_BINARY,     QVM_OP_RSHI,        0 },
+    { "RSHU",           PAT_BINARY,     QVM_OP_RSHU,        0 },
+    { "ADDF",           PAT_BINARY_F,   QVM_OP_ADDF,        0 },
+    { "SUBF",           PAT_BINARY_F,   QVM_OP_SUBF,        0 },
+    { "DIVF",           PAT_BINARY_F,   QVM_OP_DIVF,        0 },
+    { "MULF",           PAT_BINARY_F,   QVM_OP_MULF,        0 },
+    { "BLOCK_COPY 12",  PAT_BLOCK_COPY, QVM_OP_BLOCK_COPY,  12 },
+    { "BLOCK_COPY 16",  PAT_BLOCK_COPY, QVM_OP_BLOCK_COPY,  16 },
+    { "BLOCK_COPY 20",  PAT_BLOCK_COPY, QVM_OP_BLOCK_COPY,  20 },
+    { "BLOCK_COPY 32",  PAT_BLOCK_COPY, QVM_OP_BLOCK_COPY,  32 },
+    { "BLOCK_COPY 64",  PAT_BLOCK_COPY, QVM_OP_BLOCK_COPY,  64 },
+};
+#define NUM_OPBENCHES (sizeof(s_opbenches) / sizeof(s_opbenches[0]))
+
+
+// add one copy of a pattern
+static void s_build_pattern(qvm_builder_t* b, const opbench_t* bench, int leaf) {
+    int next;
+    int a = MAIN_LOCALS, bb = MAIN_LOCALS + 4;
+    if (bench->pattern == PAT_BINARY_F || bench->pattern == PAT_UNARY_F || bench->pattern == PAT_BRANCH_F) {
+        a = MAIN_LOCALS + 8;
+        bb = MAIN_LOCALS + 12;
+    }
+
+    switch (bench->pattern) {
+    case PAT_LOOP:
+        break;
+    case PAT_BINARY:
+    case PAT_BINARY_F:
+        OP(LOCAL, MAIN_RESULT);
+        OP(LOCAL, a);
+        OP(LOAD4, 0);
+        OP(LOCAL, bb);
+        OP(LOAD4, 0);
+        qvm_builder_op(b, bench->op, 0);
+        OP(STORE4, 0);
+        break;
+    case PAT_UNARY:
+    case PAT_UNARY_F:
+        OP(LOCAL, MAIN_RESULT);
+        OP(LOCAL, a);
+        OP(LOAD4, 0);
+        qvm_builder_op(b, bench->op, 0);
+        OP(STORE4, 0);
+        break;
+    case PAT_LOAD:
+        OP(LOCAL, MAIN_RESULT);
+        OP(LOCAL, a);
+        qvm_builder_op(b, bench->op, 0);
+        OP(STORE4, 0);
+        break;
+    case PAT_STORE:
+        OP(LOCAL, MAIN_RESULT);
+        OP(LOCAL, a);
+        OP(LOAD4, 0);
+        qvm_builder_op(b, bench->op, 0);
+        break;
+    case PAT_BRANCH:
+    case PAT_BRANCH_F:
+        next = qvm_builder_symbol(b, NULL, QVM_SEG_CODE);
+        OP(LOCAL, a);
+        OP(LOAD4, 0);
+        OP(LOCAL, bb);
+        OP(LOAD4, 0);
+        qvm_builder_op_symbol(b, bench->op, next, 0);
+        qvm_builder_place(b, next);
+        break;
+    case PAT_CONST:
+        OP(CONST, 1);
+        OP(POP, 0);
+        break;
+    case PAT_LOCAL:
+        OP(LOCAL, a);
+        OP(POP, 0);
+        break;
+    case PAT_PUSH:
+        OP(PUSH, 0);
+        OP(POP, 0);
+        break;
+    case PAT_ARG:
+        OP(LOCAL, a);
+        OP(LOAD4, 0);
+        OP(ARG, 8);
+        break;
+    case PAT_JUMP:
+        next = qvm_builder_symbol(b, NULL, QVM_SEG_CODE);
+        OPSYM(CONST, next);
+        OP(JUMP, 0);
+        qvm_builder_place(b, next);
+        break;
+    case PAT_CALL:
+        OPSYM(CONST, leaf);
+        OP(CALL, 0);
+        OP(POP, 0);
+        break;
+    case PAT_SYSCALL:
+        OP(CONST, -1);
+        OP(CALL, 0);
+        OP(POP, 0);
+        break;
+    case PAT_BLOCK_COPY:
+        OP(LOCAL, MAIN_LOCALS + 80);
+        OP(LOCAL, MAIN_LOCALS + 16);
+        OP(BLOCK_COPY, bench->param);
+        break;
+    }
+}
+
+
+static uint8_t* s_build_opbench(const opbench_t* bench, size_t* imagesize) {
+    float fa = 1.5f, fb = 0.5f;
+    int fabits, fbbits;
+    memcpy(&fabits, &fa, sizeof(fabits));
+    memcpy(&fbbits, &fb, sizeof(fbbits));
+
+    qvm_builder_t builder;
+    qvm_builder_t* b = &builder;
+    qvm_builder_init(b);
+    int leaf = qvm_builder_symbol(b, "leaf", QVM_SEG_CODE);
+
+    loop_t loop = s_main_begin(b, OPS_FRAMESIZE);
+    // operands are set in the loop so the optimizer can't fold them
+    int init[4] = { 7, 3, fabits, fbbits };
+    for (int i = 0; i < 4; i++) {
+        OP(LOCAL, MAIN_LOCALS + i * 4);
+        OP(CONST, init[i]);
+        OP(STORE4, 0);
+    }
+    for (int i = 0; i < OPS_UNROLL; i++)
+        s_build_pattern(b, bench, leaf);
+    s_main_end(b, loop);
+
+    qvm_builder_place(b, leaf);
+    OP(ENTER, 8);
+    OP(CONST, 0);
+    OP(LEAVE, 8);
+
+    uint8_t* image = qvm_builder_finish(b, imagesize);
+    qvm_builder_free(b);
+    if (!image) {
+        fprintf(stderr, "qvm_bench: Could not build opcode benchmark '%s'\n", bench->name);
+        exit(1);
+    }
+    return image;
+}
+
+
+static void s_ops(int iterations) {
+    if (iterations <= 0)
+        iterations = 100000;
+
+    printf("%-16s", "ns per pattern");
+    for (size_t f = 0; f < NUM_FLAGS; f++)
+        printf("  %10s", s_flagnames[f]);
+    printf("\n");
+
+    double loop[NUM_FLAGS] = { 0 };
+    for (size_t i = 0; i < NUM_OPBENCHES; i++) {
+        size_t imagesize;
+        uint8_t* image = s_build_opbench(&s_opbenches[i], &imagesize);
+
+        printf("%-16s", s_opbenches[i].name);
+        for (size_t f = 0; f < NUM_FLAGS; f++) {
+            double ns = (double)s_time(image, imagesize, s_flags[f], NULL, iterations).best / iterations;
+            // the loop is reported as a whole, everything else per pattern without the loop
+            if (s_opbenches[i].pattern == PAT_LOOP) {
+                loop[f] = ns;
+                printf("  %10.2f", ns);
+            }
+            else {
+                printf("  %10.2f", (ns - loop[f]) / OPS_UNROLL);
+            }
+        }
+        printf("\n");
+        free(image);
+    }
+}
+
+
+// one "parallel" thread. each has its own qvm_t, loaded and run entirely on the thread
+typedef struct parallel_s {
+    int id;
+    const uint8_t* image;
+    size_t size;
+    int iterations;
+    int result;
+    int ok;
+    uint64_t ns;
+} parallel_t;
+
+
+// per-instance log callback: userdata is the thread's parallel_t
+static void s_parallel_log(qvm_t* qvm, int severity, const char* msg) {
+    if (severity <= 2)
+        return;
+    fprintf(stderr, "[thread %d] %s", ((parallel_t*)qvm->userdata)->id, msg);
+}
+
+
+static void s_parallel_thread(parallel_t* p) {
+    qvm_t qvm;
+    memset(&qvm, 0, sizeof(qvm));
+    qvm.userdata = p;
+    qvm.log = s_parallel_log;
+    if (!qvm_load(&qvm, p->image, p->size, s_syscall, s_flags[NUM_FLAGS - 1], NULL))
+        return;
+    uint64_t start = s_now_ns();
+    p->result = qvm_exec(&qvm, 1, &p->iterations);
+    p->ns = s_now_ns() - start;
+    // a run-time error unloads the qvm
+    p->ok = qvm.memory != NULL;
+    qvm_unload(&qvm);
+}
+
+
+#ifdef _WIN32
+static DWORD WINAPI s_parallel_entry(LPVOID arg) {
+    s_parallel_thread((parallel_t*)arg);
+    return 0;
+}
+#else
+static void* s_parallel_entry(void* arg) {
+    s_parallel_thread((parallel_t*)arg);
+    return NULL;
+}
+#endif
+
+
+static void s_parallel(const workload_t* workload, int threads, int iterations) {
+    if (threads <= 0)
+        threads = 4;
+    if (iterations <= 0)
+        iterations = workload->iterations;
+
+    size_t imagesize;
+    uint8_t* image = s_build(workload, workload->size, &imagesize, NULL, NULL);
+
+    // result of a single instance to compare against
+    timing_t t = s_time(image, imagesize, s_flags[NUM_FLAGS - 1], NULL, iterations);
+    int expected = t.result;
+    uint64_t single = t.best;
+
+    parallel_t* ps = (parallel_t*)calloc((size_t)threads, sizeof(parallel_t));
+#ifdef _WIN32
+    HANDLE* handles = (HANDLE*)calloc((size_t)threads, sizeof(HANDLE));
+#else
+    pthread_t* handles = (pthread_t*)calloc((size_t)threads, sizeof(pthread_t));
+#endif
+    uint64_t start = s_now_ns();
+    for (int i = 0; i < threads; i++) {
+        ps[i].id = i;
+        ps[i].image = image;
+        ps[i].size = imagesize;
+        ps[i].iterations = iterations;
+#ifdef _WIN32
+        handles[i] = CreateThread(NULL, 0, s_parallel_entry, &ps[i], 0, NULL);
+        if (!handles[i]) {
+#else
+        if (pthread_create(&handles[i], NULL, s_parallel_entry, &ps[i])) {
+#endif
+            fprintf(stderr, "qvm_bench: Could not start thread %d\n", i);
+            exit(1);
+        }
+    }
+    for (int i = 0; i < threads; i++) {
+#ifdef _WIN32
+        WaitForSingleObject(handles[i], INFINITE);
+        CloseHandle(handles[i]);
+#else
+        pthread_join(handles[i], NULL);
+#endif
+    }
+    uint64_t wall = s_now_ns() - start;
+
+    int failed = 0;
+    for (int i = 0; i < threads; i++) {
+        if (!ps[i].ok || ps[i].result != expected) {
+            fprintf(stderr, "qvm_bench: thread %d %s\n", i, ps[i].ok ? "RESULT MISMATCH" : "failed");
+            failed++;
+        }
+    }
+    printf("%-10s %d threads  %10.2f ns/iter single  %10.2f ns/iter all threads  %6.2fx throughput%s\n", workload->name,
+        threads, (double)single / iterations, (double)wall / iterations, (double)single * threads / (wall ? wall : 1),
+        failed ? "  FAILED" : "");
+
+    free(handles);
+    free(ps);
+    free(image);
+    if (failed)
+        exit(1);
+}
+
+
+static void s_slice(const workload_t* workload, uint64_t slice, int iterations) {
+    if (!slice)
+        slice = 10000;
+    if (iterations <= 0)
+        iterations = workload->iterations;
+
+    size_t imagesize;
+    uint8_t* image = s_build(workload, workload->size, &imagesize, NULL, NULL);
+
+    timing_t t = s_time(image, imagesize, s_flags[NUM_FLAGS - 1], NULL, iterations);
+    int expected = t.result;
+    uint64_t single = t.best;
+
+    qvm_t qvm;
+    memset(&qvm, 0, sizeof(qvm));
+    if (!qvm_load(&qvm, image, imagesize, s_syscall, s_flags[NUM_FLAGS - 1], NULL)) {
+        fprintf(stderr, "qvm_bench: qvm_load failed\n");
+        exit(1);
+    }
+
+    int one = 1, result = 0, slices = 1;
+    uint64_t start = s_now_ns();
+    int status = qvm_begin(&qvm, -1, 1, &iterations, slice, 0, &result);
+    while (status == QVM_RUN_YIELDED) {
+        // another call into the VM while the run is paused
+        qvm_exec(&qvm, 1, &one);
+        status = qvm_resume(&qvm, slice, 0, &result);
+        slices++;
+    }
+    uint64_t elapsed = s_now_ns() - start;
+
+    int failed = status != QVM_RUN_DONE || result != expected;
+    printf("%-10s %8llu instr/slice  %6d slices  %10.2f ns/iter single  %10.2f ns/iter sliced%s\n", workload->name,
+        (unsigned long long)slice, slices, (double)single / iterations, (double)elapsed / iterations,
+        failed ? "  RESULT MISMATCH" : "");
+
+    qvm_unload(&qvm);
+    free(image);
+    if (failed)
+        exit(1);
+}
+
+
+// syscall 0 takes one argument
+static int s_shadow_numargs(int cmd) {
+    return cmd == 0 ? 1 : 0;
+}
+
+
+static int s_shadow(const workload_t* workload, int size, int iterations) {
+    if (size <= 0)
+        size = workload->size;
+    // every syscall snapshots the data segment, so shadowed runs are much slower
+    if (iterations <= 0)
+        iterations = workload->iterations / 100 > 0 ? workload->iterations / 100 : 1;
+
+    size_t imagesize;
+    uint8_t* image = s_build(workload, size, &imagesize, NULL, NULL);
+
+    int failed = 0;
+    for (size_t f = 1; f < NUM_FLAGS; f++) {
+        qvm_shadow_t sh;
+        memset(&sh, 0, sizeof(sh));
+        sh.numargs = s_shadow_numargs;
+        qvm_t reference;
+        memset(&reference, 0, sizeof(reference));
+        if (!qvm_load(&reference, image, imagesize, qvm_shadow_syscall, s_flags[0], NULL) ||
+            !qvm_shadow_load(&sh, &reference, image, imagesize, s_syscall, s_flags[f], NULL)) {
+            fprintf(stderr, "qvm_bench: Could not load shadow copy of '%s' with flags %d\n", workload->name, s_flags[f]);
+            exit(1);
+        }
+
+        uint64_t start = s_now_ns();
+        for (int call = 0; call < 3; call++)
+            qvm_shadow_exec(&sh, -1, 1, &iterations, NULL);
+        uint64_t elapsed = s_now_ns() - start;
+
+        printf("%-10s %5d  %-8s  %6llu calls  %8llu syscalls  %4llu divergences  %10.2f ns/iter%s%s\n", workload->name, size,
+            s_flagnames[f], (unsigned long long)sh.calls, (unsigned long long)sh.syscalls, (unsigned long long)sh.divergences,
+            (double)elapsed / (3.0 * iterations), sh.last[0] ? "\n  " : "", sh.last);
+        if (sh.divergences || !qvm_shadow_loaded(&sh))
+            failed = 1;
+
+        qvm_shadow_unload(&sh);
+        qvm_unload(&reference);
+    }
+
+    free(image);
+    return failed;
+}
+
+
+static int s_write_file(const char* path, const void* buf, size_t len) {
+    FILE* f = fopen(path, "wb");
+    if (!f)
+        return 0;
+    size_t written = fwrite(buf, 1, len, f);
+    fclose(f);
+    return written == len;
+}
+
+
+static void s_usage() {
+    fprintf(stderr, "usage: qvm_bench list\n"
+                    "       qvm_bench write <workload> <out.qvm> [size]\n"
+                    "       qvm_bench run [--alloc] [workload|all] [size] [iterations]\n"
+                    "       qvm_bench ops [iterations]\n"
+                    "       qvm_bench parallel [workload] [threads] [iterations]\n"
+                    "       qvm_bench slice [workload] [instructions] [iterations]\n"
+                    "       qvm_bench shadow [workload|all] [size] [iterations]\n");
+    exit(1);
+}
+
+
+int main(int argc, char** argv) {
+    if (argc < 2)
+        s_usage();
+
+    if (!strcmp(argv[1], "list")) {
+        for (size_t i = 0; i < NUM_WORKLOADS; i++)
+            printf("%-10s size %-4d  %s\n", s_workloads[i].name, s_workloads[i].size, s_workloads[i].description);
+    }
+    else if (!strcmp(argv[1], "write")) {
+        if (argc < 4)
+            s_usage();
+        const workload_t* workload = s_find_workload(argv[2]);
+        if (!workload) {
+            fprintf(stderr, "qvm_bench: Unknown workload '%s'\n", argv[2]);
+            return 1;
+        }
+        int size = argc > 4 ? atoi(argv[4]) : 0;
+
+        size_t imagesize, maplen = 0;
+        char* map = NULL;
+        uint8_t* image = s_build(workload, size > 0 ? size : workload->size, &imagesize, &map, &maplen);
+
+        // .map goes next to the .qvm, like q3asm
+        size_t pathlen = strlen(argv[3]);
+        char* mappath = (char*)malloc(pathlen + 5);
+        strcpy(mappath, argv[3]);
+        if (pathlen > 4 && !strcmp(mappath + pathlen - 4, ".qvm"))
+            mappath[pathlen - 4] = '\0';
+        strcat(mappath, ".map");
+
+        if (!s_write_file(argv[3], image, imagesize) || (map && !s_write_file(mappath, map, maplen))) {
+            fprintf(stderr, "qvm_bench: Could not write %s\n", argv[3]);
+            return 1;
+        }
+        printf("Wrote %s (%d bytes) and %s\n", argv[3], (int)imagesize, mappath);
+        free(mappath);
+        free(map);
+        free(image);
+    }
+    else if (!strcmp(argv[1], "run")) {
+        // --alloc: run everything under each allocator
+        if (argc > 2 && !strcmp(argv[2], "--alloc")) {
+            s_compare_alloc = 1;
+            argv++;
+            argc--;
+        }
+        const char* name = argc > 2 ? argv[2] : "all";
+        int size = argc > 3 ? atoi(argv[3]) : 0;
+        int iterations = argc > 4 ? atoi(argv[4]) : 0;
+        if (!strcmp(name, "all")) {
+            for (size_t i = 0; i < NUM_WORKLOADS; i++)
+                s_run(&s_workloads[i], size, iterations);
+        }
+        else {
+            const workload_t* workload = s_find_workload(name);
+            if (!workload) {
+                fprintf(stderr, "qvm_bench: Unknown workload '%s'\n", name);
+                return 1;
+            }
+            s_run(workload, size, iterations);
+        }
+    }
+    else if (!strcmp(argv[1], "ops")) {
+        s_ops(argc > 2 ? atoi(argv[2]) : 0);
+    }
+    else if (!strcmp(argv[1], "parallel")) {
+        const char* name = argc > 2 ? argv[2] : "calls";
+        const workload_t* workload = s_find_workload(name);
+        if (!workload) {
+            fprintf(stderr, "qvm_bench: Unknown workload '%s'\n", name);
+            return 1;
+        }
+        s_parallel(workload, argc > 3 ? atoi(argv[3]) : 0, argc > 4 ? atoi(argv[4]) : 0);
+    }
+    else if (!strcmp(argv[1], "slice")) {
+        const char* name = argc > 2 ? argv[2] : "calls";
+        const workload_t* workload = s_find_workload(name);
+        if (!workload) {
+            fprintf(stderr, "qvm_bench: Unknown workload '%s'\n", name);
+            return 1;
+        }
+        s_slice(workload, argc > 3 ? strtoull(argv[3], NULL, 10) : 0, argc > 4 ? atoi(argv[4]) : 0);
+    }
+    else if (!strcmp(argv[1], "shadow")) {
+        const char* name = argc > 2 ? argv[2] : "all";
+        int size = argc > 3 ? atoi(argv[3]) : 0;
+        int iterations = argc > 4 ? atoi(argv[4]) : 0;
+        int failed = 0;
+        if (!strcmp(name, "all")) {
+            for (size_t i = 0; i < NUM_WORKLOADS; i++)
+                failed |= s_shadow(&s_workloads[i], size, iterations);
+        }
+        else {
+            const workload_t* workload = s_find_workload(name);
+            if (!workload) {
+                fprintf(stderr, "qvm_bench: Unknown workload '%s'\n", name);
+                return 1;
+            }
+            failed = s_shadow(workload, size, iterations);
+        }
+        if (failed)
+            return 1;
+    }
+    else {
+        s_usage();
+    }
+
+    return 0;
+}
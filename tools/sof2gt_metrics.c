@@ -0,0 +1,162 @@
+/*
+SoF2GT_QMM - Hook gametype dlls/qvms for Soldier of Fortune 2
+Copyright 2025-2026
+https://github.com/thecybermind/sof2gt_qmm/
+3-clause BSD license: https://opensource.org/license/bsd-3-clause
+
+Created By:
+    Kevin Masterson < k.m.masterson@gmail.com >
+
+*/
+
+/* sof2gt_metrics - print the shared memory metrics of running servers in Prometheus text format
+ *
+ * usage: sof2gt_metrics <port> [port...]
+ *
+ * Servers export metrics with "sof2gt_metrics 1" (see sof2gt_metrics.h). This only maps the shared memory
+ * object read-only and never blocks the server: if a server is in the middle of updating its counters, the
+ * copy is retried. Servers that aren't running (or don't export metrics) are skipped.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <sched.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#include "sof2gt_metrics.h"
+
+#define NS_PER_SEC 1000000000.0
+
+
+// copy a consistent snapshot of the counters. returns 0 if the writer kept them busy
+static int s_snapshot(const sof2gt_metrics_t* shared, sof2gt_metrics_t* copy) {
+    for (int tries = 0; tries < 1000; tries++) {
+        uint32_t seq = __atomic_load_n(&shared->seq, __ATOMIC_ACQUIRE);
+        if (seq & 1) {
+            sched_yield();
+            continue;
+        }
+        memcpy(copy, shared, sizeof(*copy));
+        __atomic_thread_fence(__ATOMIC_ACQUIRE);
+        if (__atomic_load_n(&shared->seq, __ATOMIC_RELAXED) == seq)
+            return 1;
+    }
+    return 0;
+}
+
+
+// map a server's metrics and take a snapshot. returns 0 if it isn't available
+static int s_read(int port, sof2gt_metrics_t* metrics) {
+    char name[64] = "/";
+    snprintf(name + 1, sizeof(name) - 1, SOF2GT_METRICS_NAME, port);
+
+    int fd = shm_open(name, O_RDONLY, 0);
+    if (fd < 0)
+        return 0;
+    void* view = mmap(NULL, sizeof(sof2gt_metrics_t), PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (view == MAP_FAILED)
+        return 0;
+
+    const sof2gt_metrics_t* shared = (const sof2gt_metrics_t*)view;
+    int ok = __atomic_load_n(&shared->magic, __ATOMIC_ACQUIRE) == SOF2GT_METRICS_MAGIC &&
+             shared->version == SOF2GT_METRICS_VERSION &&
+             shared->size == sizeof(sof2gt_metrics_t) &&
+             s_snapshot(shared, metrics);
+    munmap(view, sizeof(sof2gt_metrics_t));
+    return ok;
+}
+
+
+// print HELP/TYPE lines for a metric
+static void s_header(const char* name, const char* type, const char* help) {
+    printf("# HELP %s %s\n# TYPE %s %s\n", name, help, name, type);
+}
+
+
+int main(int argc, char* argv[]) {
+    if (argc < 2) {
+        fprintf(stderr, "usage: sof2gt_metrics <port> [port...]\n");
+        return 1;
+    }
+
+    int count = argc - 1;
+    sof2gt_metrics_t* servers = (sof2gt_metrics_t*)calloc(count, sizeof(sof2gt_metrics_t));
+    int* valid = (int*)calloc(count, sizeof(int));
+    for (int i = 0; i < count; i++)
+        valid[i] = s_read(atoi(argv[i + 1]), &servers[i]);
+
+    // metrics are grouped by name, as the text format requires
+    s_header("sof2gt_info", "gauge", "Server process and current gametype");
+    for (int i = 0; i < count; i++) {
+        if (valid[i])
+            printf("sof2gt_info{port=\"%d\",pid=\"%d\",gametype=\"%.*s\"} 1\n", servers[i].port, servers[i].pid, (int)sizeof(servers[i].gametype), servers[i].gametype);
+    }
+
+    s_header("sof2gt_syscall_calls_total", "counter", "Gametype syscalls by cmd");
+    for (int i = 0; i < count; i++) {
+        for (int cmd = 0; valid[i] && cmd < SOF2GT_METRICS_SYSCALLS; cmd++) {
+            if (servers[i].syscalls[cmd].calls)
+                printf("sof2gt_syscall_calls_total{port=\"%d\",cmd=\"%d\"} %llu\n", servers[i].port, cmd, (unsigned long long)servers[i].syscalls[cmd].calls);
+        }
+    }
+    s_header("sof2gt_syscall_seconds_total", "counter", "Time spent in gametype syscalls by cmd, including plugin hooks");
+    for (int i = 0; i < count; i++) {
+        for (int cmd = 0; valid[i] && cmd < SOF2GT_METRICS_SYSCALLS; cmd++) {
+            if (servers[i].syscalls[cmd].calls)
+                printf("sof2gt_syscall_seconds_total{port=\"%d\",cmd=\"%d\"} %.9f\n", servers[i].port, cmd, servers[i].syscalls[cmd].ns / NS_PER_SEC);
+        }
+    }
+
+    s_header("sof2gt_vmmain_calls_total", "counter", "Gametype vmMain calls by cmd");
+    for (int i = 0; i < count; i++) {
+        for (int cmd = 0; valid[i] && cmd < SOF2GT_METRICS_VMMAIN; cmd++) {
+            if (servers[i].vmmain[cmd].calls)
+                printf("sof2gt_vmmain_calls_total{port=\"%d\",cmd=\"%d\"} %llu\n", servers[i].port, cmd, (unsigned long long)servers[i].vmmain[cmd].calls);
+        }
+    }
+    s_header("sof2gt_vmmain_seconds_total", "counter", "Time spent in gametype vmMain calls by cmd");
+    for (int i = 0; i < count; i++) {
+        for (int cmd = 0; valid[i] && cmd < SOF2GT_METRICS_VMMAIN; cmd++) {
+            if (servers[i].vmmain[cmd].calls)
+                printf("sof2gt_vmmain_seconds_total{port=\"%d\",cmd=\"%d\"} %.9f\n", servers[i].port, cmd, servers[i].vmmain[cmd].ns / NS_PER_SEC);
+        }
+    }
+
+    s_header("sof2gt_qvm_instructions_total", "counter", "QVM instructions executed");
+    for (int i = 0; i < count; i++) {
+        if (valid[i])
+            printf("sof2gt_qvm_instructions_total{port=\"%d\"} %llu\n", servers[i].port, (unsigned long long)servers[i].qvm_instructions);
+    }
+    s_header("sof2gt_qvm_runtime_errors_total", "counter", "QVM run-time errors");
+    for (int i = 0; i < count; i++) {
+        if (valid[i])
+            printf("sof2gt_qvm_runtime_errors_total{port=\"%d\"} %llu\n", servers[i].port, (unsigned long long)servers[i].runtime_errors);
+    }
+
+    s_header("sof2gt_loads_total", "counter", "Gametype DLL/QVM loads");
+    for (int i = 0; i < count; i++) {
+        if (valid[i])
+            printf("sof2gt_loads_total{port=\"%d\"} %llu\n", servers[i].port, (unsigned long long)servers[i].loads.calls);
+    }
+    s_header("sof2gt_load_seconds_total", "counter", "Time spent loading gametype DLLs/QVMs");
+    for (int i = 0; i < count; i++) {
+        if (valid[i])
+            printf("sof2gt_load_seconds_total{port=\"%d\"} %.9f\n", servers[i].port, servers[i].loads.ns / NS_PER_SEC);
+    }
+
+    s_header("sof2gt_cache_hits_total", "counter", "Gametype syscalls served from a cache");
+    for (int i = 0; i < count; i++) {
+        if (!valid[i])
+            continue;
+        printf("sof2gt_cache_hits_total{port=\"%d\",cache=\"syscall\"} %llu\n", servers[i].port, (unsigned long long)servers[i].syscall_cache_hits);
+        printf("sof2gt_cache_hits_total{port=\"%d\",cache=\"cvar\"} %llu\n", servers[i].port, (unsigned long long)servers[i].cvar_cache_hits);
+        printf("sof2gt_cache_hits_total{port=\"%d\",cache=\"register\"} %llu\n", servers[i].port, (unsigned long long)servers[i].register_cache_hits);
+    }
+
+    free(valid);
+    free(servers);
+    return 0;
+}